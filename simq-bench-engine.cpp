@@ -0,0 +1,163 @@
+#include "src/core/lib/engine.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string.h>
+#include <stdlib.h>
+
+// Measures the queue engine without the server: every thread holds a
+// producer and a consumer of one channel and does push, pop and ack in a loop.
+//
+// simq-bench-engine -path=/tmp/simq-bench -threads=1,2,4 -seconds=5 -size=256 -shards=1
+
+struct Settings {
+    std::string path = ".";
+    std::vector<unsigned int> threads{ 1 };
+    unsigned int seconds = 5;
+    unsigned int size = 256;
+    unsigned int shards = 1;
+};
+
+std::vector<std::string> split( const std::string &value ) {
+    std::vector<std::string> list;
+    size_t start = 0;
+
+    while( start <= value.size() ) {
+        auto end = value.find( ',', start );
+        if( end == std::string::npos ) {
+            end = value.size();
+        }
+        if( end > start ) {
+            list.push_back( value.substr( start, end - start ) );
+        }
+        start = end + 1;
+    }
+
+    return list;
+}
+
+bool parseArg( const std::string &val, const char *mask, std::string &out ) {
+    auto l = strlen( mask );
+
+    if( strncmp( val.c_str(), mask, l ) != 0 ) {
+        return false;
+    }
+
+    out = val.substr( l );
+
+    return true;
+}
+
+void runThread(
+    const Settings *settings,
+    simq::core::lib::Engine *engine,
+    std::atomic_bool *isStop,
+    std::atomic_ulong *total,
+    std::atomic_bool *isFailed
+) {
+    try {
+        auto producer = engine->createProducer( "bench", "bench" );
+        auto consumer = engine->createConsumer( "bench", "bench" );
+
+        std::vector<char> out( settings->size, 'x' );
+        simq::core::lib::Delivery delivery;
+        unsigned long count = 0;
+
+        while( !isStop->load( std::memory_order_relaxed ) ) {
+            producer->push( out.data(), out.size() );
+
+            if( consumer->pop( delivery ) ) {
+                consumer->ack( delivery );
+                count++;
+            }
+        }
+
+        *total += count;
+    } catch( simq::util::Error::Err err ) {
+        std::cerr << simq::util::Error::getDescription( err ) << std::endl;
+        *isFailed = true;
+    } catch( ... ) {
+        *isFailed = true;
+    }
+}
+
+bool runRound( const Settings &settings, unsigned int countThreads ) {
+    simq::core::lib::Engine engine( settings.path.c_str() );
+    simq::util::types::ChannelLimitMessages limits{ 1, settings.size, 1'000'000, 0 };
+
+    try {
+        engine.addChannel( "bench", "bench", limits, settings.shards );
+    } catch( simq::util::Error::Err err ) {
+        std::cerr << simq::util::Error::getDescription( err ) << std::endl;
+        return false;
+    }
+
+    std::atomic_bool isStop{ false };
+    std::atomic_bool isFailed{ false };
+    std::atomic_ulong total{ 0 };
+    std::vector<std::thread> threads;
+
+    for( unsigned int i = 0; i < countThreads; i++ ) {
+        threads.emplace_back( runThread, &settings, &engine, &isStop, &total, &isFailed );
+    }
+
+    std::this_thread::sleep_for( std::chrono::seconds( settings.seconds ) );
+    isStop = true;
+
+    for( auto &t : threads ) {
+        t.join();
+    }
+
+    if( isFailed ) {
+        std::cerr << "threads=" << countThreads << " failed" << std::endl;
+        return false;
+    }
+
+    std::cout << "threads=" << countThreads
+        << " messages=" << total.load()
+        << " msgs/s=" << total.load() / settings.seconds
+        << std::endl;
+
+    return true;
+}
+
+int main( int argc, char *argv[] ) {
+    Settings settings;
+
+    for( unsigned int i = 1; i < argc; i++ ) {
+        std::string val = std::string( argv[i] );
+        std::string arg;
+
+        if( parseArg( val, "-path=", arg ) ) {
+            settings.path = arg;
+        } else if( parseArg( val, "-threads=", arg ) ) {
+            settings.threads.clear();
+            for( auto &item : split( arg ) ) {
+                settings.threads.push_back( std::stoul( item ) );
+            }
+        } else if( parseArg( val, "-seconds=", arg ) ) {
+            settings.seconds = std::stoul( arg );
+        } else if( parseArg( val, "-size=", arg ) ) {
+            settings.size = std::stoul( arg );
+        } else if( parseArg( val, "-shards=", arg ) ) {
+            settings.shards = std::stoul( arg );
+        }
+    }
+
+    if( settings.seconds == 0 || settings.size == 0 ) {
+        std::cerr << "usage: simq-bench-engine [-path=DIR] [-threads=N[,N...]] [-seconds=N] [-size=N] [-shards=N]" << std::endl;
+        return 1;
+    }
+
+    for( auto countThreads : settings.threads ) {
+        if( !runRound( settings, countThreads ) ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
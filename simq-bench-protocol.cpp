@@ -0,0 +1,168 @@
+#include "src/core/server/protocol.hpp"
+#include "src/util/uuid.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <string.h>
+
+// Runs the command/response cycle of a consumer through Protocol over a
+// socketpair and counts heap allocations on the server side of it.
+// The counters cover the whole process, the client side allocates nothing.
+//
+// simq-bench-protocol -cycles=1000000
+
+std::atomic_ulong countAllocations{ 0 };
+
+void *operator new( size_t size ) {
+    countAllocations.fetch_add( 1, std::memory_order_relaxed );
+
+    if( auto ptr = malloc( size ? size : 1 ) ) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void *operator new[]( size_t size ) {
+    return operator new( size );
+}
+
+void operator delete( void *ptr ) noexcept {
+    free( ptr );
+}
+
+void operator delete[]( void *ptr ) noexcept {
+    free( ptr );
+}
+
+void operator delete( void *ptr, size_t ) noexcept {
+    free( ptr );
+}
+
+void operator delete[]( void *ptr, size_t ) noexcept {
+    free( ptr );
+}
+
+using Protocol = simq::core::server::Protocol;
+
+void writeAll( int fd, const char *data, unsigned int length ) {
+    while( length > 0 ) {
+        auto l = ::write( fd, data, length );
+        if( l <= 0 ) {
+            throw simq::util::Error::SOCKET;
+        }
+        data += l;
+        length -= l;
+    }
+}
+
+void readAll( int fd, char *data, unsigned int length ) {
+    while( length > 0 ) {
+        auto l = ::read( fd, data, length );
+        if( l <= 0 ) {
+            throw simq::util::Error::SOCKET;
+        }
+        data += l;
+        length -= l;
+    }
+}
+
+// CMD_POP_MESSAGE [delay = 0]
+void buildPop( std::vector<char> &frame ) {
+    unsigned int values[4] = {
+        htonl( Protocol::CMD_POP_MESSAGE ),
+        htonl( sizeof( unsigned int ) * 2 ),
+        htonl( sizeof( unsigned int ) ),
+        0,
+    };
+
+    frame.assign( ( char * )values, ( char * )values + sizeof( values ) );
+}
+
+// one pop answered with a message meta and one ack answered with ok
+void cycle( int server, int client, Protocol::Packet *packet, std::vector<char> &pop, std::vector<char> &reply ) {
+    char uuid[simq::util::UUID::LENGTH+1];
+    memset( uuid, 'a', simq::util::UUID::LENGTH );
+    uuid[simq::util::UUID::LENGTH] = 0;
+
+    writeAll( client, pop.data(), pop.size() );
+
+    do {
+        Protocol::recv( server, packet );
+    } while( !Protocol::isFull( packet ) );
+
+    if( !Protocol::isPopMessage( packet ) ) {
+        throw simq::util::Error::WRONG_CMD;
+    }
+
+    Protocol::prepareMessageMetaPop( packet, 256, uuid, 1 );
+    while( !Protocol::send( server, packet ) );
+    readAll( client, reply.data(), packet->length );
+
+    Protocol::prepareOk( packet );
+    while( !Protocol::send( server, packet ) );
+    readAll( client, reply.data(), packet->length );
+}
+
+int main( int argc, char *argv[] ) {
+    unsigned long cycles = 1'000'000;
+
+    for( int i = 1; i < argc; i++ ) {
+        std::string val = argv[i];
+
+        if( val.rfind( "-cycles=", 0 ) == 0 ) {
+            cycles = std::stoul( val.substr( 8 ) );
+        }
+    }
+
+    int fds[2];
+    if( socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds ) == -1 ) {
+        std::cerr << "socketpair failed" << std::endl;
+        return 1;
+    }
+
+    try {
+        auto packet = std::make_unique<Protocol::Packet>();
+        std::vector<char> pop;
+        std::vector<char> reply( Protocol::PACKET_SIZE );
+
+        buildPop( pop );
+
+        // warm up: the session buffers reach their steady size
+        for( unsigned int i = 0; i < 16; i++ ) {
+            cycle( fds[0], fds[1], packet.get(), pop, reply );
+        }
+
+        auto before = countAllocations.load();
+        auto start = std::chrono::steady_clock::now();
+
+        for( unsigned long i = 0; i < cycles; i++ ) {
+            cycle( fds[0], fds[1], packet.get(), pop, reply );
+        }
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+        auto allocations = countAllocations.load() - before;
+
+        std::cout << "cycles=" << cycles
+            << " allocations=" << allocations
+            << " allocations/cycle=" << ( double )allocations / cycles
+            << " ns/cycle=" << ns / cycles
+            << std::endl;
+    } catch( simq::util::Error::Err err ) {
+        std::cerr << simq::util::Error::getDescription( err ) << std::endl;
+        return 1;
+    }
+
+    close( fds[0] );
+    close( fds[1] );
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "src/core/bench/client.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string.h>
+
+// Load generator for comparing threading modes of the server. Every thread
+// holds one producer and one consumer connection to a channel (channels are
+// dealt round-robin) and does push, pop and ack in a loop.
+//
+// simq-bench -host=127.0.0.1 -port=4012 -group=g -channels=c1,c2 -consumer=cons
+//     -producer=prod -password=pass -threads=1,2,4,8,16,32,64 -seconds=5 -size=256
+
+struct Settings {
+    std::string host = "127.0.0.1";
+    unsigned short int port = 4012;
+    std::string group;
+    std::vector<std::string> channels;
+    std::string consumer;
+    std::string producer;
+    std::string password;
+    std::vector<unsigned int> threads{ 1 };
+    unsigned int seconds = 5;
+    unsigned int size = 256;
+};
+
+std::vector<std::string> split( const std::string &value ) {
+    std::vector<std::string> list;
+    size_t start = 0;
+
+    while( start <= value.size() ) {
+        auto end = value.find( ',', start );
+        if( end == std::string::npos ) {
+            end = value.size();
+        }
+        if( end > start ) {
+            list.push_back( value.substr( start, end - start ) );
+        }
+        start = end + 1;
+    }
+
+    return list;
+}
+
+bool parseArg( const std::string &val, const char *mask, std::string &out ) {
+    auto l = strlen( mask );
+
+    if( strncmp( val.c_str(), mask, l ) != 0 ) {
+        return false;
+    }
+
+    out = val.substr( l );
+
+    return true;
+}
+
+struct Pair {
+    std::unique_ptr<simq::core::bench::Client> producer;
+    std::unique_ptr<simq::core::bench::Client> consumer;
+};
+
+// connections are opened one by one before the clock starts,
+// so the round measures only the data plane
+std::unique_ptr<Pair> connect( const Settings &settings, unsigned int index ) {
+    auto &channel = settings.channels[index % settings.channels.size()];
+    auto pair = std::make_unique<Pair>();
+
+    pair->producer = std::make_unique<simq::core::bench::Client>( settings.host.c_str(), settings.port );
+    pair->producer->authProducer(
+        settings.group.c_str(),
+        channel.c_str(),
+        settings.producer.c_str(),
+        settings.password.c_str()
+    );
+
+    pair->consumer = std::make_unique<simq::core::bench::Client>( settings.host.c_str(), settings.port );
+    pair->consumer->authConsumer(
+        settings.group.c_str(),
+        channel.c_str(),
+        settings.consumer.c_str(),
+        settings.password.c_str()
+    );
+
+    return pair;
+}
+
+void runThread(
+    const Settings *settings,
+    Pair *pair,
+    std::atomic_bool *isStop,
+    std::atomic_ulong *total,
+    std::atomic_bool *isFailed
+) {
+    try {
+        std::vector<char> out( settings->size, 'x' );
+        std::vector<char> in;
+        unsigned long count = 0;
+
+        while( !isStop->load( std::memory_order_relaxed ) ) {
+            pair->producer->push( out.data(), out.size() );
+
+            if( pair->consumer->pop( in ) ) {
+                pair->consumer->ack();
+                count++;
+            }
+        }
+
+        *total += count;
+    } catch( simq::util::Error::Err err ) {
+        std::cerr << simq::util::Error::getDescription( err ) << std::endl;
+        *isFailed = true;
+    } catch( ... ) {
+        *isFailed = true;
+    }
+}
+
+bool runRound( const Settings &settings, unsigned int countThreads ) {
+    std::atomic_bool isStop{ false };
+    std::atomic_bool isFailed{ false };
+    std::atomic_ulong total{ 0 };
+    std::vector<std::unique_ptr<Pair>> pairs;
+    std::vector<std::thread> threads;
+
+    try {
+        for( unsigned int i = 0; i < countThreads; i++ ) {
+            pairs.push_back( connect( settings, i ) );
+        }
+    } catch( simq::util::Error::Err err ) {
+        std::cerr << "threads=" << countThreads << " " << simq::util::Error::getDescription( err ) << std::endl;
+        return false;
+    }
+
+    for( auto &pair : pairs ) {
+        threads.emplace_back( runThread, &settings, pair.get(), &isStop, &total, &isFailed );
+    }
+
+    std::this_thread::sleep_for( std::chrono::seconds( settings.seconds ) );
+    isStop = true;
+
+    for( auto &t : threads ) {
+        t.join();
+    }
+
+    if( isFailed ) {
+        std::cerr << "threads=" << countThreads << " failed" << std::endl;
+        return false;
+    }
+
+    std::cout << "threads=" << countThreads
+        << " messages=" << total.load()
+        << " msgs/s=" << total.load() / settings.seconds
+        << std::endl;
+
+    return true;
+}
+
+int main( int argc, char *argv[] ) {
+    Settings settings;
+
+    for( unsigned int i = 1; i < argc; i++ ) {
+        std::string val = std::string( argv[i] );
+        std::string arg;
+
+        if( parseArg( val, "-host=", arg ) ) {
+            settings.host = arg;
+        } else if( parseArg( val, "-port=", arg ) ) {
+            settings.port = std::stoul( arg );
+        } else if( parseArg( val, "-group=", arg ) ) {
+            settings.group = arg;
+        } else if( parseArg( val, "-channels=", arg ) ) {
+            settings.channels = split( arg );
+        } else if( parseArg( val, "-consumer=", arg ) ) {
+            settings.consumer = arg;
+        } else if( parseArg( val, "-producer=", arg ) ) {
+            settings.producer = arg;
+        } else if( parseArg( val, "-password=", arg ) ) {
+            settings.password = arg;
+        } else if( parseArg( val, "-threads=", arg ) ) {
+            settings.threads.clear();
+            for( auto &item : split( arg ) ) {
+                settings.threads.push_back( std::stoul( item ) );
+            }
+        } else if( parseArg( val, "-seconds=", arg ) ) {
+            settings.seconds = std::stoul( arg );
+        } else if( parseArg( val, "-size=", arg ) ) {
+            settings.size = std::stoul( arg );
+        }
+    }
+
+    if( settings.group.empty() || settings.channels.empty() || settings.seconds == 0 ) {
+        std::cerr << "usage: simq-bench -group=G -channels=C[,C...] -consumer=L -producer=L -password=P"
+            << " [-host=H] [-port=N] [-threads=N[,N...]] [-seconds=N] [-size=N]" << std::endl;
+        return 1;
+    }
+
+    for( auto countThreads : settings.threads ) {
+        if( !runRound( settings, countThreads ) ) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -6,6 +6,8 @@
 #include "src/core/server/server/manager.hpp"
 #include "src/core/server/server_controller.hpp"
 #include "src/core/server/sessions.hpp"
+#include "src/core/server/tls.hpp"
+#include "src/util/constants.h"
 #include <thread>
 #include <list>
 #include <string>
@@ -46,7 +48,11 @@ void startServer(
     simq::core::server::Access *access,
     simq::core::server::Changes *changes,
     simq::core::server::q::Manager *q,
-    simq::core::server::Sessions *sess
+    simq::core::server::Sessions *sess,
+    simq::core::server::ServerController::Dispatcher *dispatcher,
+    unsigned int worker,
+    int unixFD,
+    simq::core::server::Tls *tls
 ) {
     if( !isPassedStartServer ) {
         return;
@@ -55,11 +61,18 @@ void startServer(
 
     try {
         simq::core::server::server::Manager server( store->getPort() );
-        simq::core::server::ServerController controller( store, access, changes, q, sess );
+        simq::core::server::ServerController controller( store, access, changes, q, sess, &server, dispatcher, worker, tls );
 
         server.bindController( &controller );
+        server.bindWakeup( controller.getWakeFD() );
+        if( unixFD != -1 ) {
+            server.bindUnixSocket( unixFD );
+        }
 
         std::list<simq::core::server::Logger::Detail> list;
+        if( dispatcher != nullptr ) {
+            simq::core::server::Logger::addItemToDetails( list, "threading", "owner (experimental)" );
+        }
         simq::core::server::Logger::success( simq::core::server::Logger::OP_START_SERVER, 0, list );
 
         server.run();
@@ -82,7 +95,7 @@ void startServer(
     }
 }
 
-void startInit( const char *path = "." ) {
+void startInit( const char *path = ".", bool isOwnerThreading = false ) {
     simq::core::server::Access access;
     simq::core::server::q::Manager q;
     simq::core::server::Sessions sess( &access, &q );
@@ -97,8 +110,52 @@ void startInit( const char *path = "." ) {
     auto changes = ini.getChanges();
     auto store = ini.getStore();
 
+    // The owner mode is an unfinished experiment. Every channel is served by
+    // a single worker and connections are moved there right after
+    // authorization, but operations are not forwarded to the owner yet:
+    // admin commands and consumers of attached channels still reach the
+    // channel from other workers, so the locks of q::Manager stay on
+    std::unique_ptr<simq::core::server::ServerController::Dispatcher> dispatcher;
+    if( isOwnerThreading ) {
+        dispatcher = std::make_unique<simq::core::server::ServerController::Dispatcher>( store->getCountThreads() );
+    }
+
+    // co-located clients skip the TCP stack through the optional unix listener
+    int unixFD = -1;
+    std::string unixSocket;
+    store->getUnixSocket( unixSocket );
+
+    if( !unixSocket.empty() ) {
+        try {
+            unixFD = simq::core::server::server::Manager::createUnixSocket( unixSocket.c_str() );
+        } catch( simq::util::Error::Err err ) {
+            std::list<simq::core::server::Logger::Detail> list;
+            simq::core::server::Logger::addItemToDetails( list, "unixSocket", unixSocket.c_str() );
+            simq::core::server::Logger::fail( simq::core::server::Logger::OP_START_SERVER, err, 0, list );
+            return;
+        }
+    }
+
+    // the secure mode is on when the settings hold a certificate and its key
+    std::unique_ptr<simq::core::server::Tls> tls;
+    std::string certificate;
+    std::string key;
+    simq::util::constants::buildPathToTLSCertificate( certificate, path );
+    simq::util::constants::buildPathToTLSKey( key, path );
+
+    if( ::access( certificate.c_str(), F_OK ) == 0 ) {
+        try {
+            tls = std::make_unique<simq::core::server::Tls>( certificate.c_str(), key.c_str() );
+        } catch( simq::util::Error::Err err ) {
+            std::list<simq::core::server::Logger::Detail> list;
+            simq::core::server::Logger::addItemToDetails( list, "tlsCertificate", certificate.c_str() );
+            simq::core::server::Logger::fail( simq::core::server::Logger::OP_START_SERVER, err, 0, list );
+            return;
+        }
+    }
+
     for( unsigned int i = 0; i < store->getCountThreads(); i++ ) {
-        std::thread t( startServer, store, &access, changes, &q, &sess );
+        std::thread t( startServer, store, &access, changes, &q, &sess, dispatcher.get(), i, unixFD, tls.get() );
         t.detach();
     }
 
@@ -116,6 +173,7 @@ void startInit( const char *path = "." ) {
 
 int main( int argc, char *argv[] ) {
     bool isManager = false;
+    bool isOwnerThreading = false;
     std::string path = ".";
     auto pathMask = "-path=";
     auto lPathMask = strlen( pathMask );
@@ -127,12 +185,14 @@ int main( int argc, char *argv[] ) {
             isManager = true;
         } else if( strncmp( val.c_str(), pathMask, lPathMask ) == 0 ) {
             path = &val.c_str()[lPathMask];
+        } else if( val == "-threading=owner" ) {
+            isOwnerThreading = true;
         }
     }
 
     if( isManager ) {
         startManager( path.c_str() );
     } else {
-        startInit( path.c_str() );
+        startInit( path.c_str(), isOwnerThreading );
     }
 }
@@ -0,0 +1,272 @@
+#ifndef SIMQ_CORE_BENCH_CLIENT
+#define SIMQ_CORE_BENCH_CLIENT
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../server/protocol.hpp"
+#include "../../crypto/hash.hpp"
+#include "../../util/error.h"
+#include "../../util/messages.hpp"
+
+// NO SAFE THREAD!!!
+
+namespace simq::core::bench {
+    // Minimal blocking client speaking the raw protocol, used to load the server
+    class Client {
+        private:
+            using Protocol = server::Protocol;
+
+            int _fd = -1;
+            std::vector<char> _out;
+            std::vector<char> _in;
+
+            void _sendAll( const char *data, unsigned int length );
+            void _recvAll( char *data, unsigned int length );
+
+            void _begin( unsigned int cmd );
+            void _addValue( const void *value, unsigned int length );
+            void _addValue( unsigned int value );
+            void _addValue( const char *value );
+            void _flush();
+
+            unsigned int _recvReply();
+            unsigned int _getValueUInt( unsigned int index );
+            void _expectOk();
+
+            void _hello();
+
+        public:
+            Client( const char *host, unsigned short int port );
+            ~Client();
+
+            void authConsumer( const char *group, const char *channel, const char *login, const char *password );
+            void authProducer( const char *group, const char *channel, const char *login, const char *password );
+
+            void push( const char *data, unsigned int length );
+            bool pop( std::vector<char> &data );
+            void ack();
+    };
+
+    Client::Client( const char *host, unsigned short int port ) {
+        _fd = socket( AF_INET, SOCK_STREAM, 0 );
+        if( _fd == -1 ) {
+            throw util::Error::SOCKET;
+        }
+
+        struct sockaddr_in addr;
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons( port );
+
+        if( inet_pton( AF_INET, host, &addr.sin_addr ) != 1 ) {
+            ::close( _fd );
+            throw util::Error::WRONG_PARAM;
+        }
+
+        if( ::connect( _fd, ( struct sockaddr * )&addr, sizeof( addr ) ) == -1 ) {
+            ::close( _fd );
+            throw util::Error::SOCKET;
+        }
+
+        auto optval = 1;
+        setsockopt( _fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof( optval ) );
+    }
+
+    Client::~Client() {
+        if( _fd != -1 ) {
+            ::close( _fd );
+        }
+    }
+
+    void Client::_sendAll( const char *data, unsigned int length ) {
+        while( length > 0 ) {
+            auto l = ::send( _fd, data, length, MSG_NOSIGNAL );
+            if( l <= 0 ) {
+                throw util::Error::SOCKET;
+            }
+            data += l;
+            length -= l;
+        }
+    }
+
+    void Client::_recvAll( char *data, unsigned int length ) {
+        while( length > 0 ) {
+            auto l = ::recv( _fd, data, length, 0 );
+            if( l <= 0 ) {
+                throw util::Error::SOCKET;
+            }
+            data += l;
+            length -= l;
+        }
+    }
+
+    void Client::_begin( unsigned int cmd ) {
+        _out.resize( Protocol::LENGTH_META );
+
+        auto meta = ( unsigned int * )_out.data();
+        meta[0] = htonl( cmd );
+        meta[1] = 0;
+    }
+
+    void Client::_addValue( const void *value, unsigned int length ) {
+        auto offset = _out.size();
+        _out.resize( offset + sizeof( unsigned int ) + length );
+
+        auto l = htonl( length );
+        memcpy( &_out[offset], &l, sizeof( unsigned int ) );
+        memcpy( &_out[offset + sizeof( unsigned int )], value, length );
+    }
+
+    void Client::_addValue( unsigned int value ) {
+        auto v = htonl( value );
+        _addValue( &v, sizeof( v ) );
+    }
+
+    void Client::_addValue( const char *value ) {
+        _addValue( value, strlen( value ) + 1 );
+    }
+
+    void Client::_flush() {
+        auto meta = ( unsigned int * )_out.data();
+        meta[1] = htonl( _out.size() - Protocol::LENGTH_META );
+
+        _sendAll( _out.data(), _out.size() );
+    }
+
+    unsigned int Client::_recvReply() {
+        unsigned int meta[2];
+        _recvAll( ( char * )meta, sizeof( meta ) );
+
+        _in.resize( ntohl( meta[1] ) );
+        _recvAll( _in.data(), _in.size() );
+
+        return ntohl( meta[0] );
+    }
+
+    unsigned int Client::_getValueUInt( unsigned int index ) {
+        unsigned int offset = 0;
+
+        for( unsigned int i = 0; offset + sizeof( unsigned int ) <= _in.size(); i++ ) {
+            unsigned int length;
+            memcpy( &length, &_in[offset], sizeof( length ) );
+            length = ntohl( length );
+            offset += sizeof( unsigned int );
+
+            if( i == index ) {
+                if( length != sizeof( unsigned int ) || offset + length > _in.size() ) {
+                    break;
+                }
+
+                unsigned int value;
+                memcpy( &value, &_in[offset], sizeof( value ) );
+                return ntohl( value );
+            }
+
+            offset += length;
+        }
+
+        throw util::Error::WRONG_PARAM;
+    }
+
+    void Client::_expectOk() {
+        if( _recvReply() != Protocol::CMD_OK ) {
+            throw util::Error::WRONG_CMD;
+        }
+    }
+
+    void Client::_hello() {
+        _begin( Protocol::CMD_CHECK_NOSECURE );
+        _flush();
+        _expectOk();
+
+        _begin( Protocol::CMD_GET_VERSION );
+        _flush();
+        _expectOk();
+    }
+
+    void Client::authConsumer( const char *group, const char *channel, const char *login, const char *password ) {
+        unsigned char hash[crypto::HASH_LENGTH];
+        crypto::Hash::hash( password, hash );
+
+        _hello();
+
+        _begin( Protocol::CMD_AUTH_CONSUMER );
+        _addValue( group );
+        _addValue( channel );
+        _addValue( login );
+        _addValue( hash, crypto::HASH_LENGTH );
+        _flush();
+        _expectOk();
+    }
+
+    void Client::authProducer( const char *group, const char *channel, const char *login, const char *password ) {
+        unsigned char hash[crypto::HASH_LENGTH];
+        crypto::Hash::hash( password, hash );
+
+        _hello();
+
+        _begin( Protocol::CMD_AUTH_PRODUCER );
+        _addValue( group );
+        _addValue( channel );
+        _addValue( login );
+        _addValue( hash, crypto::HASH_LENGTH );
+        _flush();
+        _expectOk();
+    }
+
+    void Client::push( const char *data, unsigned int length ) {
+        _begin( Protocol::CMD_PUSH_MESSAGE );
+        _addValue( length );
+        _flush();
+        _expectOk();
+
+        for( unsigned int offset = 0; offset < length; offset += Protocol::PACKET_SIZE ) {
+            auto l = util::Messages::getResiduePart( length, offset );
+            _sendAll( &data[offset], l );
+            _expectOk();
+        }
+    }
+
+    bool Client::pop( std::vector<char> &data ) {
+        _begin( Protocol::CMD_POP_MESSAGE );
+        _addValue( 0u );
+        _flush();
+
+        auto cmd = _recvReply();
+
+        if( cmd == Protocol::CMD_SEND_MESSAGE_NONE ) {
+            return false;
+        }
+
+        if( cmd != Protocol::CMD_SEND_MESSAGE_META && cmd != Protocol::CMD_SEND_SIGNAL_MESSAGE_META ) {
+            throw util::Error::WRONG_CMD;
+        }
+
+        auto length = _getValueUInt( 0 );
+        data.resize( length );
+
+        for( unsigned int offset = 0; offset < length; offset += Protocol::PACKET_SIZE ) {
+            _begin( Protocol::CMD_GET_PART_MESSAGE );
+            _flush();
+
+            auto l = util::Messages::getResiduePart( length, offset );
+            _recvAll( &data[offset], l );
+            _expectOk();
+        }
+
+        return true;
+    }
+
+    void Client::ack() {
+        _begin( Protocol::CMD_REMOVE_MESSAGE );
+        _flush();
+        _expectOk();
+    }
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef SIMQ_CORE_LIB_CONSUMER
+#define SIMQ_CORE_LIB_CONSUMER
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <string.h>
+#include "../server/q/manager.hpp"
+#include "../../util/uuid.hpp"
+#include "../../util/error.h"
+
+// NO SAFE THREAD!!!
+
+namespace simq::core::lib {
+    // a popped message, it stays taken until it is acked or rejected
+    struct Delivery {
+        unsigned int id = 0;
+        bool isSignal = false;
+        char uuid[util::UUID::LENGTH+1]{};
+        std::vector<char> data;
+
+        template<typename T>
+        T get() const;
+    };
+
+    template<typename T>
+    T Delivery::get() const {
+        static_assert( std::is_trivially_copyable_v<T>, "T must be trivially copyable" );
+
+        if( data.size() != sizeof( T ) ) {
+            throw util::Error::WRONG_MESSAGE_SIZE;
+        }
+
+        T value;
+        memcpy( &value, data.data(), sizeof( T ) );
+
+        return value;
+    }
+
+    // Pops from one channel of an Engine. Messages that are neither acked nor
+    // rejected go back to the queue when the consumer is destroyed
+    class Consumer {
+        private:
+            struct Taken {
+                unsigned int id;
+                bool isSignal;
+            };
+
+            server::q::Manager *_q = nullptr;
+            server::q::Manager::ChannelHandle _handle;
+            unsigned int _id = 0;
+            std::vector<Taken> _taken;
+
+            void _release( unsigned int id, bool isSignal );
+            void _forget( unsigned int id );
+
+        public:
+            Consumer( server::q::Manager *q, const char *group, const char *channel, unsigned int id );
+            ~Consumer();
+
+            Consumer( const Consumer & ) = delete;
+            Consumer &operator=( const Consumer & ) = delete;
+
+            // false when the channel is empty
+            bool pop( Delivery &delivery );
+            void ack( Delivery &delivery );
+            void reject( Delivery &delivery );
+
+            // notifyFD, an eventfd, is written once on a push after every pop
+            void subscribe( int notifyFD );
+    };
+
+    Consumer::Consumer( server::q::Manager *q, const char *group, const char *channel, unsigned int id ) {
+        _q = q;
+        _id = id;
+        _handle = _q->joinConsumer( group, channel, _id );
+    }
+
+    Consumer::~Consumer() {
+        // returned newest first, so they are redelivered in the order they were popped
+        try {
+            for( auto it = _taken.rbegin(); it != _taken.rend(); it++ ) {
+                _release( it->id, it->isSignal );
+            }
+        } catch( ... ) {}
+
+        _q->leaveConsumer( _handle, _id );
+    }
+
+    void Consumer::_release( unsigned int id, bool isSignal ) {
+        if( isSignal ) {
+            _q->removeMessage( _handle, id );
+        } else {
+            _q->revertMessage( _handle, id );
+        }
+    }
+
+    void Consumer::_forget( unsigned int id ) {
+        auto it = std::find_if( _taken.begin(), _taken.end(), [id]( const Taken &taken ) {
+            return taken.id == id;
+        } );
+
+        if( it == _taken.end() ) {
+            throw util::Error::NOT_FOUND;
+        }
+
+        _taken.erase( it );
+    }
+
+    bool Consumer::pop( Delivery &delivery ) {
+        unsigned int length = 0;
+        delivery.uuid[0] = 0;
+
+        auto id = _q->popMessage( _handle, length, delivery.uuid );
+
+        if( id == 0 ) {
+            return false;
+        }
+
+        delivery.id = id;
+        delivery.isSignal = delivery.uuid[0] == 0;
+
+        try {
+            delivery.data.resize( length );
+            _q->read( _handle, id, delivery.data.data(), length, 0 );
+        } catch( ... ) {
+            _release( id, delivery.isSignal );
+            throw;
+        }
+
+        _taken.push_back( { id, delivery.isSignal } );
+
+        return true;
+    }
+
+    void Consumer::ack( Delivery &delivery ) {
+        _forget( delivery.id );
+        _q->removeMessage( _handle, delivery.id );
+        delivery.id = 0;
+    }
+
+    void Consumer::reject( Delivery &delivery ) {
+        _forget( delivery.id );
+        _release( delivery.id, delivery.isSignal );
+        delivery.id = 0;
+    }
+
+    void Consumer::subscribe( int notifyFD ) {
+        _q->subscribeConsumer( _handle, notifyFD );
+    }
+}
+
+#endif
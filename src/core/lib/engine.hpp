@@ -0,0 +1,134 @@
+#ifndef SIMQ_CORE_LIB_ENGINE
+#define SIMQ_CORE_LIB_ENGINE
+
+#include <memory>
+#include <string>
+#include <atomic>
+#include "producer.hpp"
+#include "consumer.hpp"
+#include "../server/q/manager.hpp"
+#include "../../util/constants.h"
+#include "../../util/validation.hpp"
+#include "../../util/types.h"
+#include "../../util/fs.hpp"
+#include "../../util/error.h"
+
+namespace simq::core::lib {
+    // The queue engine of the server for use in the same process, without
+    // sockets and the protocol. Channels keep their data files in the same
+    // place as the server's, under path, and have the same limits.
+    //
+    // simq::core::lib::Engine engine( "/var/lib/app" );
+    // engine.addChannel( "g", "c", limits );
+    // auto producer = engine.createProducer( "g", "c" );
+    // producer->push( data, length );
+    class Engine {
+        private:
+            server::q::Manager _q;
+            std::string _path;
+            // producers and consumers are told apart by the id that is the fd in the server
+            std::atomic_uint _lastID{0};
+
+            void _createDir( const std::string &path );
+
+        public:
+            Engine( const char *path );
+
+            void addChannel(
+                const char *group,
+                const char *channel,
+                util::types::ChannelLimitMessages &limitMessages,
+                unsigned int countShards = 1
+            );
+            void updateChannelLimitMessages(
+                const char *group,
+                const char *channel,
+                util::types::ChannelLimitMessages &limitMessages
+            );
+            void removeChannel( const char *group, const char *channel );
+            void clearQ( const char *group, const char *channel );
+
+            std::unique_ptr<Producer> createProducer( const char *group, const char *channel );
+            std::unique_ptr<Consumer> createConsumer( const char *group, const char *channel );
+    };
+
+    Engine::Engine( const char *path ) {
+        _path = path;
+    }
+
+    void Engine::_createDir( const std::string &path ) {
+        if( !util::FS::dirExists( path.c_str() ) && !util::FS::createDir( path.c_str() ) ) {
+            throw util::Error::FS_ERROR;
+        }
+    }
+
+    void Engine::addChannel(
+        const char *group,
+        const char *channel,
+        util::types::ChannelLimitMessages &limitMessages,
+        unsigned int countShards
+    ) {
+        if( !util::Validation::isGroupName( group ) ) {
+            throw util::Error::WRONG_GROUP;
+        }
+        if( !util::Validation::isChannelName( channel ) ) {
+            throw util::Error::WRONG_CHANNEL;
+        }
+        if( !util::Validation::isChannelLimitMessages( limitMessages ) ) {
+            throw util::Error::WRONG_CHANNEL_LIMIT_MESSAGES;
+        }
+        if( !util::Validation::isChannelShards( countShards ) ) {
+            throw util::Error::WRONG_PARAM;
+        }
+
+        std::string path;
+
+        util::constants::buildPathToGroups( path, _path.c_str() );
+        _createDir( path );
+        util::constants::buildPathToGroup( path, _path.c_str(), group );
+        _createDir( path );
+        util::constants::buildPathToChannel( path, _path.c_str(), group, channel );
+        _createDir( path );
+
+        try {
+            _q.addGroup( group );
+        } catch( util::Error::Err err ) {
+            if( err != util::Error::DUPLICATE_GROUP ) {
+                throw;
+            }
+        }
+
+        util::constants::buildPathToChannelData( path, _path.c_str(), group, channel );
+        _q.addChannel( group, channel, path.c_str(), limitMessages, countShards );
+    }
+
+    void Engine::updateChannelLimitMessages(
+        const char *group,
+        const char *channel,
+        util::types::ChannelLimitMessages &limitMessages
+    ) {
+        if( !util::Validation::isChannelLimitMessages( limitMessages ) ) {
+            throw util::Error::WRONG_CHANNEL_LIMIT_MESSAGES;
+        }
+
+        _q.updateChannelLimitMessages( group, channel, limitMessages );
+    }
+
+    void Engine::removeChannel( const char *group, const char *channel ) {
+        _q.removeChannel( group, channel );
+    }
+
+    void Engine::clearQ( const char *group, const char *channel ) {
+        _q.clearQ( group, channel );
+    }
+
+    std::unique_ptr<Producer> Engine::createProducer( const char *group, const char *channel ) {
+        return std::make_unique<Producer>( &_q, group, channel, ++_lastID );
+    }
+
+    std::unique_ptr<Consumer> Engine::createConsumer( const char *group, const char *channel ) {
+        return std::make_unique<Consumer>( &_q, group, channel, ++_lastID );
+    }
+}
+
+#endif
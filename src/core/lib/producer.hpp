@@ -0,0 +1,82 @@
+#ifndef SIMQ_CORE_LIB_PRODUCER
+#define SIMQ_CORE_LIB_PRODUCER
+
+#include <type_traits>
+#include "../server/q/manager.hpp"
+#include "../../util/uuid.hpp"
+#include "../../util/error.h"
+
+// NO SAFE THREAD!!!
+
+namespace simq::core::lib {
+    // Pushes to one channel of an Engine, the body is copied into the queue once
+    class Producer {
+        private:
+            server::q::Manager *_q = nullptr;
+            server::q::Manager::ChannelHandle _handle;
+            unsigned int _id = 0;
+
+            void _push( unsigned int id, const char *data, unsigned int length );
+
+        public:
+            Producer( server::q::Manager *q, const char *group, const char *channel, unsigned int id );
+            ~Producer();
+
+            Producer( const Producer & ) = delete;
+            Producer &operator=( const Producer & ) = delete;
+
+            // uuid is optional, it gets util::UUID::LENGTH + 1 bytes
+            void push( const char *data, unsigned int length, char *uuid = nullptr );
+            void pushKeyed( const char *key, const char *data, unsigned int length, char *uuid = nullptr );
+            void pushSignal( const char *data, unsigned int length );
+
+            template<typename T>
+            void push( const T &value, char *uuid = nullptr );
+    };
+
+    Producer::Producer( server::q::Manager *q, const char *group, const char *channel, unsigned int id ) {
+        _q = q;
+        _id = id;
+        _handle = _q->joinProducer( group, channel, _id );
+    }
+
+    Producer::~Producer() {
+        _q->leaveProducer( _handle, _id );
+    }
+
+    void Producer::_push( unsigned int id, const char *data, unsigned int length ) {
+        try {
+            _q->write( _handle, id, data, length );
+        } catch( ... ) {
+            _q->removeMessage( _handle, id );
+            throw;
+        }
+
+        _q->pushMessage( _handle, id );
+    }
+
+    void Producer::push( const char *data, unsigned int length, char *uuid ) {
+        char buffer[util::UUID::LENGTH+1]{};
+        _push( _q->createMessageForQ( _handle, length, uuid ? uuid : buffer ), data, length );
+    }
+
+    // messages with one key are popped in the order they were pushed
+    void Producer::pushKeyed( const char *key, const char *data, unsigned int length, char *uuid ) {
+        char buffer[util::UUID::LENGTH+1]{};
+        _push( _q->createMessageForQ( _handle, length, uuid ? uuid : buffer, key ), data, length );
+    }
+
+    // delivered to every consumer of the channel at the moment of the push
+    void Producer::pushSignal( const char *data, unsigned int length ) {
+        _push( _q->createMessageForBroadcast( _handle, length ), data, length );
+    }
+
+    template<typename T>
+    void Producer::push( const T &value, char *uuid ) {
+        static_assert( std::is_trivially_copyable_v<T>, "T must be trivially copyable" );
+
+        push( ( const char * )&value, sizeof( T ), uuid );
+    }
+}
+
+#endif
@@ -1,8 +1,9 @@
 #ifndef SIMQ_CORE_SERVER_ACCESS
 #define SIMQ_CORE_SERVER_ACCESS
 
-#include "../../util/lock_atomic.hpp"
+#include "../../util/rw_lock.hpp"
 #include "../../util/error.h"
+#include "../../util/snapshot.hpp"
 #include "../../crypto/hash.hpp"
 #include <atomic>
 #include <algorithm>
@@ -20,39 +21,46 @@
 namespace simq::core::server {
     class Access {
         private:
-        std::atomic_uint _countGroupsWrited {0};
-        std::shared_timed_mutex _mGroups;
-
-        struct Entity {
-            std::shared_timed_mutex mSessions;
-            std::atomic_uint countSessionsWrited;
+        struct Entity: std::enable_shared_from_this<Entity> {
+            util::RWLock mSessions;
             std::map<unsigned int, bool> sessions;
 
             unsigned char password[crypto::HASH_LENGTH];
+
+            // moves on when a password change or a removal revokes the sessions
+            std::atomic_ulong epoch{0};
         };
 
         struct Consumer: Entity {};
         struct Producer: Entity {};
 
         struct Channel {
-            std::shared_timed_mutex mConsumers;
-            std::atomic_uint countConsumersWrited;
-            std::map<std::string, std::unique_ptr<Consumer>> consumers;
+            std::map<std::string, std::shared_ptr<Consumer>> consumers;
+            std::map<std::string, std::shared_ptr<Producer>> producers;
+        };
 
-            std::shared_timed_mutex mProducers;
-            std::atomic_uint countProducersWrited;
-            std::map<std::string, std::unique_ptr<Producer>> producers;
+        struct Group {
+            std::shared_ptr<Entity> entity;
+            std::map<std::string, std::shared_ptr<const Channel>> channels;
         };
 
-        struct Group: Entity {
-            std::shared_timed_mutex mChannels;
-            std::atomic_uint countChannelsWrited;
-            std::map<std::string, std::unique_ptr<Channel>> channels;
+        // replaced as a whole on admin changes, read without locks;
+        // sessions and passwords live in the entities and stay mutable
+        struct Directory {
+            std::map<std::string, std::shared_ptr<const Group>> groups;
         };
 
-        std::map<std::string, std::unique_ptr<Group>> _groups;
+        public:
+        // a push or pop permission resolved once per session,
+        // it holds while the epoch of its entity stays the same
+        struct Capability {
+            std::shared_ptr<Entity> entity;
+            unsigned long epoch = 0;
+        };
+
+        private:
+        util::Snapshot<Directory> _directory;
 
-        void _wait( std::atomic_uint &atom );
         void _checkGroupSession(
             const char *groupName,
             unsigned int fd,
@@ -63,50 +71,37 @@ namespace simq::core::server {
             const char *channelName,
             const char *login,
             unsigned int fd,
-            const unsigned char *password = nullptr
+            const unsigned char *password = nullptr,
+            Capability *capability = nullptr
         );
         void _checkProducerSession(
             const char *groupName,
             const char *channelName,
             const char *login,
             unsigned int fd,
-            const unsigned char *password = nullptr
+            const unsigned char *password = nullptr,
+            Capability *capability = nullptr
         );
 
-        void _checkIssetGroup( const char *name );
-        void _checkNoIssetGroup( const char *name );
-        void _checkIssetSessions( std::map<unsigned int, bool> &map, unsigned int fd );
-        void _checkNoIssetSessions( std::map<unsigned int, bool> &map, unsigned int fd );
+        const Group *_getGroup( const Directory &directory, const char *name );
+        const Group *_findGroup( const Directory &directory, const char *name );
+        const Channel *_getChannel( const Group *group, const char *name );
+        const Channel *_findChannel( const Group *group, const char *name );
+        Consumer *_getConsumer( const Channel *channel, const char *login );
+        Consumer *_findConsumer( const Channel *channel, const char *login );
+        Producer *_getProducer( const Channel *channel, const char *login );
+        Producer *_findProducer( const Channel *channel, const char *login );
 
-        void _checkIssetChannel(
-            std::map<std::string, std::unique_ptr<Channel>> &map,
-            const char *name
-        );
-
-        void _checkNoIssetChannel(
-            std::map<std::string, std::unique_ptr<Channel>> &map,
-            const char *name
-        );
-
-        void _checkIssetConsumer(
-            std::map<std::string, std::unique_ptr<Consumer>> &map,
-            const char *name
-        );
-
-        void _checkNoIssetConsumer(
-            std::map<std::string, std::unique_ptr<Consumer>> &map,
-            const char *name
-        );
+        template<typename F>
+        void _updateChannel( const char *groupName, const char *channelName, F f );
 
-        void _checkIssetProducer(
-            std::map<std::string, std::unique_ptr<Producer>> &map,
-            const char *name
-        );
+        bool _isCapable( const Capability &capability );
+        void _revoke( Entity *entity );
+        void _collectEntities( const Channel *channel, std::list<std::shared_ptr<Entity>> &entities );
 
-        void _checkNoIssetProducer(
-            std::map<std::string, std::unique_ptr<Producer>> &map,
-            const char *name
-        );
+        void _checkPassword( Entity *entity, const unsigned char *password );
+        void _checkIssetSessions( std::map<unsigned int, bool> &map, unsigned int fd );
+        void _checkNoIssetSessions( std::map<unsigned int, bool> &map, unsigned int fd );
      
         public:
         void addGroup(
@@ -169,15 +164,18 @@ namespace simq::core::server {
             const char *channelName,
             const char *login,
             const unsigned char *password,
-            unsigned int fd
+            unsigned int fd,
+            Capability &capability
         );
         void authProducer(
             const char *groupName,
             const char *channelName,
             const char *login,
             const unsigned char *password,
-            unsigned int fd
+            unsigned int fd,
+            Capability &capability
         );
+        void resume( Capability &capability, unsigned int fd );
 
      
         void logoutGroup( const char *groupName, unsigned int fd );
@@ -198,13 +196,15 @@ namespace simq::core::server {
             const char *groupName,
             const char *channelName,
             const char *login,
-            unsigned int fd
+            unsigned int fd,
+            Capability &capability
         );
         void checkPopMessage(
             const char *groupName,
             const char *channelName,
             const char *login,
-            unsigned int fd
+            unsigned int fd,
+            Capability &capability
         );
 
         void checkUpdateMyGroupPassword(
@@ -294,76 +294,120 @@ namespace simq::core::server {
 
     };
 
-    void Access::_wait( std::atomic_uint &atom ) {
-        while( atom );
-    }
 
     void Access::addGroup(
         const char *groupName,
         const unsigned char *password
     ) {
-        util::LockAtomic lockAtomicGroup( _countGroupsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockGroups( _mGroups );
+        _directory.update( [&]( Directory &directory ) {
+            if( directory.groups.find( groupName ) != directory.groups.end() ) {
+                throw util::Error::DUPLICATE_GROUP;
+            }
 
-        _checkNoIssetGroup( groupName );
+            auto group = std::make_shared<Group>();
+            group->entity = std::make_shared<Entity>();
+            memcpy( group->entity->password, password, crypto::HASH_LENGTH );
 
-        _groups[groupName] = std::make_unique<Group>();
-        memcpy( _groups[groupName]->password, password, crypto::HASH_LENGTH );
+            directory.groups[groupName] = std::move( group );
+        } );
     }
 
     void Access::updateGroupPassword(
         const char *groupName,
         const unsigned char *password
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        _checkIssetGroup( groupName );
-        auto group = _groups[groupName].get();
+        auto group = _findGroup( *directory, groupName )->entity.get();
 
-        util::LockAtomic lockAtomicGroupSessions( group->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
+        std::lock_guard<util::RWLock> lockGroupSessions( group->mSessions );
 
         memcpy( group->password, password, crypto::HASH_LENGTH );
 
         group->sessions.clear();
+        _revoke( group );
     }
 
     void Access::removeGroup( const char *groupName ) {
-        util::LockAtomic lockAtomicGroup( _countGroupsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockGroups( _mGroups );
+        std::list<std::shared_ptr<Entity>> entities;
 
-        _groups.erase( groupName );
-    }
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                return;
+            }
 
-    void Access::addChannel( const char *groupName, const char *channelName ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
+            entities.push_back( it->second->entity );
+            for( auto &channel : it->second->channels ) {
+                _collectEntities( channel.second.get(), entities );
+            }
 
-        auto group = _groups[groupName].get();
+            directory.groups.erase( it );
+        } );
 
-        util::LockAtomic lockAtomicChannels( group->countChannelsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkNoIssetChannel( group->channels, channelName );
+        for( auto &entity : entities ) {
+            _revoke( entity.get() );
+        }
+    }
 
-        group->channels[channelName] = std::make_unique<Channel>();
+    void Access::addChannel( const char *groupName, const char *channelName ) {
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                throw util::Error::NOT_FOUND_GROUP;
+            }
+
+            if( it->second->channels.find( channelName ) != it->second->channels.end() ) {
+                throw util::Error::DUPLICATE_CHANNEL;
+            }
+
+            auto group = std::make_shared<Group>( *it->second );
+            group->channels[channelName] = std::make_shared<const Channel>();
+            it->second = std::move( group );
+        } );
     }
 
     void Access::removeChannel( const char *groupName, const char *channelName ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        std::list<std::shared_ptr<Entity>> entities;
+
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                throw util::Error::NOT_FOUND_GROUP;
+            }
 
-        _checkIssetGroup( groupName );
+            _collectEntities( _getChannel( it->second.get(), channelName ), entities );
 
-        auto group = _groups[groupName].get();
+            auto group = std::make_shared<Group>( *it->second );
+            group->channels.erase( channelName );
+            it->second = std::move( group );
+        } );
 
-        util::LockAtomic lockAtomicChannels( group->countChannelsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockChannels( group->mChannels );
+        for( auto &entity : entities ) {
+            _revoke( entity.get() );
+        }
+    }
 
-        group->channels.erase( channelName );
+    template<typename F>
+    void Access::_updateChannel( const char *groupName, const char *channelName, F f ) {
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                throw util::Error::NOT_FOUND_GROUP;
+            }
+
+            auto itChannel = it->second->channels.find( channelName );
+            if( itChannel == it->second->channels.end() ) {
+                throw util::Error::NOT_FOUND_CHANNEL;
+            }
+
+            auto channel = std::make_shared<Channel>( *itChannel->second );
+            f( *channel );
+
+            auto group = std::make_shared<Group>( *it->second );
+            group->channels[channelName] = std::move( channel );
+            it->second = std::move( group );
+        } );
     }
 
     void Access::addConsumer(
@@ -372,27 +416,16 @@ namespace simq::core::server {
         const char *login,
         const unsigned char *password
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
+        _updateChannel( groupName, channelName, [&]( Channel &channel ) {
+            if( channel.consumers.find( login ) != channel.consumers.end() ) {
+                throw util::Error::DUPLICATE_CONSUMER;
+            }
 
-        auto channel = group->channels[channelName].get();
+            auto consumer = std::make_shared<Consumer>();
+            memcpy( consumer->password, password, crypto::HASH_LENGTH );
 
-        util::LockAtomic lockAtomicConsumers( channel->countConsumersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-
-        _checkNoIssetConsumer( channel->consumers, login );
-
-        channel->consumers[login] = std::make_unique<Consumer>();
-        memcpy( channel->consumers[login]->password, password, crypto::HASH_LENGTH );
+            channel.consumers[login] = std::move( consumer );
+        } );
     }
 
     void Access::updateConsumerPassword(
@@ -401,32 +434,16 @@ namespace simq::core::server {
         const char *login,
         const unsigned char *password
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicConsumers( channel->countConsumersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-
-        _checkIssetConsumer( channel->consumers, login );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto consumer = channel->consumers[login].get();
+        auto group = _findGroup( *directory, groupName );
+        auto consumer = _findConsumer( _findChannel( group, channelName ), login );
 
-        util::LockAtomic lockAtomicConsumerSessions( consumer->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumerSessions( consumer->mSessions );
+        std::lock_guard<util::RWLock> lockConsumerSessions( consumer->mSessions );
 
-        memcpy( channel->consumers[login]->password, password, crypto::HASH_LENGTH );
-        channel->consumers[login]->sessions.clear();
+        memcpy( consumer->password, password, crypto::HASH_LENGTH );
+        consumer->sessions.clear();
+        _revoke( consumer );
     }
 
     void Access::removeConsumer(
@@ -434,24 +451,21 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        std::shared_ptr<Entity> consumer;
 
-        _checkIssetGroup( groupName );
+        _updateChannel( groupName, channelName, [&]( Channel &channel ) {
+            auto it = channel.consumers.find( login );
+            if( it == channel.consumers.end() ) {
+                return;
+            }
 
-        auto group = _groups[groupName].get();
+            consumer = it->second;
+            channel.consumers.erase( it );
+        } );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicConsumers( channel->countConsumersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-
-        channel->consumers.erase( login );
+        if( consumer != nullptr ) {
+            _revoke( consumer.get() );
+        }
     }
 
     void Access::addProducer(
@@ -460,27 +474,16 @@ namespace simq::core::server {
         const char *login,
         const unsigned char *password
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
+        _updateChannel( groupName, channelName, [&]( Channel &channel ) {
+            if( channel.producers.find( login ) != channel.producers.end() ) {
+                throw util::Error::DUPLICATE_PRODUCER;
+            }
 
-        auto channel = group->channels[channelName].get();
+            auto producer = std::make_shared<Producer>();
+            memcpy( producer->password, password, crypto::HASH_LENGTH );
 
-        util::LockAtomic lockAtomicProducers( channel->countProducersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        _checkNoIssetProducer( channel->producers, login );
-
-        channel->producers[login] = std::make_unique<Producer>();
-        memcpy( channel->producers[login]->password, password, crypto::HASH_LENGTH );
+            channel.producers[login] = std::move( producer );
+        } );
     }
 
     void Access::updateProducerPassword(
@@ -489,33 +492,17 @@ namespace simq::core::server {
         const char *login,
         const unsigned char *password
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicProducers( channel->countProducersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        _checkIssetProducer( channel->producers, login );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto producer = channel->producers[login].get();
+        auto group = _findGroup( *directory, groupName );
+        auto producer = _findProducer( _findChannel( group, channelName ), login );
 
-        util::LockAtomic lockAtomicProducerSessions( producer->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducerSessions( producer->mSessions );
+        std::lock_guard<util::RWLock> lockProducerSessions( producer->mSessions );
 
-        memcpy( channel->producers[login]->password, password, crypto::HASH_LENGTH );
+        memcpy( producer->password, password, crypto::HASH_LENGTH );
 
-        channel->producers[login]->sessions.clear();
+        producer->sessions.clear();
+        _revoke( producer );
     }
 
     void Access::removeProducer(
@@ -523,24 +510,21 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        std::shared_ptr<Entity> producer;
 
-        _checkIssetGroup( groupName );
+        _updateChannel( groupName, channelName, [&]( Channel &channel ) {
+            auto it = channel.producers.find( login );
+            if( it == channel.producers.end() ) {
+                return;
+            }
 
-        auto group = _groups[groupName].get();
+            producer = it->second;
+            channel.producers.erase( it );
+        } );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicProducers( channel->countProducersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        channel->producers.erase( login );
+        if( producer != nullptr ) {
+            _revoke( producer.get() );
+        }
     }
 
     void Access::authGroup(
@@ -548,24 +532,13 @@ namespace simq::core::server {
         const unsigned char *password,
         unsigned int fd
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        _checkIssetGroup( groupName );
+        auto group = _findGroup( *directory, groupName )->entity.get();
 
-        auto group = _groups[groupName].get();
-
-        util::LockAtomic lockAtomicGroupSessions( group->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        if( strncmp(
-            ( const char * )group->password,
-            (const char *)password,
-            crypto::HASH_LENGTH
-        ) != 0 ) {
-            throw util::Error::WRONG_PASSWORD;
-        }
+        std::lock_guard<util::RWLock> lockGroupSessions( group->mSessions );
 
+        _checkPassword( group, password );
         _checkNoIssetSessions( group->sessions, fd );
 
         group->sessions[fd] = true;
@@ -576,43 +549,23 @@ namespace simq::core::server {
         const char *channelName,
         const char *login,
         const unsigned char *password,
-        unsigned int fd
+        unsigned int fd,
+        Capability &capability
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-
-        _checkIssetConsumer( channel->consumers, login );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto consumer = channel->consumers[login].get();
+        auto group = _findGroup( *directory, groupName );
+        auto consumer = _findConsumer( _findChannel( group, channelName ), login );
 
-        util::LockAtomic lockAtomicConsumerSessions( consumer->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumerSessions( consumer->mSessions );
-
-        if( strncmp(
-            ( const char * )consumer->password,
-            (const char *)password,
-            crypto::HASH_LENGTH
-        ) != 0 ) {
-            throw util::Error::WRONG_PASSWORD;
-        }
+        std::lock_guard<util::RWLock> lockConsumerSessions( consumer->mSessions );
 
+        _checkPassword( consumer, password );
         _checkNoIssetSessions( consumer->sessions, fd );
 
         consumer->sessions[fd] = true;
+
+        capability.entity = consumer->shared_from_this();
+        capability.epoch = consumer->epoch.load();
     }
 
     void Access::authProducer(
@@ -620,59 +573,58 @@ namespace simq::core::server {
         const char *channelName,
         const char *login,
         const unsigned char *password,
-        unsigned int fd
+        unsigned int fd,
+        Capability &capability
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto group = _groups[groupName].get();
+        auto group = _findGroup( *directory, groupName );
+        auto producer = _findProducer( _findChannel( group, channelName ), login );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        std::lock_guard<util::RWLock> lockProducerSessions( producer->mSessions );
 
-        _checkIssetChannel( group->channels, channelName );
+        _checkPassword( producer, password );
+        _checkNoIssetSessions( producer->sessions, fd );
 
-        auto channel = group->channels[channelName].get();
+        producer->sessions[fd] = true;
 
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mProducers );
+        capability.entity = producer->shared_from_this();
+        capability.epoch = producer->epoch.load();
+    }
 
-        _checkIssetProducer( channel->producers, login );
+    // binds fd to the entity of a capability without looking it up,
+    // the capability must be valid after the lock as well as before
+    void Access::resume( Capability &capability, unsigned int fd ) {
+        if( !_isCapable( capability ) ) {
+            throw util::Error::ACCESS_DENY;
+        }
 
-        auto producer = channel->producers[login].get();
+        auto entity = capability.entity.get();
 
-        util::LockAtomic lockAtomicProducerSessions( producer->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducerSessions( producer->mSessions );
+        std::lock_guard<util::RWLock> lockSessions( entity->mSessions );
 
-        if( strncmp(
-            ( const char * )producer->password,
-            (const char *)password,
-            crypto::HASH_LENGTH
-        ) != 0 ) {
-            throw util::Error::WRONG_PASSWORD;
+        if( !_isCapable( capability ) ) {
+            throw util::Error::ACCESS_DENY;
         }
 
-        _checkNoIssetSessions( producer->sessions, fd );
+        _checkNoIssetSessions( entity->sessions, fd );
 
-        producer->sessions[fd] = true;
+        entity->sessions[fd] = true;
     }
 
     void Access::logoutGroup( const char *groupName, unsigned int fd ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        auto group = _getGroup( *directory, groupName );
+        if( group == nullptr ) {
             return;
         }
 
-        auto group = _groups[groupName].get();
+        auto entity = group->entity.get();
 
-        util::LockAtomic lockAtomicGroupSessions( group->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
+        std::lock_guard<util::RWLock> lockGroupSessions( entity->mSessions );
 
-        group->sessions.erase( fd );
+        entity->sessions.erase( fd );
     }
 
     void Access::logoutConsumer(
@@ -681,35 +633,17 @@ namespace simq::core::server {
         const char *login,
         unsigned int fd
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        if( _groups.find( groupName ) == _groups.end() ) {
-            return;
-        }
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            return;
-        }
-
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-
-        if( channel->consumers.find( login ) == channel->consumers.end() ) {
+        auto consumer = _getConsumer(
+            _getChannel( _getGroup( *directory, groupName ), channelName ),
+            login
+        );
+        if( consumer == nullptr ) {
             return;
         }
 
-        auto consumer = channel->consumers[login].get();
-
-        util::LockAtomic lockAtomicConsumerSessions( consumer->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumerSessions( consumer->mSessions );
+        std::lock_guard<util::RWLock> lockConsumerSessions( consumer->mSessions );
 
         consumer->sessions.erase( fd );
     }
@@ -720,35 +654,17 @@ namespace simq::core::server {
         const char *login,
         unsigned int fd
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        if( _groups.find( groupName ) == _groups.end() ) {
-            return;
-        }
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            return;
-        }
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        if( channel->producers.find( login ) == channel->producers.end() ) {
+        auto producer = _getProducer(
+            _getChannel( _getGroup( *directory, groupName ), channelName ),
+            login
+        );
+        if( producer == nullptr ) {
             return;
         }
 
-        auto producer = channel->producers[login].get();
-
-        util::LockAtomic lockAtomicProducerSessions( producer->countSessionsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducerSessions( producer->mSessions );
+        std::lock_guard<util::RWLock> lockProducerSessions( producer->mSessions );
 
         producer->sessions.erase( fd );
     }
@@ -758,24 +674,16 @@ namespace simq::core::server {
         unsigned int fd,
         const unsigned char *password
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto group = _groups[groupName].get();
+        auto group = _findGroup( *directory, groupName )->entity.get();
 
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
+        std::shared_lock<util::RWLock> lockGroupSessions( group->mSessions );
 
         _checkIssetSessions( group->sessions, fd );
 
-        if( password != nullptr && strncmp(
-            ( const char * )group->password,
-            (const char *)password,
-            crypto::HASH_LENGTH
-        ) != 0 ) {
-            throw util::Error::WRONG_PASSWORD;
+        if( password != nullptr ) {
+            _checkPassword( group, password );
         }
     }
 
@@ -784,40 +692,25 @@ namespace simq::core::server {
         const char *channelName,
         const char *login,
         unsigned int fd,
-        const unsigned char *password
+        const unsigned char *password,
+        Capability *capability
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto group = _groups[groupName].get();
+        auto group = _findGroup( *directory, groupName );
+        auto consumer = _findConsumer( _findChannel( group, channelName ), login );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mConsumers );
-
-        _checkIssetConsumer( channel->consumers, login );
-
-        auto consumer = channel->consumers[login].get();
-
-        _wait( consumer->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumerSessions( consumer->mSessions );
+        std::shared_lock<util::RWLock> lockConsumerSessions( consumer->mSessions );
 
         _checkIssetSessions( consumer->sessions, fd );
 
-        if( password != nullptr && strncmp(
-            ( const char * )consumer->password,
-            (const char *)password,
-            crypto::HASH_LENGTH
-        ) != 0 ) {
-            throw util::Error::WRONG_PASSWORD;
+        if( password != nullptr ) {
+            _checkPassword( consumer, password );
+        }
+
+        if( capability != nullptr ) {
+            capability->entity = consumer->shared_from_this();
+            capability->epoch = consumer->epoch.load();
         }
     }
 
@@ -826,40 +719,25 @@ namespace simq::core::server {
         const char *channelName,
         const char *login,
         unsigned int fd,
-        const unsigned char *password
+        const unsigned char *password,
+        Capability *capability
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mConsumers );
-
-        _checkIssetProducer( channel->producers, login );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto producer = channel->producers[login].get();
+        auto group = _findGroup( *directory, groupName );
+        auto producer = _findProducer( _findChannel( group, channelName ), login );
 
-        _wait( producer->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducerSessions( producer->mSessions );
+        std::shared_lock<util::RWLock> lockProducerSessions( producer->mSessions );
 
         _checkIssetSessions( producer->sessions, fd );
 
-        if( password != nullptr && strncmp(
-            ( const char * )producer->password,
-            (const char *)password,
-            crypto::HASH_LENGTH
-        ) != 0 ) {
-            throw util::Error::WRONG_PASSWORD;
+        if( password != nullptr ) {
+            _checkPassword( producer, password );
+        }
+
+        if( capability != nullptr ) {
+            capability->entity = producer->shared_from_this();
+            capability->epoch = producer->epoch.load();
         }
     }
 
@@ -867,18 +745,28 @@ namespace simq::core::server {
         const char *groupName,
         const char *channelName,
         const char *login,
-        unsigned int fd
+        unsigned int fd,
+        Capability &capability
     ) {
-        _checkProducerSession( groupName, channelName, login, fd );
+        if( _isCapable( capability ) ) {
+            return;
+        }
+
+        _checkProducerSession( groupName, channelName, login, fd, nullptr, &capability );
     }
 
     void Access::checkPopMessage(
         const char *groupName,
         const char *channelName,
         const char *login,
-        unsigned int fd
+        unsigned int fd,
+        Capability &capability
     ) {
-        _checkConsumerSession( groupName, channelName, login, fd );
+        if( _isCapable( capability ) ) {
+            return;
+        }
+
+        _checkConsumerSession( groupName, channelName, login, fd, nullptr, &capability );
     }
 
     void Access::checkUpdateMyGroupPassword(
@@ -909,6 +797,36 @@ namespace simq::core::server {
         _checkProducerSession( groupName, channelName, login, fd, password );
     }
 
+    bool Access::_isCapable( const Capability &capability ) {
+        return capability.entity != nullptr && capability.entity->epoch.load() == capability.epoch;
+    }
+
+    // a removed entity is revoked after the update of the directory, so no reader
+    // can resolve it and take the new epoch
+    void Access::_revoke( Entity *entity ) {
+        entity->epoch++;
+    }
+
+    void Access::_collectEntities( const Channel *channel, std::list<std::shared_ptr<Entity>> &entities ) {
+        if( channel == nullptr ) {
+            return;
+        }
+
+        for( auto &consumer : channel->consumers ) {
+            entities.push_back( consumer.second );
+        }
+
+        for( auto &producer : channel->producers ) {
+            entities.push_back( producer.second );
+        }
+    }
+
+    void Access::_checkPassword( Entity *entity, const unsigned char *password ) {
+        if( memcmp( entity->password, password, crypto::HASH_LENGTH ) != 0 ) {
+            throw util::Error::WRONG_PASSWORD;
+        }
+    }
+
     void Access::_checkIssetSessions( std::map<unsigned int, bool> &map, unsigned int fd ) {
         if( map.find( fd ) == map.end() ) {
             throw util::Error::ACCESS_DENY;
@@ -921,70 +839,88 @@ namespace simq::core::server {
         }
     }
 
-    void Access::_checkIssetGroup( const char *name ) {
-        if( _groups.find( name ) == _groups.end() ) {
+    const Access::Group *Access::_getGroup( const Directory &directory, const char *name ) {
+        auto it = directory.groups.find( name );
+        if( it == directory.groups.end() ) {
+            return nullptr;
+        }
+
+        return it->second.get();
+    }
+
+    const Access::Group *Access::_findGroup( const Directory &directory, const char *name ) {
+        auto group = _getGroup( directory, name );
+        if( group == nullptr ) {
             throw util::Error::NOT_FOUND_GROUP;
         }
+
+        return group;
     }
 
-    void Access::_checkNoIssetGroup( const char *name ) {
-        if( _groups.find( name ) != _groups.end() ) {
-            throw util::Error::DUPLICATE_GROUP;
+    const Access::Channel *Access::_getChannel( const Group *group, const char *name ) {
+        if( group == nullptr ) {
+            return nullptr;
+        }
+
+        auto it = group->channels.find( name );
+        if( it == group->channels.end() ) {
+            return nullptr;
         }
+
+        return it->second.get();
     }
 
-    void Access::_checkIssetChannel(
-        std::map<std::string, std::unique_ptr<Channel>> &map,
-        const char *name
-    ) {
-        if( map.find( name ) == map.end() ) {
+    const Access::Channel *Access::_findChannel( const Group *group, const char *name ) {
+        auto channel = _getChannel( group, name );
+        if( channel == nullptr ) {
             throw util::Error::NOT_FOUND_CHANNEL;
         }
+
+        return channel;
     }
 
-    void Access::_checkNoIssetChannel(
-        std::map<std::string, std::unique_ptr<Channel>> &map,
-        const char *name
-    ) {
-        if( map.find( name ) != map.end() ) {
-            throw util::Error::DUPLICATE_CHANNEL;
+    Access::Consumer *Access::_getConsumer( const Channel *channel, const char *login ) {
+        if( channel == nullptr ) {
+            return nullptr;
         }
+
+        auto it = channel->consumers.find( login );
+        if( it == channel->consumers.end() ) {
+            return nullptr;
+        }
+
+        return it->second.get();
     }
 
-    void Access::_checkIssetConsumer(
-        std::map<std::string, std::unique_ptr<Consumer>> &map,
-        const char *name
-    ) {
-        if( map.find( name ) == map.end() ) {
+    Access::Consumer *Access::_findConsumer( const Channel *channel, const char *login ) {
+        auto consumer = _getConsumer( channel, login );
+        if( consumer == nullptr ) {
             throw util::Error::NOT_FOUND_CONSUMER;
         }
+
+        return consumer;
     }
 
-    void Access::_checkNoIssetConsumer(
-        std::map<std::string, std::unique_ptr<Consumer>> &map,
-        const char *name
-    ) {
-        if( map.find( name ) != map.end() ) {
-            throw util::Error::DUPLICATE_CONSUMER;
+    Access::Producer *Access::_getProducer( const Channel *channel, const char *login ) {
+        if( channel == nullptr ) {
+            return nullptr;
         }
-    }
 
-    void Access::_checkIssetProducer(
-        std::map<std::string, std::unique_ptr<Producer>> &map,
-        const char *name
-    ) {
-        if( map.find( name ) == map.end() ) {
-            throw util::Error::NOT_FOUND_PRODUCER;
+        auto it = channel->producers.find( login );
+        if( it == channel->producers.end() ) {
+            return nullptr;
         }
+
+        return it->second.get();
     }
 
-    void Access::_checkNoIssetProducer(
-        std::map<std::string, std::unique_ptr<Producer>> &map,
-        const char *name
-    ) {
-        if( map.find( name ) != map.end() ) {
-            throw util::Error::DUPLICATE_PRODUCER;
+    Access::Producer *Access::_findProducer( const Channel *channel, const char *login ) {
+        auto producer = _getProducer( channel, login );
+        if( producer == nullptr ) {
+            throw util::Error::NOT_FOUND_PRODUCER;
         }
+
+        return producer;
     }
 
     void Access::checkToChannel(
@@ -992,39 +928,25 @@ namespace simq::core::server {
         const char *channelName,
         unsigned int fd
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto group = _groups[groupName].get();
+        auto group = _findGroup( *directory, groupName );
+        auto entity = group->entity.get();
 
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
+        {
+            std::shared_lock<util::RWLock> lockGroupSessions( entity->mSessions );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+            _checkIssetSessions( entity->sessions, fd );
+        }
 
-        _checkIssetChannel( group->channels, channelName );
+        _findChannel( group, channelName );
     }
 
     void Access::checkToGroup(
         const char *groupName,
         unsigned int fd
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
+        _checkGroupSession( groupName, fd );
     }
 
     void Access::checkAddChannel(
@@ -1032,22 +954,14 @@ namespace simq::core::server {
         unsigned int fd,
         const char *channelName
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto group = _groups[groupName].get();
+        _checkGroupSession( groupName, fd );
 
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkNoIssetChannel( group->channels, channelName );
+        auto group = _findGroup( *directory, groupName );
+        if( _getChannel( group, channelName ) != nullptr ) {
+            throw util::Error::DUPLICATE_CHANNEL;
+        }
     }
 
     void Access::checkUpdateChannelLimitMessages(
@@ -1055,22 +969,7 @@ namespace simq::core::server {
         unsigned int fd,
         const char *channelName
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
+        checkToChannel( groupName, channelName, fd );
     }
 
     void Access::checkRemoveChannel(
@@ -1078,22 +977,7 @@ namespace simq::core::server {
         unsigned int fd,
         const char *channelName
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
+        checkToChannel( groupName, channelName, fd );
     }
 
     void Access::checkAddConsumer(
@@ -1102,28 +986,14 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        auto channel = group->channels[channelName].get();
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
+        _checkGroupSession( groupName, fd );
 
-        _checkNoIssetConsumer( channel->consumers, login );
+        auto channel = _findChannel( _findGroup( *directory, groupName ), channelName );
+        if( _getConsumer( channel, login ) != nullptr ) {
+            throw util::Error::DUPLICATE_CONSUMER;
+        }
     }
 
     void Access::checkUpdateConsumerPassword(
@@ -1132,26 +1002,11 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
+        _checkGroupSession( groupName, fd );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-        auto channel = group->channels[channelName].get();
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-        _checkIssetConsumer( channel->consumers, login );
+        _findConsumer( _findChannel( _findGroup( *directory, groupName ), channelName ), login );
     }
 
     void Access::checkRemoveConsumer(
@@ -1160,28 +1015,7 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumers( channel->mConsumers );
-
-        _checkIssetConsumer( channel->consumers, login );
+        checkUpdateConsumerPassword( groupName, fd, channelName, login );
     }
 
     void Access::checkAddProducer(
@@ -1190,28 +1024,14 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
+        _checkGroupSession( groupName, fd );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        _checkNoIssetProducer( channel->producers, login );
+        auto channel = _findChannel( _findGroup( *directory, groupName ), channelName );
+        if( _getProducer( channel, login ) != nullptr ) {
+            throw util::Error::DUPLICATE_PRODUCER;
+        }
     }
 
     void Access::checkUpdateProducerPassword(
@@ -1220,28 +1040,11 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
+        _checkGroupSession( groupName, fd );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        _checkIssetProducer( channel->producers, login );
+        _findProducer( _findChannel( _findGroup( *directory, groupName ), channelName ), login );
     }
 
     void Access::checkRemoveProducer(
@@ -1250,28 +1053,7 @@ namespace simq::core::server {
         const char *channelName,
         const char *login
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroups( _mGroups );
-
-        _checkIssetGroup( groupName );
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countSessionsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockGroupSessions( group->mSessions );
-
-        _checkIssetSessions( group->sessions, fd );
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        _checkIssetChannel( group->channels, channelName );
-
-        auto channel = group->channels[channelName].get();
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducers( channel->mProducers );
-
-        _checkIssetProducer( channel->producers, login );
+        checkUpdateProducerPassword( groupName, fd, channelName, login );
     }
 
 }
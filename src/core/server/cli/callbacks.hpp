@@ -27,8 +27,14 @@ namespace simq::core::server::CLI {
                 util::types::ChannelLimitMessages &limitMessages
             ) = 0;
 
+            virtual unsigned int getChannelShards(
+                const char *group,
+                const char *channel
+            ) = 0;
+
             virtual unsigned short int getPort() = 0;
             virtual unsigned short int getCountThreads() = 0;
+            virtual void getUnixSocket( std::string &path ) = 0;
             virtual void getMasterPassword(
                 unsigned char password[crypto::HASH_LENGTH]
             ) = 0;
@@ -55,6 +61,11 @@ namespace simq::core::server::CLI {
                 const char *channel,
                 util::types::ChannelLimitMessages *limitMessages
             ) = 0;
+            virtual void updateChannelShards(
+                const char *group,
+                const char *channel,
+                unsigned int count
+            ) = 0;
             virtual void removeChannel(
                 const char *group,
                 const char *channel
@@ -101,6 +112,7 @@ namespace simq::core::server::CLI {
             ) = 0;
             virtual void updatePort( unsigned short int port ) = 0;
             virtual void updateCountThreads( unsigned short int port ) = 0;
+            virtual void updateUnixSocket( const char *path ) = 0;
     };
 }
 
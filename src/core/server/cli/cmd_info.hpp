@@ -19,6 +19,7 @@ namespace simq::core::server::CLI {
             util::Console *_console = nullptr;
             Callbacks *_cb = nullptr;
             void _addToList( std::vector<std::string> &list, const char *name, unsigned int value );
+            void _addToList( std::vector<std::string> &list, const char *name, const std::string &value );
         public:
             CmdInfo(
                 util::Console *console,
@@ -35,6 +36,13 @@ namespace simq::core::server::CLI {
         list.push_back( item );
     }
 
+    void CmdInfo::_addToList( std::vector<std::string> &list, const char *name, const std::string &value ) {
+        std::string item = name;
+        item += " - ";
+        item += value;
+        list.push_back( item );
+    }
+
     void CmdInfo::run( std::vector<std::string> &params ) {
         if( params.size() > 1 ) {
             Ini::printDanger( _console, "Many params" );
@@ -46,6 +54,10 @@ namespace simq::core::server::CLI {
         if( _nav->isSettings() ) {
             _addToList( list, Ini::infoSettingsPort, _cb->getPort() );
             _addToList( list, Ini::infoSettingsCountThreads, _cb->getCountThreads() );
+
+            std::string unixSocket;
+            _cb->getUnixSocket( unixSocket );
+            _addToList( list, Ini::infoSettingsUnixSocket, unixSocket );
         } else if( _nav->isChannel() ) {
             util::types::ChannelLimitMessages limitMessages;
             _cb->getChannelLimitMessages(
@@ -57,6 +69,7 @@ namespace simq::core::server::CLI {
             _addToList( list, Ini::infoChMaxMessageSize, limitMessages.maxMessageSize );
             _addToList( list, Ini::infoChMaxMessagesInMemory, limitMessages.maxMessagesInMemory );
             _addToList( list, Ini::infoChMaxMessagesOnDisk, limitMessages.maxMessagesOnDisk );
+            _addToList( list, Ini::infoChShards, _cb->getChannelShards( _nav->getGroup(), _nav->getChannel() ) );
         }
 
         _console->printList( list, params.empty() ? nullptr : params[0].c_str() );
@@ -46,6 +46,23 @@ namespace simq::core::server::CLI {
         auto name = params[0];
         auto value = params[1].c_str();
 
+        // the only setting with a text value, "" turns the listener off
+        if( name == Ini::infoSettingsUnixSocket ) {
+            if( value[0] != 0 && !util::Validation::isUnixSocketPath( value ) ) {
+                Ini::printDanger( _console, "Wrong value" );
+                return;
+            }
+
+            try {
+                _cb->updateUnixSocket( value );
+                Ini::printSuccess( _console, "Restart server to apply changes" );
+            } catch( ... ) {
+                Ini::printDanger( _console, "Server error" );
+            }
+
+            return;
+        }
+
         if( value[0] != 0 && !util::Validation::isUInt( value ) ) {
             Ini::printDanger( _console, "Wrong value" );
             return;
@@ -100,6 +117,13 @@ namespace simq::core::server::CLI {
                 );
                 limitMessages.maxMessagesOnDisk = num;
                 isChannel = true;
+            } else if( name == Ini::infoChShards ) {
+                if( !util::Validation::isChannelShards( num ) ) {
+                    Ini::printDanger( _console, "Wrong value" );
+                } else {
+                    _cb->updateChannelShards( _nav->getGroup(), _nav->getChannel(), num );
+                    Ini::printSuccess( _console, "Restart server to apply changes" );
+                }
             } else {
                 Ini::printDanger( _console, "Unknown name" );
             }
@@ -23,10 +23,12 @@ namespace simq::core::server::CLI::Ini {
 
     inline const char *infoSettingsPort = "port";
     inline const char *infoSettingsCountThreads = "countThreads";
+    inline const char *infoSettingsUnixSocket = "unixSocket";
     inline const char *infoChMinMessageSize = "minMessageSize";
     inline const char *infoChMaxMessageSize = "maxMessageSize";
     inline const char *infoChMaxMessagesInMemory = "maxMessagesInMemory";
     inline const char *infoChMaxMessagesOnDisk = "maxMessagesOnDisk";
+    inline const char *infoChShards = "shards";
 
     inline const char *msgApplyChangesDefer = "The changes will be applied by the server.";
 
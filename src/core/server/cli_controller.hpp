@@ -29,9 +29,14 @@ namespace simq::core::server {
                 const char *channel,
                 util::types::ChannelLimitMessages &limitMessages
             );
+            unsigned int getChannelShards(
+                const char *group,
+                const char *channel
+            );
 
             unsigned short int getPort();
             unsigned short int getCountThreads();
+            void getUnixSocket( std::string &path );
             void getMasterPassword(
                 unsigned char password[crypto::HASH_LENGTH]
             );
@@ -56,6 +61,11 @@ namespace simq::core::server {
                 const char *channel,
                 util::types::ChannelLimitMessages *limitMessages
             );
+            void updateChannelShards(
+                const char *group,
+                const char *channel,
+                unsigned int count
+            );
             void removeChannel(
                 const char *group,
                 const char *channel
@@ -100,6 +110,7 @@ namespace simq::core::server {
             void updateMasterPassword( const unsigned char *password );
             void updatePort( unsigned short int port );
             void updateCountThreads( unsigned short int count );
+            void updateUnixSocket( const char *path );
     };
 
     CLIController::CLIController( Store *store, Changes *changes ) {
@@ -139,6 +150,13 @@ namespace simq::core::server {
         _store->getDirectChannelLimitMessages( group, channel, limitMessages );
     }
 
+    unsigned int CLIController::getChannelShards(
+        const char *group,
+        const char *channel
+    ) {
+        return _store->getDirectChannelShards( group, channel );
+    }
+
     unsigned short int CLIController::getPort() {
         return _store->getDirectPort();
     }
@@ -147,6 +165,10 @@ namespace simq::core::server {
         return _store->getDirectCountThreads();
     }
 
+    void CLIController::getUnixSocket( std::string &path ) {
+        _store->getDirectUnixSocket( path );
+    }
+
     void CLIController::getMasterPassword(
         unsigned char password[crypto::HASH_LENGTH]
     ) {
@@ -192,6 +214,14 @@ namespace simq::core::server {
         _changes->pushDefered( std::move( ch ) );
     }
 
+    void CLIController::updateChannelShards(
+        const char *group,
+        const char *channel,
+        unsigned int count
+    ) {
+        _store->updateChannelShards( group, channel, count );
+    }
+
     void CLIController::removeChannel(
         const char *group,
         const char *channel
@@ -269,6 +299,10 @@ namespace simq::core::server {
     void CLIController::updateCountThreads( unsigned short int count ) {
         _store->updateCountThreads( count );
     }
+
+    void CLIController::updateUnixSocket( const char *path ) {
+        _store->updateUnixSocket( path );
+    }
 }
 
 #endif
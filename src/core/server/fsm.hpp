@@ -7,6 +7,8 @@ namespace simq::core::server {
             enum Code {
                 COMMON_RECV_CMD_CHECK_SECURE,
                 COMMON_SEND_CONFIRM_SECURE,
+                COMMON_SEND_CONFIRM_TLS,
+                COMMON_TLS_HANDSHAKE,
                 COMMON_RECV_CMD_GET_VERSION,
                 COMMON_SEND_VERSION,
                 COMMON_RECV_CMD_AUTH,
@@ -14,6 +16,9 @@ namespace simq::core::server {
                 COMMON_SEND_CONFIRM_AUTH_CONSUMER,
                 COMMON_SEND_CONFIRM_AUTH_PRODUCER,
                 COMMON_SEND_ERROR_WITH_CLOSE,
+                COMMON_SEND_CONFIRM_MUX,
+                // the connection carries streams, see Mux
+                COMMON_MUX,
 
                 COMMON_CLOSE,
 
@@ -41,6 +46,11 @@ namespace simq::core::server {
                 CONSUMER_SEND_CONFIRM_PART_MESSAGE_END,
                 CONSUMER_RECV_CMD_REMOVE_MESSAGE,
 
+                CONSUMER_SEND_CONFIRM_SUBSCRIBE,
+                CONSUMER_SUBSCRIBED_RECV_CMD,
+                CONSUMER_SUBSCRIBED_SEND_MESSAGE_META,
+                CONSUMER_SUBSCRIBED_SEND_MESSAGE,
+
                 CONSUMER_CLOSE,
 
 
@@ -62,12 +72,16 @@ namespace simq::core::server {
             static bool isClose( Code code );
             static bool isConsumerClose( Code code );
             static bool isConsumer( Code code );
+            static bool isSubscribed( Code code );
+            static bool isRecv( Code code );
     };
 
     FSM::Code FSM::getNextCodeAfterSend( Code code ) {
         switch( code ) {
             case COMMON_SEND_CONFIRM_SECURE:
                 return COMMON_RECV_CMD_GET_VERSION;
+            case COMMON_SEND_CONFIRM_TLS:
+                return COMMON_TLS_HANDSHAKE;
             case COMMON_SEND_VERSION:
                 return COMMON_RECV_CMD_AUTH;
             case COMMON_SEND_CONFIRM_AUTH_GROUP:
@@ -77,6 +91,8 @@ namespace simq::core::server {
                 return CONSUMER_RECV_CMD;
             case COMMON_SEND_CONFIRM_AUTH_PRODUCER:
                 return PRODUCER_RECV_CMD;
+            case COMMON_SEND_CONFIRM_MUX:
+                return COMMON_MUX;
             case GROUP_SEND:
             case GROUP_SEND_ERROR:
                 return GROUP_RECV_CMD;
@@ -93,6 +109,10 @@ namespace simq::core::server {
                 return CONSUMER_RECV_CMD_PART_MESSAGE;
             case CONSUMER_SEND_CONFIRM_PART_MESSAGE_END:
                 return CONSUMER_RECV_CMD_REMOVE_MESSAGE;
+            case CONSUMER_SEND_CONFIRM_SUBSCRIBE:
+                return CONSUMER_SUBSCRIBED_RECV_CMD;
+            case CONSUMER_SUBSCRIBED_SEND_MESSAGE_META:
+                return CONSUMER_SUBSCRIBED_SEND_MESSAGE;
             case PRODUCER_SEND:
             case PRODUCER_SEND_ERROR:
                 return PRODUCER_RECV_CMD;
@@ -134,12 +154,45 @@ namespace simq::core::server {
                 case CONSUMER_SEND_CONFIRM_PART_MESSAGE:
                 case CONSUMER_SEND_CONFIRM_PART_MESSAGE_END:
                 case CONSUMER_RECV_CMD_REMOVE_MESSAGE:
+                case CONSUMER_SEND_CONFIRM_SUBSCRIBE:
+                case CONSUMER_SUBSCRIBED_RECV_CMD:
+                case CONSUMER_SUBSCRIBED_SEND_MESSAGE_META:
+                case CONSUMER_SUBSCRIBED_SEND_MESSAGE:
                 case CONSUMER_CLOSE:
                     return true;
                 default:
                     return false;
         }
     }
+
+    bool FSM::isSubscribed( Code code ) {
+        switch( code ) {
+            case CONSUMER_SUBSCRIBED_RECV_CMD:
+            case CONSUMER_SUBSCRIBED_SEND_MESSAGE_META:
+            case CONSUMER_SUBSCRIBED_SEND_MESSAGE:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool FSM::isRecv( Code code ) {
+        switch( code ) {
+            case COMMON_RECV_CMD_CHECK_SECURE:
+            case COMMON_RECV_CMD_GET_VERSION:
+            case COMMON_RECV_CMD_AUTH:
+            case GROUP_RECV_CMD:
+            case CONSUMER_RECV_CMD:
+            case CONSUMER_RECV_CMD_PART_MESSAGE:
+            case CONSUMER_RECV_CMD_REMOVE_MESSAGE:
+            case PRODUCER_RECV_CMD:
+            case PRODUCER_RECV_PART_MESSAGE:
+            case PRODUCER_RECV_PART_MESSAGE_NULL:
+                return true;
+            default:
+                return false;
+        }
+    }
 }
 
 #endif
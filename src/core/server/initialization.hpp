@@ -168,6 +168,13 @@ namespace simq::core::server {
                     std::to_string( limitMessages.maxMessagesOnDisk ).c_str()
                 );
 
+                auto countShards = _store->getChannelShards( group, channel );
+                Logger::addItemToDetails(
+                    details,
+                    "shards",
+                    std::to_string( countShards ).c_str()
+                );
+
                 _access->addChannel( group, channel );
 
                 std::string pathToData;
@@ -178,7 +185,7 @@ namespace simq::core::server {
                     channel
                 );
 
-                _q->addChannel( group, channel, pathToData.c_str(), limitMessages );
+                _q->addChannel( group, channel, pathToData.c_str(), limitMessages, countShards );
 
                 Logger::success(
                     Logger::OP_INITIALIZATION_CHANNEL,
@@ -35,6 +35,8 @@ namespace simq::core::server {
                 OP_ADD_PRODUCER,
                 OP_UPDATE_PRODUCER_PASSWORD,
                 OP_REMOVE_PRODUCER,
+
+                OP_ACCEPT_STATS,
             };
 
             struct Detail {
@@ -148,6 +150,10 @@ namespace simq::core::server {
                 break;
             case OP_REMOVE_PRODUCER:
                 str = "Remove producer";
+                break;
+            case OP_ACCEPT_STATS:
+                str = "Accept statistics";
+                break;
         }
     }
 
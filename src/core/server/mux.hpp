@@ -0,0 +1,420 @@
+#ifndef SIMQ_CORE_SERVER_MUX
+#define SIMQ_CORE_SERVER_MUX
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include "server/manager.hpp"
+#include "../../util/io.hpp"
+#include "../../util/error.h"
+
+namespace simq::core::server {
+    // Logical streams of one connection. Every stream has a session and FSM of
+    // its own on a virtual fd, see util::IO; the mux keeps the bytes of the
+    // streams in user space and wakes a stream through the ready list of the
+    // server manager when it has something to read or room to write again.
+    //
+    // A frame is [stream][type][value] as big endian uints, a data frame is
+    // followed by value bytes. The client opens and closes streams, the server
+    // confirms a close with a close of its own once the stream is gone. Data of
+    // the client is limited by a window per stream, the server returns it with
+    // window frames; data of the server goes out a frame per stream in turn
+    class Mux: public util::IO::Endpoint {
+        public:
+            enum Type {
+                TYPE_DATA = 1,
+                TYPE_OPEN,
+                TYPE_CLOSE,
+                TYPE_WINDOW,
+            };
+
+            static const unsigned int SIZE_HEADER = sizeof( unsigned int ) * 3;
+            static const unsigned int MAX_FRAME = 16 * 1'024;
+            static const unsigned int WINDOW = 256 * 1'024;
+            static const unsigned int MAX_STREAMS = 64;
+
+        private:
+            // streams are framed while less than this waits for the connection,
+            // so a small reply never queues behind more than a frame of bulk data
+            static const unsigned int MAX_PENDING = MAX_FRAME;
+            // a session writes until this much of it waits to be framed
+            static const unsigned int MAX_OUT = 4 * MAX_FRAME;
+            static const unsigned int SIZE_READ = 64 * 1'024;
+
+            struct Stream {
+                unsigned int fd;
+                // bytes of the client the session has not read yet
+                std::string in;
+                unsigned int offsetIn = 0;
+                // bytes read since the last window frame
+                unsigned int taken = 0;
+                // bytes of the session not framed yet
+                std::string out;
+                unsigned int offsetOut = 0;
+                bool isReady = false;
+                // a write was cut short, the session waits for room
+                bool isBlocked = false;
+                bool isClosing = false;
+            };
+
+            int _fd;
+            server::Manager *_server;
+
+            // the frame being received
+            char _header[SIZE_HEADER];
+            unsigned int _lengthHeader = 0;
+            unsigned int _id = 0;
+            unsigned int _residue = 0;
+
+            std::string _out;
+            unsigned int _offsetOut = 0;
+
+            std::unordered_map<unsigned int, Stream> _streams;
+            std::unordered_map<unsigned int, unsigned int> _ids;
+            // streams with data to frame, served in turn
+            std::deque<unsigned int> _ready;
+
+            void _queue( unsigned int id, Type type, unsigned int value );
+            void _take( Stream *stream, const char *data, unsigned int length );
+            void _frame( unsigned int id, Stream *stream );
+            bool _flush();
+            template<typename F>
+            void _onHeader( F open );
+
+        public:
+            Mux( int fd, server::Manager *server );
+            ~Mux();
+
+            template<typename F>
+            void recv( F open );
+            void send();
+            bool isClosed( unsigned int fd );
+
+            long read( unsigned int fd, char *data, unsigned int length );
+            long write( unsigned int fd, const char *data, unsigned int length );
+            void close( unsigned int fd );
+    };
+
+    Mux::Mux( int fd, server::Manager *server ) : _fd{fd}, _server{server} {}
+
+    // the sessions of the streams are closed before, what is left only frees the fds
+    Mux::~Mux() {
+        std::vector<unsigned int> fds;
+        for( auto &item : _ids ) {
+            fds.push_back( item.first );
+        }
+
+        _ids.clear();
+        _streams.clear();
+
+        for( auto fd : fds ) {
+            util::IO::close( fd );
+        }
+    }
+
+    void Mux::_queue( unsigned int id, Type type, unsigned int value ) {
+        unsigned int header[3] = { htonl( id ), htonl( type ), htonl( value ) };
+
+        _out.append( ( const char * )header, SIZE_HEADER );
+    }
+
+    // reads the connection until it is drained, open( id ) returns the fd of a new stream
+    template<typename F>
+    void Mux::recv( F open ) {
+        char data[SIZE_READ];
+
+        while( true ) {
+            auto l = ::recv( _fd, data, SIZE_READ, 0 );
+
+            if( l == 0 ) {
+                throw util::Error::SOCKET;
+            }
+
+            if( l == -1 ) {
+                if( errno == EAGAIN ) {
+                    return;
+                }
+                throw util::Error::SOCKET;
+            }
+
+            unsigned int length = l;
+            unsigned int offset = 0;
+
+            while( offset < length ) {
+                if( _lengthHeader < SIZE_HEADER ) {
+                    auto size = std::min( SIZE_HEADER - _lengthHeader, length - offset );
+                    memcpy( &_header[_lengthHeader], &data[offset], size );
+                    _lengthHeader += size;
+                    offset += size;
+
+                    if( _lengthHeader == SIZE_HEADER ) {
+                        _onHeader( open );
+                    }
+                    continue;
+                }
+
+                auto size = std::min( _residue, length - offset );
+                auto it = _streams.find( _id );
+
+                // data of a closed stream is dropped
+                if( it != _streams.end() && !it->second.isClosing ) {
+                    _take( &it->second, &data[offset], size );
+                }
+
+                offset += size;
+                _residue -= size;
+
+                if( _residue == 0 ) {
+                    _lengthHeader = 0;
+                }
+            }
+        }
+    }
+
+    template<typename F>
+    void Mux::_onHeader( F open ) {
+        unsigned int header[3];
+        memcpy( header, _header, SIZE_HEADER );
+
+        _id = ntohl( header[0] );
+        auto type = ntohl( header[1] );
+        auto value = ntohl( header[2] );
+        auto it = _streams.find( _id );
+
+        _residue = 0;
+
+        switch( type ) {
+            case TYPE_DATA: {
+                if( value == 0 || value > MAX_FRAME ) {
+                    throw util::Error::WRONG_PARAM;
+                }
+
+                if( it != _streams.end() ) {
+                    auto stream = &it->second;
+                    if( stream->in.size() - stream->offsetIn + stream->taken + value > WINDOW ) {
+                        throw util::Error::WRONG_PARAM;
+                    }
+                }
+
+                _residue = value;
+                return;
+            }
+            case TYPE_OPEN: {
+                if( _id == 0 || it != _streams.end() || _streams.size() >= MAX_STREAMS ) {
+                    throw util::Error::WRONG_PARAM;
+                }
+
+                Stream stream;
+                stream.fd = open( _id );
+
+                _ids[stream.fd] = _id;
+                _streams.emplace( _id, std::move( stream ) );
+                break;
+            }
+            case TYPE_CLOSE: {
+                // the session sees it on its next turn and the stream goes away with it, see close
+                if( it != _streams.end() && !it->second.isClosing ) {
+                    it->second.isClosing = true;
+                    _server->schedule( it->second.fd );
+                }
+                break;
+            }
+            default:
+                throw util::Error::WRONG_PARAM;
+        }
+
+        _lengthHeader = 0;
+    }
+
+    void Mux::_take( Stream *stream, const char *data, unsigned int length ) {
+        if( stream->offsetIn >= WINDOW / 2 ) {
+            stream->in.erase( 0, stream->offsetIn );
+            stream->offsetIn = 0;
+        }
+
+        stream->in.append( data, length );
+        _server->schedule( stream->fd );
+    }
+
+    // moves a frame of what the session wrote to the connection
+    void Mux::_frame( unsigned int id, Stream *stream ) {
+        unsigned int length = stream->out.size() - stream->offsetOut;
+        if( length > MAX_FRAME ) {
+            length = MAX_FRAME;
+        }
+
+        if( length == 0 ) {
+            return;
+        }
+
+        _queue( id, TYPE_DATA, length );
+        _out.append( &stream->out[stream->offsetOut], length );
+        stream->offsetOut += length;
+
+        if( stream->offsetOut == stream->out.size() ) {
+            stream->out.clear();
+            stream->offsetOut = 0;
+        }
+    }
+
+    // Sends what waits for the connection and frames the streams in turn until
+    // the connection can not take more. A stream that got room again is woken.
+    // False on an error of the connection, its EPOLLRDHUP closes it
+    bool Mux::_flush() {
+        while( true ) {
+            while( _offsetOut < _out.size() ) {
+                auto l = ::send( _fd, &_out[_offsetOut], _out.size() - _offsetOut, MSG_NOSIGNAL );
+
+                if( l == -1 ) {
+                    return errno == EAGAIN;
+                }
+
+                _offsetOut += l;
+            }
+
+            _out.clear();
+            _offsetOut = 0;
+
+            if( _ready.empty() ) {
+                return true;
+            }
+
+            while( _out.size() < MAX_PENDING && !_ready.empty() ) {
+                auto id = _ready.front();
+                _ready.pop_front();
+
+                auto it = _streams.find( id );
+                if( it == _streams.end() ) {
+                    continue;
+                }
+
+                auto stream = &it->second;
+                _frame( id, stream );
+
+                if( stream->offsetOut < stream->out.size() ) {
+                    _ready.push_back( id );
+                } else {
+                    stream->isReady = false;
+                }
+
+                if( stream->isBlocked && stream->out.size() - stream->offsetOut < MAX_OUT ) {
+                    stream->isBlocked = false;
+                    _server->schedule( stream->fd );
+                }
+            }
+        }
+    }
+
+    void Mux::send() {
+        if( !_flush() ) {
+            throw util::Error::SOCKET;
+        }
+    }
+
+    bool Mux::isClosed( unsigned int fd ) {
+        auto it = _ids.find( fd );
+
+        return it != _ids.end() && _streams[it->second].isClosing;
+    }
+
+    long Mux::read( unsigned int fd, char *data, unsigned int length ) {
+        auto it = _ids.find( fd );
+        if( it == _ids.end() ) {
+            errno = EBADF;
+            return -1;
+        }
+
+        auto id = it->second;
+        auto stream = &_streams[id];
+        auto size = std::min( ( unsigned int )stream->in.size() - stream->offsetIn, length );
+
+        if( size == 0 ) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        memcpy( data, &stream->in[stream->offsetIn], size );
+        stream->offsetIn += size;
+        stream->taken += size;
+
+        if( stream->offsetIn == stream->in.size() ) {
+            stream->in.clear();
+            stream->offsetIn = 0;
+        }
+
+        if( stream->taken >= WINDOW / 2 ) {
+            _queue( id, TYPE_WINDOW, stream->taken );
+            stream->taken = 0;
+            _flush();
+        }
+
+        return size;
+    }
+
+    long Mux::write( unsigned int fd, const char *data, unsigned int length ) {
+        auto it = _ids.find( fd );
+        if( it == _ids.end() ) {
+            errno = EBADF;
+            return -1;
+        }
+
+        auto id = it->second;
+        auto stream = &_streams[id];
+        auto pending = stream->out.size() - stream->offsetOut;
+
+        if( pending >= MAX_OUT ) {
+            stream->isBlocked = true;
+            errno = EAGAIN;
+            return -1;
+        }
+
+        auto size = std::min( MAX_OUT - ( unsigned int )pending, length );
+
+        stream->out.erase( 0, stream->offsetOut );
+        stream->offsetOut = 0;
+        stream->out.append( data, size );
+
+        if( size < length ) {
+            stream->isBlocked = true;
+        }
+
+        if( !stream->isReady ) {
+            stream->isReady = true;
+            _ready.push_back( id );
+        }
+
+        _flush();
+
+        return size;
+    }
+
+    // the session of the stream is closed, what it wrote goes out before the close frame
+    void Mux::close( unsigned int fd ) {
+        auto it = _ids.find( fd );
+        if( it == _ids.end() ) {
+            return;
+        }
+
+        auto id = it->second;
+        auto stream = &_streams[id];
+
+        while( stream->offsetOut < stream->out.size() ) {
+            _frame( id, stream );
+        }
+
+        _queue( id, TYPE_CLOSE, 0 );
+
+        _streams.erase( id );
+        _ids.erase( it );
+
+        _flush();
+    }
+}
+
+#endif
@@ -2,18 +2,21 @@
 #define SIMQ_CORE_SERVER_PROTOCOL
 
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <string.h>
 #include <memory>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <stdarg.h>
+#include <initializer_list>
 #include <arpa/inet.h>
 #include <iostream>
 #include "../../util/types.h"
 #include "../../util/constants.h"
 #include "../../util/error.h"
+#include "../../util/io.hpp"
 #include "../../util/validation.hpp"
 #include "../../crypto/hash.hpp"
 
@@ -29,6 +32,10 @@ namespace simq::core::server {
         public:
             const static unsigned int LENGTH_META = SIZE_UINT * 2;
             const static unsigned int PACKET_SIZE = util::constants::MESSAGE_PACKET_SIZE;
+            const static unsigned int MAX_KEY_LENGTH = 255;
+            const static unsigned int MAX_COUNT_VALUES = 16;
+            static constexpr unsigned int MIN_CAPACITY = 128;
+            const static unsigned int TOKEN_LENGTH = 32;
 
             enum Cmd {
                 CMD_OK = 10,
@@ -37,6 +44,7 @@ namespace simq::core::server {
 
                 CMD_CHECK_SECURE = 101,
                 CMD_CHECK_NOSECURE = 102,
+                CMD_OPEN_MUX = 103,
 
                 CMD_GET_VERSION = 201,
 
@@ -45,6 +53,8 @@ namespace simq::core::server {
                 CMD_AUTH_GROUP = 1'001,
                 CMD_AUTH_CONSUMER = 1'002,
                 CMD_AUTH_PRODUCER = 1'003,
+                CMD_RESUME = 1'004,
+                CMD_GET_TOKEN = 1'005,
 
                 CMD_GET_CHANNELS = 2'001,
                 CMD_GET_CONSUMERS = 2'002,
@@ -69,12 +79,21 @@ namespace simq::core::server {
                 CMD_PUSH_MESSAGE = 6'001,
                 CMD_PUSH_REPLICA_MESSAGE = 6'002,
                 CMD_PUSH_SIGNAL_MESSAGE = 6'003,
+                CMD_PUSH_KEYED_MESSAGE = 6'004,
+                CMD_OPEN_RING = 6'005,
 
                 CMD_REMOVE_MESSAGE = 6'101,
                 CMD_REMOVE_MESSAGE_BY_UUID = 6'102,
+                CMD_ACK_MESSAGE = 6'103,
+                CMD_ACK_MESSAGES = 6'104,
+                CMD_REMOVE_MESSAGES = 6'105,
 
                 CMD_POP_MESSAGE = 6'201,
                 CMD_GET_PART_MESSAGE = 6'202,
+                CMD_SET_PREFETCH = 6'203,
+                CMD_SUBSCRIBE = 6'204,
+                CMD_CREDIT = 6'205,
+                CMD_ATTACH_CHANNEL = 6'206,
 
                 CMD_SEND_MESSAGE_META = 6'301,
                 CMD_SEND_SIGNAL_MESSAGE_META = 6'302,
@@ -95,12 +114,80 @@ namespace simq::core::server {
                 unsigned int countValues;
                 std::unique_ptr<unsigned int[]> valuesOffsets;
                 std::unique_ptr<char[]> values;
+
+                // size of values, it only grows and is reused by every packet of a session
+                unsigned int capacity = 0;
             };
         private:
             static const unsigned int SIZE_CMD = sizeof( Cmd );
+            static const unsigned int MAX_PARAMS = 5;
+
+            enum Param: unsigned char {
+                PARAM_LENGTH,
+                PARAM_DELAY,
+                PARAM_PREFETCH,
+                PARAM_TAG,
+                PARAM_CREDITS,
+                PARAM_MIN_MESSAGE_SIZE,
+                PARAM_MAX_MESSAGE_SIZE,
+                PARAM_MAX_MESSAGES_IN_MEMORY,
+                PARAM_MAX_MESSAGES_ON_DISK,
+                PARAM_PASSWORD,
+                PARAM_NEW_PASSWORD,
+                PARAM_GROUP,
+                PARAM_CHANNEL,
+                PARAM_CONSUMER,
+                PARAM_PRODUCER,
+                PARAM_UUID,
+                PARAM_UUIDS,
+                PARAM_KEY,
+                PARAM_TOKEN,
+
+                COUNT_PARAMS,
+            };
+
+            // checks the value at offset, stores its position and returns its size
+            using Checker = unsigned int (*)( Packet *packet, unsigned int offset, unsigned int iterator );
+
+            // layout of the body of a command, the whole protocol is described
+            // once by the table in _getDescriptor
+            struct Descriptor {
+                Cmd cmd;
+                unsigned int countParams;
+                Param params[MAX_PARAMS];
+                // resolved at compile time, the body is checked without a lookup per value
+                Checker checkers[MAX_PARAMS];
+                // index of the value of every kind of param, -1 if there is no such value
+                signed char positions[COUNT_PARAMS];
+            };
+
+            // commands are looked up by slot: the hundreds of cmd and its
+            // remainder, which is always below 32 in this protocol
+            static const unsigned int COUNT_SLOTS = 64 * 32;
+
+            struct Index {
+                unsigned char slots[COUNT_SLOTS];
+            };
+
+            struct String {
+                const char *value;
+                unsigned int length;
+            };
+
+            static constexpr Descriptor _describe( Cmd cmd, std::initializer_list<Param> params = {} );
+            static constexpr unsigned int _getSlot( unsigned int cmd );
+            template<unsigned int N>
+            static constexpr Index _makeIndex( const Descriptor ( &descriptors )[N] );
+            static const Descriptor *_getDescriptor( unsigned int cmd );
 
             static bool _recv( unsigned int fd, Packet *packet );
-            static unsigned int _calculateLengthBodyMessage( unsigned int value, ... );
+
+            static constexpr unsigned int _getLengthValue( unsigned int value );
+            static constexpr unsigned int _getLengthValue( String value );
+            static void _marshValue( Packet *packet, unsigned int value );
+            static void _marshValue( Packet *packet, String value );
+            template<typename ...T>
+            static void _prepare( Packet *packet, Cmd cmd, T ...values );
 
             static void _marsh( Packet *packet, unsigned int value );
             static void _marsh( Packet *packet, Cmd value );
@@ -112,10 +199,10 @@ namespace simq::core::server {
 
             static void _checkMeta( Packet *packet );
             static void _checkBody( Packet *packet );
-            static unsigned int _calculateCountValues( Packet *packet );
 
             static unsigned int _getLengthByOffset( Packet *packet, unsigned int offset );
 
+            static constexpr Checker _getChecker( Param param );
             static unsigned int _checkParamCmdUInt(
                 Packet *packet,
                 unsigned int offset,
@@ -151,35 +238,34 @@ namespace simq::core::server {
                 unsigned int offset,
                 unsigned int iterator
             );
+            static unsigned int _checkParamCmdUUIDs(
+                Packet *packet,
+                unsigned int offset,
+                unsigned int iterator
+            );
+            static unsigned int _checkParamCmdKey(
+                Packet *packet,
+                unsigned int offset,
+                unsigned int iterator
+            );
+            static unsigned int _checkParamCmdToken(
+                Packet *packet,
+                unsigned int offset,
+                unsigned int iterator
+            );
 
             static void _checkControlLength( unsigned int calculateLength, unsigned int length );
 
-            static void _checkCmdUpdatePassword( Packet *packet );
-            static void _checkCmdAuthGroup( Packet *packet );
-            static void _checkCmdAuthConsumer( Packet *packet );
-            static void _checkCmdAuthProducer( Packet *packet );
-            static void _checkCmdGetUsers( Packet *packet );
-            static void _checkCmdGetChannelLimitMessages( Packet *packet );
-            static void _checkCmdAddChannel( Packet *packet );
-            static void _checkCmdUpdateChannelLimitMessages( Packet *packet );
-            static void _checkCmdRemoveChannel( Packet *packet );
-            static void _checkCmdAddConsumer( Packet *packet );
-            static void _checkCmdUpdateConsumerPassword( Packet *packet );
-            static void _checkCmdRemoveConsumer( Packet *packet );
-            static void _checkCmdAddProducer( Packet *packet );
-            static void _checkCmdUpdateProducerPassword( Packet *packet );
-            static void _checkCmdRemoveProducer( Packet *packet );
-            static void _checkCmdPushMessage( Packet *packet );
-            static void _checkCmdPushReplicaMessage( Packet *packet );
-            static void _checkCmdPushSignalMessage( Packet *packet );
-            static void _checkCmdRemoveMessageByUUID( Packet *packet );
-            static void _checkCmdPopMessage( Packet *packet );
-            static void _checkCmdClearQ( Packet *packet );
+            static bool _isCmd( Packet *packet, Cmd cmd );
+            static const char *_getValue( Packet *packet, Param param );
+            static unsigned int _getUInt( Packet *packet, Param param );
 
         public:
             static void prepareVersion( Packet *packet );
             static void prepareOk( Packet *packet );
             static void prepareError( Packet *packet, const char *description );
+            static void prepareToken( Packet *packet, const unsigned char *token );
+            static void prepareRing( Packet *packet, unsigned int sizeData, unsigned int countCompletions );
             static void prepareStringList(
                 Packet *packet,
                 std::list<std::string> &list
@@ -199,17 +285,22 @@ namespace simq::core::server {
             static void prepareMessageMetaPop(
                 Packet *packet,
                 unsigned int length,
-                const char *uuid
+                const char *uuid,
+                unsigned int tag = 0,
+                const char *channel = nullptr
             );
             static void prepareSignalMessageMetaPop(
                 Packet *packet,
-                unsigned int length
+                unsigned int length,
+                unsigned int tag = 0,
+                const char *channel = nullptr
             );
             static void prepareNoneMessageMetaPop(
                 Packet *packet
             );
 
             static bool send( unsigned int fd, Packet *packet );
+            static bool sendRights( unsigned int fd, Packet *packet, const int *fds, unsigned int count );
 
             static void recv( unsigned int fd, Packet *packet );
 
@@ -217,6 +308,7 @@ namespace simq::core::server {
 
             static bool isCheckSecure( Packet *packet );
             static bool isCheckNoSecure( Packet *packet );
+            static bool isOpenMux( Packet *packet );
             static bool isGetVersion( Packet *packet );
 
             static bool isUpdatePassword( Packet *packet );
@@ -229,6 +321,8 @@ namespace simq::core::server {
             static bool isAuthGroup( Packet *packet );
             static bool isAuthConsumer( Packet *packet );
             static bool isAuthProducer( Packet *packet );
+            static bool isResume( Packet *packet );
+            static bool isGetToken( Packet *packet );
 
             static bool isAddChannel( Packet *packet );
             static bool isUpdateChannelLimitMessages( Packet *packet );
@@ -248,9 +342,18 @@ namespace simq::core::server {
             static bool isPushMessage( Packet *packet );
             static bool isPushSignalMessage( Packet *packet );
             static bool isPushReplicaMessage( Packet *packet );
+            static bool isPushKeyedMessage( Packet *packet );
+            static bool isOpenRing( Packet *packet );
 
             static bool isRemoveMessage( Packet *packet );
             static bool isRemoveMessageByUUID( Packet *packet );
+            static bool isRemoveMessages( Packet *packet );
+            static bool isSetPrefetch( Packet *packet );
+            static bool isAckMessage( Packet *packet );
+            static bool isAckMessages( Packet *packet );
+            static bool isSubscribe( Packet *packet );
+            static bool isCredit( Packet *packet );
+            static bool isAttachChannel( Packet *packet );
 
             static bool isClearQ( Packet *packet );
 
@@ -261,10 +364,16 @@ namespace simq::core::server {
 
             static const unsigned char *getPassword( Packet *packet );
             static const unsigned char *getNewPassword( Packet *packet );
+            static const unsigned char *getToken( Packet *packet );
 
             static unsigned int getLength( Packet *packet );
             static unsigned int getDelay( Packet *packet );
+            static unsigned int getPrefetch( Packet *packet );
+            static unsigned int getTag( Packet *packet );
+            static unsigned int getCredits( Packet *packet );
             static const char *getUUID( Packet *packet );
+            static void getUUIDs( Packet *packet, std::vector<const char *> &uuids );
+            static const char *getKey( Packet *packet );
             static void getChannelLimitMessages(
                 Packet *packet,
                 util::types::ChannelLimitMessages &limitMessages
@@ -276,12 +385,176 @@ namespace simq::core::server {
             static bool isFullPart( BasePacket *packet );
     };
 
+    constexpr Protocol::Descriptor Protocol::_describe( Cmd cmd, std::initializer_list<Param> params ) {
+        Descriptor descriptor{ cmd, 0, {}, {}, {} };
+
+        for( unsigned int i = 0; i < COUNT_PARAMS; i++ ) {
+            descriptor.positions[i] = -1;
+        }
+
+        for( auto param : params ) {
+            if( descriptor.countParams == MAX_PARAMS ) {
+                throw util::Error::WRONG_PARAM;
+            }
+
+            if( descriptor.positions[param] == -1 ) {
+                descriptor.positions[param] = descriptor.countParams;
+            }
+
+            descriptor.params[descriptor.countParams] = param;
+            descriptor.checkers[descriptor.countParams++] = _getChecker( param );
+        }
+
+        return descriptor;
+    }
+
+    constexpr Protocol::Checker Protocol::_getChecker( Param param ) {
+        switch( param ) {
+            case PARAM_LENGTH:
+            case PARAM_DELAY:
+            case PARAM_PREFETCH:
+            case PARAM_TAG:
+            case PARAM_CREDITS:
+            case PARAM_MIN_MESSAGE_SIZE:
+            case PARAM_MAX_MESSAGE_SIZE:
+            case PARAM_MAX_MESSAGES_IN_MEMORY:
+            case PARAM_MAX_MESSAGES_ON_DISK:
+                return _checkParamCmdUInt;
+            case PARAM_PASSWORD:
+            case PARAM_NEW_PASSWORD:
+                return _checkParamCmdPassword;
+            case PARAM_GROUP:
+                return _checkParamCmdGroupName;
+            case PARAM_CHANNEL:
+                return _checkParamCmdChannelName;
+            case PARAM_CONSUMER:
+                return _checkParamCmdConsumerName;
+            case PARAM_PRODUCER:
+                return _checkParamCmdProducerName;
+            case PARAM_UUID:
+                return _checkParamCmdUUID;
+            case PARAM_UUIDS:
+                return _checkParamCmdUUIDs;
+            case PARAM_KEY:
+                return _checkParamCmdKey;
+            case PARAM_TOKEN:
+                return _checkParamCmdToken;
+            case COUNT_PARAMS:
+                break;
+        }
+
+        // evaluated at compile time, a param without a checker breaks the build
+        throw util::Error::WRONG_PARAM;
+    }
+
+    constexpr unsigned int Protocol::_getSlot( unsigned int cmd ) {
+        auto remainder = cmd % 100;
+        auto slot = cmd / 100 * 32 + remainder;
+
+        return remainder < 32 && slot < COUNT_SLOTS ? slot : COUNT_SLOTS;
+    }
+
+    template<unsigned int N>
+    constexpr Protocol::Index Protocol::_makeIndex( const Descriptor ( &descriptors )[N] ) {
+        static_assert( N < 256 );
+
+        Index index{};
+
+        for( unsigned int i = 0; i < N; i++ ) {
+            auto slot = _getSlot( descriptors[i].cmd );
+
+            // evaluated at compile time, a command without its own slot breaks the build
+            if( slot == COUNT_SLOTS || index.slots[slot] != 0 ) {
+                throw util::Error::WRONG_CMD;
+            }
+
+            index.slots[slot] = i + 1;
+        }
+
+        return index;
+    }
+
+    const Protocol::Descriptor *Protocol::_getDescriptor( unsigned int cmd ) {
+        static constexpr Descriptor descriptors[] = {
+            _describe( CMD_OK ),
+            _describe( CMD_CHECK_SECURE ),
+            _describe( CMD_CHECK_NOSECURE ),
+            _describe( CMD_OPEN_MUX ),
+            _describe( CMD_GET_VERSION ),
+            _describe( CMD_GET_CHANNELS ),
+            _describe( CMD_REMOVE_MESSAGE ),
+            _describe( CMD_GET_PART_MESSAGE ),
+
+            _describe( CMD_UPDATE_PASSWORD, { PARAM_PASSWORD, PARAM_NEW_PASSWORD } ),
+
+            _describe( CMD_AUTH_GROUP, { PARAM_GROUP, PARAM_PASSWORD } ),
+            _describe( CMD_AUTH_CONSUMER, { PARAM_GROUP, PARAM_CHANNEL, PARAM_CONSUMER, PARAM_PASSWORD } ),
+            _describe( CMD_AUTH_PRODUCER, { PARAM_GROUP, PARAM_CHANNEL, PARAM_PRODUCER, PARAM_PASSWORD } ),
+            _describe( CMD_RESUME, { PARAM_TOKEN } ),
+            _describe( CMD_GET_TOKEN ),
+
+            _describe( CMD_GET_CONSUMERS, { PARAM_CHANNEL } ),
+            _describe( CMD_GET_PRODUCERS, { PARAM_CHANNEL } ),
+            _describe( CMD_GET_CHANNEL_LIMIT_MESSSAGES, { PARAM_CHANNEL } ),
+
+            _describe( CMD_ADD_CHANNEL, {
+                PARAM_CHANNEL,
+                PARAM_MIN_MESSAGE_SIZE,
+                PARAM_MAX_MESSAGE_SIZE,
+                PARAM_MAX_MESSAGES_IN_MEMORY,
+                PARAM_MAX_MESSAGES_ON_DISK,
+            } ),
+            _describe( CMD_UPDATE_CHANNEL_LIMIT_MESSAGES, {
+                PARAM_CHANNEL,
+                PARAM_MIN_MESSAGE_SIZE,
+                PARAM_MAX_MESSAGE_SIZE,
+                PARAM_MAX_MESSAGES_IN_MEMORY,
+                PARAM_MAX_MESSAGES_ON_DISK,
+            } ),
+            _describe( CMD_REMOVE_CHANNEL, { PARAM_CHANNEL } ),
+            _describe( CMD_CLEAR_Q, { PARAM_CHANNEL } ),
+
+            _describe( CMD_ADD_CONSUMER, { PARAM_CHANNEL, PARAM_CONSUMER, PARAM_PASSWORD } ),
+            _describe( CMD_UPDATE_CONSUMER_PASSWORD, { PARAM_CHANNEL, PARAM_CONSUMER, PARAM_PASSWORD } ),
+            _describe( CMD_REMOVE_CONSUMER, { PARAM_CHANNEL, PARAM_CONSUMER } ),
+
+            _describe( CMD_ADD_PRODUCER, { PARAM_CHANNEL, PARAM_PRODUCER, PARAM_PASSWORD } ),
+            _describe( CMD_UPDATE_PRODUCER_PASSWORD, { PARAM_CHANNEL, PARAM_PRODUCER, PARAM_PASSWORD } ),
+            _describe( CMD_REMOVE_PRODUCER, { PARAM_CHANNEL, PARAM_PRODUCER } ),
+
+            _describe( CMD_PUSH_MESSAGE, { PARAM_LENGTH } ),
+            _describe( CMD_PUSH_REPLICA_MESSAGE, { PARAM_LENGTH, PARAM_UUID } ),
+            _describe( CMD_PUSH_SIGNAL_MESSAGE, { PARAM_LENGTH } ),
+            _describe( CMD_PUSH_KEYED_MESSAGE, { PARAM_LENGTH, PARAM_KEY } ),
+            _describe( CMD_OPEN_RING ),
+
+            _describe( CMD_REMOVE_MESSAGE_BY_UUID, { PARAM_UUID } ),
+            _describe( CMD_ACK_MESSAGE, { PARAM_TAG } ),
+            _describe( CMD_ACK_MESSAGES, { PARAM_TAG } ),
+            _describe( CMD_REMOVE_MESSAGES, { PARAM_UUIDS } ),
+
+            _describe( CMD_POP_MESSAGE, { PARAM_DELAY } ),
+            _describe( CMD_SET_PREFETCH, { PARAM_PREFETCH } ),
+            _describe( CMD_SUBSCRIBE, { PARAM_CREDITS } ),
+            _describe( CMD_CREDIT, { PARAM_CREDITS } ),
+            _describe( CMD_ATTACH_CHANNEL, { PARAM_CHANNEL, PARAM_CONSUMER, PARAM_PASSWORD } ),
+        };
+        static constexpr Index index = _makeIndex( descriptors );
+
+        auto slot = _getSlot( cmd );
+
+        if( slot == COUNT_SLOTS || index.slots[slot] == 0 ) {
+            return nullptr;
+        }
+
+        return &descriptors[index.slots[slot] - 1];
+    }
+
     bool Protocol::_recv( unsigned int fd, Packet *packet ) {
-        auto l = ::recv(
+        auto l = util::IO::recv(
             fd,
             &packet->values.get()[packet->wrLength],
-            packet->length - packet->wrLength,
-            MSG_NOSIGNAL
+            packet->length - packet->wrLength
         );
 
         if( l == -1 ) {
@@ -298,11 +571,10 @@ namespace simq::core::server {
     }
 
     bool Protocol::send( unsigned int fd, Packet *packet ) {
-        auto l = ::send(
+        auto l = util::IO::send(
             fd,
             &packet->values.get()[packet->wrLength],
-            packet->length - packet->wrLength,
-            MSG_NOSIGNAL
+            packet->length - packet->wrLength
         );
 
         if( l == -1 ) {
@@ -318,26 +590,72 @@ namespace simq::core::server {
         return packet->wrLength == packet->length;
     };
 
-    unsigned int Protocol::_calculateLengthBodyMessage( unsigned int value, ... ) {
-        unsigned int total = 0;
-        total += SIZE_UINT;
-        total += value;
+    // Sends the start of the packet with the descriptors attached, the rest
+    // goes by send. The descriptors are lost if nothing can be sent, so a full
+    // socket is an error here
+    bool Protocol::sendRights( unsigned int fd, Packet *packet, const int *fds, unsigned int count ) {
+        if( count > 4 ) {
+            throw util::Error::WRONG_PARAM;
+        }
 
-        va_list args;
-        va_start( args, value );
- 
-        while( true ) {
-            auto item = va_arg( args, unsigned int );
+        char control[CMSG_SPACE( sizeof( int ) * 4 )]{};
 
-            if( item == 0 ) {
-                break;
-            }
+        struct iovec iov;
+        iov.iov_base = &packet->values.get()[packet->wrLength];
+        iov.iov_len = packet->length - packet->wrLength;
 
-            total += SIZE_UINT;
-            total += item;
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE( sizeof( int ) * count );
+
+        auto cmsg = CMSG_FIRSTHDR( &msg );
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN( sizeof( int ) * count );
+        memcpy( CMSG_DATA( cmsg ), fds, sizeof( int ) * count );
+
+        auto l = ::sendmsg( fd, &msg, MSG_NOSIGNAL );
+
+        if( l <= 0 ) {
+            throw util::Error::SOCKET;
         }
 
-        return total;
+        packet->wrLength += l;
+
+        return packet->wrLength == packet->length;
+    }
+
+    constexpr unsigned int Protocol::_getLengthValue( unsigned int ) {
+        return SIZE_UINT + SIZE_UINT;
+    }
+
+    constexpr unsigned int Protocol::_getLengthValue( String value ) {
+        return SIZE_UINT + value.length;
+    }
+
+    void Protocol::_marshValue( Packet *packet, unsigned int value ) {
+        _marsh( packet, SIZE_UINT );
+        _marsh( packet, value );
+    }
+
+    void Protocol::_marshValue( Packet *packet, String value ) {
+        _marsh( packet, value.length );
+        _marsh( packet, value.value, value.length );
+    }
+
+    template<typename ...T>
+    void Protocol::_prepare( Packet *packet, Cmd cmd, T ...values ) {
+        unsigned int lengthBody = ( _getLengthValue( values ) + ... + 0 );
+
+        _reservePacketValues( packet, LENGTH_META + lengthBody );
+        packet->length = 0;
+
+        _marsh( packet, cmd );
+        _marsh( packet, lengthBody );
+
+        ( _marshValue( packet, values ), ... );
     }
 
     void Protocol::_marsh( Packet *packet, unsigned int value ) {
@@ -365,44 +683,35 @@ namespace simq::core::server {
     }
 
     void Protocol::_reservePacketValues( Packet *packet, unsigned int length ){
-        packet->values = std::make_unique<char[]>( length + 1 );
+        if( packet->values == nullptr || packet->capacity < length + 1 ) {
+            packet->capacity = std::max( length + 1, MIN_CAPACITY );
+            packet->values.reset( new char[packet->capacity] );
+        }
+
+        packet->values[length] = 0;
         packet->length = length;
         packet->wrLength = 0;
     }
 
     void Protocol::prepareVersion( Packet *packet ) {
-        auto lengthBody = _calculateLengthBodyMessage( SIZE_UINT, 0 );
-
-        _reservePacketValues( packet, LENGTH_META + lengthBody );
-        packet->length = 0;
-
-        _marsh( packet, CMD_OK );
-        _marsh( packet, lengthBody );
-
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, VERSION );
+        _prepare( packet, CMD_OK, VERSION );
     }
 
     void Protocol::prepareOk( Packet *packet ) {
-        _reservePacketValues( packet, LENGTH_META );
-        packet->length = 0;
-
-        _marsh( packet, CMD_OK );
-        _marsh( packet, ( unsigned int )0 );
+        _prepare( packet, CMD_OK );
     }
 
     void Protocol::prepareError( Packet *packet, const char *description ) {
-        auto lengthDescr = strlen( description ) + 1;
-        auto lengthBody = _calculateLengthBodyMessage( lengthDescr, 0 );
-
-        _reservePacketValues( packet, LENGTH_META + lengthBody );
-        packet->length = 0;
+        _prepare( packet, CMD_ERROR, String{ description, ( unsigned int )strlen( description ) + 1 } );
+    }
 
-        _marsh( packet, CMD_ERROR );
-        _marsh( packet, lengthBody );
+    // the token for the next reconnect, see CMD_GET_TOKEN and CMD_RESUME
+    void Protocol::prepareToken( Packet *packet, const unsigned char *token ) {
+        _prepare( packet, CMD_OK, String{ ( const char * )token, TOKEN_LENGTH } );
+    }
 
-        _marsh( packet, lengthDescr );
-        _marsh( packet, description, lengthDescr );
+    void Protocol::prepareRing( Packet *packet, unsigned int sizeData, unsigned int countCompletions ) {
+        _prepare( packet, CMD_OK, sizeData, countCompletions );
     }
 
     void Protocol::prepareStringList(
@@ -433,43 +742,21 @@ namespace simq::core::server {
         Packet *packet,
         util::types::ChannelLimitMessages &limitMessages
     ) {
-        auto lengthBody = _calculateLengthBodyMessage(
-            SIZE_UINT,
-            SIZE_UINT,
-            SIZE_UINT,
-            SIZE_UINT,
-            0
+        _prepare(
+            packet,
+            CMD_OK,
+            limitMessages.minMessageSize,
+            limitMessages.maxMessageSize,
+            limitMessages.maxMessagesInMemory,
+            limitMessages.maxMessagesOnDisk
         );
-
-        _reservePacketValues( packet, LENGTH_META + lengthBody );
-        packet->length = 0;
-
-        _marsh( packet, CMD_OK );
-        _marsh( packet, lengthBody );
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, limitMessages.minMessageSize );
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, limitMessages.maxMessageSize );
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, limitMessages.maxMessagesInMemory );
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, limitMessages.maxMessagesOnDisk );
     }
 
     void Protocol::prepareMessageMetaPush(
         Packet *packet,
         const char *uuid
     ) {
-        auto lengthUUID = strlen( uuid ) + 1;
-        auto lengthBody = _calculateLengthBodyMessage( lengthUUID, 0 );
-
-        _reservePacketValues( packet, LENGTH_META + lengthBody );
-        packet->length = 0;
-
-        _marsh( packet, CMD_OK );
-        _marsh( packet, lengthBody );
-        _marsh( packet, lengthUUID );
-        _marsh( packet, uuid, lengthUUID );
+        _prepare( packet, CMD_OK, String{ uuid, ( unsigned int )strlen( uuid ) + 1 } );
     }
 
     void Protocol::prepareSignalMessageMetaPush( Packet *packet ) {
@@ -479,45 +766,42 @@ namespace simq::core::server {
     void Protocol::prepareMessageMetaPop(
         Packet *packet,
         unsigned int length,
-        const char *uuid
+        const char *uuid,
+        unsigned int tag,
+        const char *channel
     ) {
-        auto lengthUUID = strlen( uuid ) + 1;
-        auto lengthBody = _calculateLengthBodyMessage( SIZE_UINT, lengthUUID, 0 );
-
-        _reservePacketValues( packet, LENGTH_META + lengthBody );
-        packet->length = 0;
-
-        _marsh( packet, CMD_SEND_MESSAGE_META );
-        _marsh( packet, lengthBody );
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, length );
-        _marsh( packet, lengthUUID );
-        _marsh( packet, uuid, lengthUUID );
+        String value{ uuid, ( unsigned int )strlen( uuid ) + 1 };
+
+        // the delivery tag is sent only to consumers with a prefetch window,
+        // a consumer with attached channels always gets it before the channel
+        if( channel ) {
+            _prepare( packet, CMD_SEND_MESSAGE_META, length, value, tag, String{ channel, ( unsigned int )strlen( channel ) + 1 } );
+        } else if( tag ) {
+            _prepare( packet, CMD_SEND_MESSAGE_META, length, value, tag );
+        } else {
+            _prepare( packet, CMD_SEND_MESSAGE_META, length, value );
+        }
     }
 
     void Protocol::prepareSignalMessageMetaPop(
         Packet *packet,
-        unsigned int length
+        unsigned int length,
+        unsigned int tag,
+        const char *channel
     ) {
-        auto lengthBody = _calculateLengthBodyMessage( SIZE_UINT, 0 );
-
-        _reservePacketValues( packet, LENGTH_META + lengthBody );
-        packet->length = 0;
-
-        _marsh( packet, CMD_SEND_SIGNAL_MESSAGE_META );
-        _marsh( packet, lengthBody );
-        _marsh( packet, SIZE_UINT );
-        _marsh( packet, length );
+        if( channel ) {
+            _prepare( packet, CMD_SEND_SIGNAL_MESSAGE_META, length, tag, String{ channel, ( unsigned int )strlen( channel ) + 1 } );
+        } else if( tag ) {
+            _prepare( packet, CMD_SEND_SIGNAL_MESSAGE_META, length, tag );
+        } else {
+            _prepare( packet, CMD_SEND_SIGNAL_MESSAGE_META, length );
+        }
     }
 
     void Protocol::prepareNoneMessageMetaPop(
         Packet *packet
     ) {
-        _reservePacketValues( packet, LENGTH_META );
-        packet->length = 0;
-
-        _marsh( packet, CMD_SEND_MESSAGE_NONE );
-        _marsh( packet, ( unsigned int )0 );
+        _prepare( packet, CMD_SEND_MESSAGE_NONE );
     }
 
     void Protocol::_checkMeta( Packet *packet ) {
@@ -526,57 +810,32 @@ namespace simq::core::server {
         packet->cmd = ( Cmd )ntohl( packet->cmd );
         packet->length = ntohl( packet->length );
 
-        switch( packet->cmd ) {
-            case CMD_OK:
-            case CMD_CHECK_SECURE:
-            case CMD_CHECK_NOSECURE:
-            case CMD_REMOVE_MESSAGE:
-            case CMD_GET_CHANNELS:
-            case CMD_GET_VERSION:
-            case CMD_GET_PART_MESSAGE:
-                if( packet->length != 0 ) {
-                    throw util::Error::WRONG_CMD;
-                }
-                break;
-            case CMD_UPDATE_PASSWORD:
-            case CMD_AUTH_GROUP:
-            case CMD_AUTH_CONSUMER:
-            case CMD_AUTH_PRODUCER:
-            case CMD_GET_CONSUMERS:
-            case CMD_GET_PRODUCERS:
-            case CMD_GET_CHANNEL_LIMIT_MESSSAGES:
-            case CMD_ADD_CHANNEL:
-            case CMD_UPDATE_CHANNEL_LIMIT_MESSAGES:
-            case CMD_REMOVE_CHANNEL:
-            case CMD_ADD_CONSUMER:
-            case CMD_UPDATE_CONSUMER_PASSWORD:
-            case CMD_REMOVE_CONSUMER:
-            case CMD_ADD_PRODUCER:
-            case CMD_UPDATE_PRODUCER_PASSWORD:
-            case CMD_REMOVE_PRODUCER:
-            case CMD_PUSH_MESSAGE:
-            case CMD_PUSH_SIGNAL_MESSAGE:
-            case CMD_PUSH_REPLICA_MESSAGE:
-            case CMD_REMOVE_MESSAGE_BY_UUID:
-            case CMD_POP_MESSAGE:
-            case CMD_CLEAR_Q:
-                if( packet->length > PACKET_SIZE ) {
-                    throw util::Error::WRONG_CMD;
-                }
-                break;
-            default:
-                throw util::Error::WRONG_CMD;
-                break;
+        auto descriptor = _getDescriptor( packet->cmd );
+
+        if( descriptor == nullptr ) {
+            throw util::Error::WRONG_CMD;
+        }
+
+        if( descriptor->countParams == 0 && packet->length != 0 ) {
+            throw util::Error::WRONG_CMD;
+        }
+
+        if( descriptor->countParams != 0 && ( packet->length == 0 || packet->length > PACKET_SIZE ) ) {
+            throw util::Error::WRONG_CMD;
         }
     }
 
     unsigned int Protocol::_getLengthByOffset( Packet *packet, unsigned int offset ) {
+        if( offset + SIZE_UINT > packet->length ) {
+            throw util::Error::WRONG_CMD;
+        }
+
         unsigned int length = 0;
         memcpy( &length, &packet->values[offset], SIZE_UINT );
 
         length = ntohl( length );
 
-        if( length == 0 || offset + SIZE_UINT + length > packet->length ) {
+        if( length == 0 || length > packet->length - offset - SIZE_UINT ) {
             throw util::Error::WRONG_CMD;
         }
 
@@ -594,7 +853,7 @@ namespace simq::core::server {
             throw util::Error::WRONG_PARAM;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
@@ -610,7 +869,7 @@ namespace simq::core::server {
             throw util::Error::WRONG_PASSWORD;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
@@ -628,7 +887,7 @@ namespace simq::core::server {
             throw util::Error::WRONG_GROUP;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
@@ -646,7 +905,7 @@ namespace simq::core::server {
             throw util::Error::WRONG_CHANNEL;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
@@ -664,7 +923,7 @@ namespace simq::core::server {
             throw util::Error::WRONG_CONSUMER;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
@@ -682,7 +941,7 @@ namespace simq::core::server {
             throw util::Error::WRONG_PRODUCER;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
@@ -700,295 +959,100 @@ namespace simq::core::server {
             throw util::Error::WRONG_UUID;
         }
 
-        packet->valuesOffsets[iterator] = offset ? offset + SIZE_UINT : SIZE_UINT;
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
         return SIZE_UINT + l;
     }
 
-    void Protocol::_checkControlLength( unsigned int calculateLength, unsigned int length ) {
-        if( calculateLength != length ) {
-            throw util::Error::WRONG_CMD;
-        }
-    }
-
-    void Protocol::_checkCmdUpdatePassword( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdPassword( packet, offset, 0 );
-        offset += _checkParamCmdPassword( packet, offset, 1 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdAuthGroup( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdGroupName( packet, offset, 0 );
-        offset += _checkParamCmdPassword( packet, offset, 1 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdAuthConsumer( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdGroupName( packet, offset, 0 );
-        offset += _checkParamCmdChannelName( packet, offset, 1 );
-        offset += _checkParamCmdConsumerName( packet, offset, 2 );
-        offset += _checkParamCmdPassword( packet, offset, 3 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdAuthProducer( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdGroupName( packet, offset, 0 );
-        offset += _checkParamCmdChannelName( packet, offset, 1 );
-        offset += _checkParamCmdProducerName( packet, offset, 2 );
-        offset += _checkParamCmdPassword( packet, offset, 3 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdGetUsers( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdGetChannelLimitMessages( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdAddChannel( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-        offset += _checkParamCmdUInt( packet, offset, 1 );
-        offset += _checkParamCmdUInt( packet, offset, 2 );
-        offset += _checkParamCmdUInt( packet, offset, 3 );
-        offset += _checkParamCmdUInt( packet, offset, 4 );
-
-        _checkControlLength( offset, packet->length );
-
-        util::types::ChannelLimitMessages limitMessages{};
-
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        _demarsh( &values[offsets[1]], limitMessages.minMessageSize );
-        _demarsh( &values[offsets[2]], limitMessages.maxMessageSize );
-        _demarsh( &values[offsets[3]], limitMessages.maxMessagesInMemory );
-        _demarsh( &values[offsets[4]], limitMessages.maxMessagesOnDisk );
+    // a single value with the uuids one after another, each ends with \0
+    unsigned int Protocol::_checkParamCmdUUIDs(
+        Packet *packet,
+        unsigned int offset,
+        unsigned int iterator
+    ) {
+        auto l = _getLengthByOffset( packet, offset );
 
-        if( !util::Validation::isChannelLimitMessages( limitMessages ) ) {
-            throw util::Error::WRONG_CHANNEL_LIMIT_MESSAGES;
+        if( l % ( util::UUID::LENGTH + 1 ) != 0 ) {
+            throw util::Error::WRONG_UUID;
         }
-    }
-
-    void Protocol::_checkCmdUpdateChannelLimitMessages( Packet *packet ) {
-        _checkCmdAddChannel( packet );
-    }
-
-    void Protocol::_checkCmdRemoveChannel( Packet *packet ) {
-        auto offset = 0;
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdAddConsumer( Packet *packet ) {
-        auto offset = 0;
-
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-        offset += _checkParamCmdConsumerName( packet, offset, 1 );
-        offset += _checkParamCmdPassword( packet, offset, 2 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdUpdateConsumerPassword( Packet *packet ) {
-        _checkCmdAddConsumer( packet );
-    }
-
-    void Protocol::_checkCmdRemoveConsumer( Packet *packet ) {
-        auto offset = 0;
-
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-        offset += _checkParamCmdConsumerName( packet, offset, 1 );
 
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdAddProducer( Packet *packet ) {
-        auto offset = 0;
+        for( unsigned int i = 0; i < l; i += util::UUID::LENGTH + 1 ) {
+            auto uuid = &packet->values[offset + SIZE_UINT + i];
 
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-        offset += _checkParamCmdProducerName( packet, offset, 1 );
-        offset += _checkParamCmdPassword( packet, offset, 2 );
-
-        _checkControlLength( offset, packet->length );
-    }
-
-    void Protocol::_checkCmdUpdateProducerPassword( Packet *packet ) {
-        _checkCmdAddProducer( packet );
-    }
-
-    void Protocol::_checkCmdRemoveProducer( Packet *packet ) {
-        auto offset = 0;
+            if( uuid[util::UUID::LENGTH] != 0 || !util::Validation::isUUID( uuid ) ) {
+                throw util::Error::WRONG_UUID;
+            }
+        }
 
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
-        offset += _checkParamCmdProducerName( packet, offset, 1 );
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
-        _checkControlLength( offset, packet->length );
+        return SIZE_UINT + l;
     }
 
-    void Protocol::_checkCmdPushMessage( Packet *packet ) {
-        auto offset = 0;
-
-        offset += _checkParamCmdUInt( packet, offset, 0 );
+    unsigned int Protocol::_checkParamCmdKey(
+        Packet *packet,
+        unsigned int offset,
+        unsigned int iterator
+    ) {
+        auto l = _getLengthByOffset( packet, offset );
 
-        _checkControlLength( offset, packet->length );
-    }
+        auto key = &packet->values[offset+SIZE_UINT];
 
-    void Protocol::_checkCmdPushReplicaMessage( Packet *packet ) {
-        auto offset = 0;
+        if( l > MAX_KEY_LENGTH + 1 || l < 2 || strnlen( key, l ) != l-1 ) {
+            throw util::Error::WRONG_PARAM;
+        }
 
-        offset += _checkParamCmdUInt( packet, offset, 0 );
-        offset += _checkParamCmdUUID( packet, offset, 1 );
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
-        _checkControlLength( offset, packet->length );
+        return SIZE_UINT + l;
     }
 
-    void Protocol::_checkCmdPushSignalMessage( Packet *packet ) {
-        _checkCmdPushMessage( packet );
-    }
+    unsigned int Protocol::_checkParamCmdToken(
+        Packet *packet,
+        unsigned int offset,
+        unsigned int iterator
+    ) {
+        auto l = _getLengthByOffset( packet, offset );
 
-    void Protocol::_checkCmdRemoveMessageByUUID( Packet *packet ) {
-        auto offset = 0;
+        if( l != TOKEN_LENGTH ) {
+            throw util::Error::WRONG_PARAM;
+        }
 
-        offset += _checkParamCmdUUID( packet, offset, 0 );
+        packet->valuesOffsets[iterator] = offset + SIZE_UINT;
 
-        _checkControlLength( offset, packet->length );
+        return SIZE_UINT + l;
     }
 
-    void Protocol::_checkCmdPopMessage( Packet *packet ) {
-        auto offset = 0;
-
-        offset += _checkParamCmdUInt( packet, offset, 0 );
-
-        _checkControlLength( offset, packet->length );
+    void Protocol::_checkControlLength( unsigned int calculateLength, unsigned int length ) {
+        if( calculateLength != length ) {
+            throw util::Error::WRONG_CMD;
+        }
     }
 
-    void Protocol::_checkCmdClearQ( Packet *packet ) {
-        auto offset = 0;
-
-        offset += _checkParamCmdChannelName( packet, offset, 0 );
+    void Protocol::_checkBody( Packet *packet ) {
+        auto descriptor = _getDescriptor( packet->cmd );
 
-        _checkControlLength( offset, packet->length );
-    }
+        if( packet->valuesOffsets == nullptr ) {
+            packet->valuesOffsets = std::make_unique<unsigned int[]>( MAX_COUNT_VALUES );
+        }
 
-    unsigned int Protocol::_calculateCountValues( Packet *packet ) {
-        unsigned int length = packet->length;
         unsigned int offset = 0;
-        unsigned int count = 0;
-
-        while( true ) {
-            if( length - offset < SIZE_UINT + 1 ) throw util::Error::WRONG_CMD;
-
-            count++;
-
-            unsigned int l = 0;
-            memcpy( &l, &packet->values.get()[offset], SIZE_UINT );
 
-            l = ntohl( l );
-            if( l == 0 ) throw util::Error::WRONG_CMD;
-            offset += SIZE_UINT + l;
-
-            if( offset == length ) break;
-
-            if( offset > length ) throw util::Error::WRONG_CMD;
+        for( unsigned int i = 0; i < descriptor->countParams; i++ ) {
+            offset += descriptor->checkers[i]( packet, offset, i );
         }
 
-        return count;
-    }
-
-    void Protocol::_checkBody( Packet *packet ) {
-        packet->countValues = _calculateCountValues( packet );
+        _checkControlLength( offset, packet->length );
 
-        if( packet->countValues == 0 || packet->countValues > 16 ) {
-            throw util::Error::WRONG_CMD;
-        }
+        packet->countValues = descriptor->countParams;
 
-        packet->valuesOffsets = std::make_unique<unsigned int[]>( packet->countValues );
+        if( descriptor->positions[PARAM_MIN_MESSAGE_SIZE] != -1 ) {
+            util::types::ChannelLimitMessages limitMessages{};
+            getChannelLimitMessages( packet, limitMessages );
 
-        switch( packet->cmd ) {
-            case CMD_UPDATE_PASSWORD:
-                _checkCmdUpdatePassword( packet );
-                break;
-            case CMD_AUTH_GROUP:
-                _checkCmdAuthGroup( packet );
-                break;
-            case CMD_AUTH_CONSUMER:
-                _checkCmdAuthConsumer( packet );
-                break;
-            case CMD_AUTH_PRODUCER:
-                _checkCmdAuthProducer( packet );
-                break;
-                break;
-            case CMD_GET_CONSUMERS:
-            case CMD_GET_PRODUCERS:
-                _checkCmdGetUsers( packet );
-                break;
-                break;
-            case CMD_GET_CHANNEL_LIMIT_MESSSAGES:
-                _checkCmdGetChannelLimitMessages( packet );
-                break;
-            case CMD_ADD_CHANNEL:
-                _checkCmdAddChannel( packet );
-                break;
-            case CMD_UPDATE_CHANNEL_LIMIT_MESSAGES:
-                _checkCmdUpdateChannelLimitMessages( packet );
-                break;
-            case CMD_REMOVE_CHANNEL:
-                _checkCmdRemoveChannel( packet );
-                break;
-            case CMD_ADD_CONSUMER:
-                _checkCmdAddConsumer( packet );
-                break;
-            case CMD_ADD_PRODUCER:
-                _checkCmdAddProducer( packet );
-                break;
-            case CMD_UPDATE_CONSUMER_PASSWORD:
-                _checkCmdUpdateConsumerPassword( packet );
-                break;
-            case CMD_UPDATE_PRODUCER_PASSWORD:
-                _checkCmdUpdateProducerPassword( packet );
-                break;
-            case CMD_REMOVE_CONSUMER:
-                _checkCmdRemoveConsumer( packet );
-                break;
-            case CMD_REMOVE_PRODUCER:
-                _checkCmdRemoveProducer( packet );
-                break;
-            case CMD_PUSH_MESSAGE:
-                _checkCmdPushMessage( packet );
-                break;
-            case CMD_PUSH_REPLICA_MESSAGE:
-                _checkCmdPushReplicaMessage( packet );
-                break;
-            case CMD_PUSH_SIGNAL_MESSAGE:
-                _checkCmdPushSignalMessage( packet );
-                break;
-            case CMD_REMOVE_MESSAGE_BY_UUID:
-                _checkCmdRemoveMessageByUUID( packet );
-                break;
-            case CMD_POP_MESSAGE:
-                _checkCmdPopMessage( packet );
-                break;
-            case CMD_CLEAR_Q:
-                _checkCmdClearQ( packet );
-                break;
+            if( !util::Validation::isChannelLimitMessages( limitMessages ) ) {
+                throw util::Error::WRONG_CHANNEL_LIMIT_MESSAGES;
+            }
         }
     }
 
@@ -1029,298 +1093,269 @@ namespace simq::core::server {
     }
 
     bool Protocol::isOk( Packet *packet ) {
-        return packet->cmd == CMD_OK && packet->countValues == 0;
+        return _isCmd( packet, CMD_OK );
     }
 
     bool Protocol::isCheckSecure( Packet *packet ) {
-        return packet->cmd == CMD_CHECK_SECURE && packet->countValues == 0;
+        return _isCmd( packet, CMD_CHECK_SECURE );
     }
 
     bool Protocol::isCheckNoSecure( Packet *packet ) {
-        return packet->cmd == CMD_CHECK_NOSECURE && packet->countValues == 0;
+        return _isCmd( packet, CMD_CHECK_NOSECURE );
+    }
+
+    bool Protocol::isOpenMux( Packet *packet ) {
+        return _isCmd( packet, CMD_OPEN_MUX );
     }
 
     bool Protocol::isGetVersion( Packet *packet ) {
-        return packet->cmd == CMD_GET_VERSION && packet->countValues == 0;
+        return _isCmd( packet, CMD_GET_VERSION );
     }
 
     bool Protocol::isUpdatePassword( Packet *packet ) {
-        return packet->cmd == CMD_UPDATE_PASSWORD && packet->countValues == 2;
+        return _isCmd( packet, CMD_UPDATE_PASSWORD );
     }
 
     bool Protocol::isGetChannels( Packet *packet ) {
-        return packet->cmd == CMD_GET_CHANNELS && packet->countValues == 0;
+        return _isCmd( packet, CMD_GET_CHANNELS );
     }
 
     bool Protocol::isGetChannelLimitMessages( Packet *packet ) {
-        return packet->cmd == CMD_GET_CHANNEL_LIMIT_MESSSAGES && packet->countValues == 1;
+        return _isCmd( packet, CMD_GET_CHANNEL_LIMIT_MESSSAGES );
     }
 
     bool Protocol::isGetConsumers( Packet *packet ) {
-        return packet->cmd == CMD_GET_CONSUMERS && packet->countValues == 1;
+        return _isCmd( packet, CMD_GET_CONSUMERS );
     }
 
     bool Protocol::isGetProducers( Packet *packet ) {
-        return packet->cmd == CMD_GET_PRODUCERS && packet->countValues == 1;
+        return _isCmd( packet, CMD_GET_PRODUCERS );
     }
 
     bool Protocol::isAuthGroup( Packet *packet ) {
-        return packet->cmd == CMD_AUTH_GROUP && packet->countValues == 2;
+        return _isCmd( packet, CMD_AUTH_GROUP );
     }
 
     bool Protocol::isAuthConsumer( Packet *packet ) {
-        return packet->cmd == CMD_AUTH_CONSUMER && packet->countValues == 4;
+        return _isCmd( packet, CMD_AUTH_CONSUMER );
     }
 
     bool Protocol::isAuthProducer( Packet *packet ) {
-        return packet->cmd == CMD_AUTH_PRODUCER && packet->countValues == 4;
+        return _isCmd( packet, CMD_AUTH_PRODUCER );
+    }
+
+    bool Protocol::isResume( Packet *packet ) {
+        return _isCmd( packet, CMD_RESUME );
+    }
+
+    bool Protocol::isGetToken( Packet *packet ) {
+        return _isCmd( packet, CMD_GET_TOKEN );
     }
 
     bool Protocol::isAddChannel( Packet *packet ) {
-        return packet->cmd == CMD_ADD_CHANNEL && packet->countValues == 5;
+        return _isCmd( packet, CMD_ADD_CHANNEL );
     }
 
     bool Protocol::isUpdateChannelLimitMessages( Packet *packet ) {
-        return packet->cmd == CMD_UPDATE_CHANNEL_LIMIT_MESSAGES && packet->countValues == 5;
+        return _isCmd( packet, CMD_UPDATE_CHANNEL_LIMIT_MESSAGES );
     }
 
     bool Protocol::isRemoveChannel( Packet *packet ) {
-        return packet->cmd == CMD_REMOVE_CHANNEL && packet->countValues == 1;
+        return _isCmd( packet, CMD_REMOVE_CHANNEL );
     }
 
     bool Protocol::isAddConsumer( Packet *packet ) {
-        return packet->cmd == CMD_ADD_CONSUMER && packet->countValues == 3;
+        return _isCmd( packet, CMD_ADD_CONSUMER );
     }
 
     bool Protocol::isUpdateConsumerPassword( Packet *packet ) {
-        return packet->cmd == CMD_UPDATE_CONSUMER_PASSWORD && packet->countValues == 3;
+        return _isCmd( packet, CMD_UPDATE_CONSUMER_PASSWORD );
     }
 
     bool Protocol::isRemoveConsumer( Packet *packet ) {
-        return packet->cmd == CMD_REMOVE_CONSUMER && packet->countValues == 2;
+        return _isCmd( packet, CMD_REMOVE_CONSUMER );
     }
 
     bool Protocol::isAddProducer( Packet *packet ) {
-        return packet->cmd == CMD_ADD_PRODUCER && packet->countValues == 3;
+        return _isCmd( packet, CMD_ADD_PRODUCER );
     }
 
     bool Protocol::isUpdateProducerPassword( Packet *packet ) {
-        return packet->cmd == CMD_UPDATE_PRODUCER_PASSWORD && packet->countValues == 3;
+        return _isCmd( packet, CMD_UPDATE_PRODUCER_PASSWORD );
     }
 
     bool Protocol::isRemoveProducer( Packet *packet ) {
-        return packet->cmd == CMD_REMOVE_PRODUCER && packet->countValues == 2;
+        return _isCmd( packet, CMD_REMOVE_PRODUCER );
     }
 
     bool Protocol::isPopMessage( Packet *packet ) {
-        return packet->cmd == CMD_POP_MESSAGE && packet->countValues == 1;
+        return _isCmd( packet, CMD_POP_MESSAGE );
     }
 
     bool Protocol::isGetPartMessage( Packet *packet ) {
-        return packet->cmd == CMD_GET_PART_MESSAGE && packet->countValues == 0;
+        return _isCmd( packet, CMD_GET_PART_MESSAGE );
     }
 
     bool Protocol::isPushMessage( Packet *packet ) {
-        return packet->cmd == CMD_PUSH_MESSAGE && packet->countValues == 1;
+        return _isCmd( packet, CMD_PUSH_MESSAGE );
     }
 
     bool Protocol::isPushSignalMessage( Packet *packet ) {
-        return packet->cmd == CMD_PUSH_SIGNAL_MESSAGE && packet->countValues == 1;
+        return _isCmd( packet, CMD_PUSH_SIGNAL_MESSAGE );
     }
 
     bool Protocol::isPushReplicaMessage( Packet *packet ) {
-        return packet->cmd == CMD_PUSH_REPLICA_MESSAGE && packet->countValues == 2;
+        return _isCmd( packet, CMD_PUSH_REPLICA_MESSAGE );
+    }
+
+    bool Protocol::isSetPrefetch( Packet *packet ) {
+        return _isCmd( packet, CMD_SET_PREFETCH );
+    }
+
+    bool Protocol::isAckMessage( Packet *packet ) {
+        return _isCmd( packet, CMD_ACK_MESSAGE );
+    }
+
+    bool Protocol::isAckMessages( Packet *packet ) {
+        return _isCmd( packet, CMD_ACK_MESSAGES );
+    }
+
+    bool Protocol::isRemoveMessages( Packet *packet ) {
+        return _isCmd( packet, CMD_REMOVE_MESSAGES );
+    }
+
+    bool Protocol::isSubscribe( Packet *packet ) {
+        return _isCmd( packet, CMD_SUBSCRIBE );
+    }
+
+    bool Protocol::isCredit( Packet *packet ) {
+        return _isCmd( packet, CMD_CREDIT );
+    }
+
+    bool Protocol::isAttachChannel( Packet *packet ) {
+        return _isCmd( packet, CMD_ATTACH_CHANNEL );
+    }
+
+    bool Protocol::isPushKeyedMessage( Packet *packet ) {
+        return _isCmd( packet, CMD_PUSH_KEYED_MESSAGE );
+    }
+
+    bool Protocol::isOpenRing( Packet *packet ) {
+        return _isCmd( packet, CMD_OPEN_RING );
     }
 
     bool Protocol::isRemoveMessage( Packet *packet ) {
-        return packet->cmd == CMD_REMOVE_MESSAGE && packet->countValues == 0;
+        return _isCmd( packet, CMD_REMOVE_MESSAGE );
     }
 
     bool Protocol::isRemoveMessageByUUID( Packet *packet ) {
-        return packet->cmd == CMD_REMOVE_MESSAGE_BY_UUID && packet->countValues == 1;
+        return _isCmd( packet, CMD_REMOVE_MESSAGE_BY_UUID );
     }
 
     bool Protocol::isClearQ( Packet *packet ) {
-        return packet->cmd == CMD_CLEAR_Q && packet->countValues == 1;
+        return _isCmd( packet, CMD_CLEAR_Q );
     }
 
-    const char *Protocol::getGroup( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isAuthGroup( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isAuthConsumer( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isAuthProducer( packet ) ) {
-            return &values[offsets[0]];
+    bool Protocol::_isCmd( Packet *packet, Cmd cmd ) {
+        return packet->cmd == cmd && packet->countValues == _getDescriptor( cmd )->countParams;
+    }
+
+    const char *Protocol::_getValue( Packet *packet, Param param ) {
+        auto descriptor = _getDescriptor( packet->cmd );
+
+        if(
+            descriptor == nullptr
+            || descriptor->countParams != packet->countValues
+            || descriptor->positions[param] == -1
+        ) {
+            throw util::Error::WRONG_CMD;
         }
 
-        throw util::Error::WRONG_CMD;
+        return &packet->values[packet->valuesOffsets[descriptor->positions[param]]];
     }
 
-    const char *Protocol::getChannel( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isAuthGroup( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isAuthConsumer( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isAuthProducer( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isGetConsumers( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isGetProducers( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isAddChannel( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isUpdateChannelLimitMessages( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isRemoveChannel( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isAddConsumer( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isUpdateConsumerPassword( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isRemoveConsumer( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isAddProducer( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isUpdateProducerPassword( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isRemoveProducer( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isGetChannelLimitMessages( packet ) ) {
-            return &values[offsets[0]];
-        } else if( isClearQ( packet ) ) {
-            return &values[offsets[0]];
-        }
+    unsigned int Protocol::_getUInt( Packet *packet, Param param ) {
+        unsigned int value = 0;
+        _demarsh( _getValue( packet, param ), value );
 
-        throw util::Error::WRONG_CMD;
+        return value;
     }
 
-    const char *Protocol::getConsumer( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isAuthConsumer( packet ) ) {
-            return &values[offsets[2]];
-        } else if( isAddConsumer( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isUpdateConsumerPassword( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isRemoveConsumer( packet ) ) {
-            return &values[offsets[1]];
-        }
+    const char *Protocol::getGroup( Packet *packet ) {
+        return _getValue( packet, PARAM_GROUP );
+    }
 
-        throw util::Error::WRONG_CMD;
+    const char *Protocol::getChannel( Packet *packet ) {
+        return _getValue( packet, PARAM_CHANNEL );
     }
 
-    const char *Protocol::getProducer( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isAuthProducer( packet ) ) {
-            return &values[offsets[2]];
-        } else if( isAddProducer( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isUpdateProducerPassword( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isRemoveProducer( packet ) ) {
-            return &values[offsets[1]];
-        }
+    const char *Protocol::getConsumer( Packet *packet ) {
+        return _getValue( packet, PARAM_CONSUMER );
+    }
 
-        throw util::Error::WRONG_CMD;
+    const char *Protocol::getProducer( Packet *packet ) {
+        return _getValue( packet, PARAM_PRODUCER );
     }
 
     const unsigned char *Protocol::getPassword( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isAuthGroup( packet ) ) {
-            return (const unsigned char *)&values[offsets[1]];
-        } else if( isAuthConsumer( packet ) ) {
-            return (const unsigned char *)&values[offsets[3]];
-        } else if( isAuthProducer( packet ) ) {
-            return (const unsigned char *)&values[offsets[3]];
-        } else if( isUpdatePassword( packet ) ) {
-            return (const unsigned char *)&values[offsets[0]];
-        } else if( isAddConsumer( packet ) ) {
-            return (const unsigned char *)&values[offsets[2]];
-        } else if( isAddProducer( packet ) ) {
-            return (const unsigned char *)&values[offsets[2]];
-        } else if( isUpdateConsumerPassword( packet ) ) {
-            return (const unsigned char *)&values[offsets[2]];
-        } else if( isUpdateProducerPassword( packet ) ) {
-            return (const unsigned char *)&values[offsets[2]];
-        }
-        throw util::Error::WRONG_CMD;
+        return ( const unsigned char * )_getValue( packet, PARAM_PASSWORD );
     }
 
     const unsigned char *Protocol::getNewPassword( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isUpdatePassword( packet ) ) {
-            return (const unsigned char *)&values[offsets[1]];
-        }
+        return ( const unsigned char * )_getValue( packet, PARAM_NEW_PASSWORD );
+    }
 
-        throw util::Error::WRONG_CMD;
+    const unsigned char *Protocol::getToken( Packet *packet ) {
+        return ( const unsigned char * )_getValue( packet, PARAM_TOKEN );
     }
 
     unsigned int Protocol::getLength( Packet *packet ) {
-        if( isPushMessage( packet ) || isPushSignalMessage( packet ) || isPushReplicaMessage ( packet ) ) {
-            unsigned int value = 0;
-            _demarsh( &packet->values[packet->valuesOffsets[0]], value );
-
-            return value;
-        }
-
-        throw util::Error::WRONG_CMD;
+        return _getUInt( packet, PARAM_LENGTH );
     }
 
     unsigned int Protocol::getDelay( Packet *packet ) {
-        if( isPopMessage( packet ) ) {
-            unsigned int value = 0;
-            _demarsh( &packet->values[packet->valuesOffsets[0]], value );
+        return _getUInt( packet, PARAM_DELAY );
+    }
 
-            return value;
-        }
+    unsigned int Protocol::getPrefetch( Packet *packet ) {
+        return _getUInt( packet, PARAM_PREFETCH );
+    }
+
+    unsigned int Protocol::getTag( Packet *packet ) {
+        return _getUInt( packet, PARAM_TAG );
+    }
 
-        throw util::Error::WRONG_CMD;
+    unsigned int Protocol::getCredits( Packet *packet ) {
+        return _getUInt( packet, PARAM_CREDITS );
     }
 
     const char *Protocol::getUUID( Packet *packet ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
+        return _getValue( packet, PARAM_UUID );
+    }
+
+    void Protocol::getUUIDs( Packet *packet, std::vector<const char *> &uuids ) {
+        auto values = _getValue( packet, PARAM_UUIDS );
+
+        unsigned int l = 0;
+        _demarsh( values - SIZE_UINT, l );
 
-        if( isPushReplicaMessage( packet ) ) {
-            return &values[offsets[1]];
-        } else if( isRemoveMessageByUUID( packet ) ) {
-            return &values[offsets[0]];
+        for( unsigned int i = 0; i < l; i += util::UUID::LENGTH + 1 ) {
+            uuids.push_back( &values[i] );
         }
+    }
 
-        throw util::Error::WRONG_CMD;
+    const char *Protocol::getKey( Packet *packet ) {
+        return _getValue( packet, PARAM_KEY );
     }
 
     void Protocol::getChannelLimitMessages(
         Packet *packet,
         util::types::ChannelLimitMessages &limitMessages
     ) {
-        auto values = packet->values.get();
-        auto offsets = packet->valuesOffsets.get();
-
-        if( isUpdateChannelLimitMessages( packet ) || isAddChannel( packet ) ) {
-            _demarsh( &values[offsets[1]], limitMessages.minMessageSize );
-            _demarsh( &values[offsets[2]], limitMessages.maxMessageSize );
-            _demarsh( &values[offsets[3]], limitMessages.maxMessagesInMemory );
-            _demarsh( &values[offsets[4]], limitMessages.maxMessagesOnDisk );
-
-            return;
-        }
-
-        throw util::Error::WRONG_CMD;
+        limitMessages.minMessageSize = _getUInt( packet, PARAM_MIN_MESSAGE_SIZE );
+        limitMessages.maxMessageSize = _getUInt( packet, PARAM_MAX_MESSAGE_SIZE );
+        limitMessages.maxMessagesInMemory = _getUInt( packet, PARAM_MAX_MESSAGES_IN_MEMORY );
+        limitMessages.maxMessagesOnDisk = _getUInt( packet, PARAM_MAX_MESSAGES_ON_DISK );
     }
 
     bool Protocol::isFull( BasePacket *packet ) {
@@ -2,6 +2,7 @@
 #define SIMQ_CORE_SERVER_Q_BUFFER
 
 #include <map>
+#include <algorithm>
 #include <list>
 #include <vector>
 #include <mutex>
@@ -14,13 +15,14 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
-#include <sys/sendfile.h>
 #include <memory>
+#include <string.h>
 #include "../../../util/file.hpp"
 #include "../../../util/messages.hpp"
 #include "../../../util/error.h"
 #include "../../../util/constants.h"
-#include "../../../util/lock_atomic.hpp"
+#include "../../../util/rw_lock.hpp"
+#include "../../../util/io.hpp"
 
 namespace simq::core::server::q {
     class Buffer {
@@ -41,8 +43,7 @@ namespace simq::core::server::q {
             unsigned int _fileFD = 0;
 
 
-            std::shared_timed_mutex _mItems;
-            std::atomic_uint _countItemsWrited {0};
+            util::RWLock _mItems;
             std::vector<std::unique_ptr<Item>> _items;
 
             std::list<unsigned int> _freeIDs;
@@ -58,7 +59,6 @@ namespace simq::core::server::q {
             void _initFileSize();
             void _expandItems();
             void _expandFile();
-            void _wait( std::atomic_uint &atom );
 
             unsigned int _getOffsetPage( unsigned int length );
             unsigned int _getOffsetInnerPage( unsigned int length, unsigned int offsetPage );
@@ -71,11 +71,16 @@ namespace simq::core::server::q {
             unsigned int _checkRSLength( int length );
             unsigned int _calculateCountPages( unsigned int length );
 
+            void _reservePage( Item *item, unsigned int offsetPage );
             unsigned int _recv( char *data, unsigned int recvLength, unsigned int fd );
             unsigned int _recvToBuffer( Item *item, unsigned int fd );
             unsigned int _recvToFile( Item *item, unsigned int fd );
             unsigned int _sendFromBuffer( Item *item, unsigned int fd, unsigned int offset );
             unsigned int _sendFromFile( Item *item, unsigned int fd, unsigned int offset );
+            unsigned int _writeToBuffer( Item *item, const char *data, unsigned int length );
+            unsigned int _writeToFile( Item *item, const char *data, unsigned int length );
+            unsigned int _readFromBuffer( Item *item, char *data, unsigned int length, unsigned int offset );
+            unsigned int _readFromFile( Item *item, char *data, unsigned int length, unsigned int offset );
 
             Item *_getItem( unsigned int id );
         public:
@@ -85,12 +90,8 @@ namespace simq::core::server::q {
             unsigned int allocateOnDisk( unsigned int length );
             void free( unsigned int id );
 
-            void write(
-                unsigned int id,
-                const char *data,
-                unsigned int length,
-                unsigned int offsetPage
-            );
+            unsigned int write( unsigned int id, const char *data, unsigned int length );
+            unsigned int read( unsigned int id, char *data, unsigned int length, unsigned int offset );
 
             unsigned int recv( unsigned int id, unsigned int fd );
             unsigned int send( unsigned int id, unsigned int fd, unsigned int offset );
@@ -109,12 +110,6 @@ namespace simq::core::server::q {
         _expandItems();
     }
 
-    void Buffer::_wait( std::atomic_uint &atom ) {
-        while( atom ) {
-            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
-        }
-    }
-
     unsigned int Buffer::_checkRSLength( int length ) {
         if( length == -1 ) {
             if( errno != EAGAIN ) {
@@ -151,8 +146,7 @@ namespace simq::core::server::q {
     }
 
     unsigned int Buffer::allocateOnDisk( unsigned int length ) {
-        util::LockAtomic lockAtomicGroup( _countItemsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockItems( _mItems );
+        std::lock_guard<util::RWLock> lockItems( _mItems );
 
         auto id = _getUniqID();
 
@@ -165,8 +159,7 @@ namespace simq::core::server::q {
     }
 
     unsigned int Buffer::allocate( unsigned int length ) {
-        util::LockAtomic lockAtomicGroup( _countItemsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockItems( _mItems );
+        std::lock_guard<util::RWLock> lockItems( _mItems );
 
         auto id = _getUniqID();
 
@@ -187,8 +180,7 @@ namespace simq::core::server::q {
     }
 
     unsigned int Buffer::getLength( unsigned int id ) {
-        _wait( _countItemsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockItems( _mItems );
+        std::shared_lock<util::RWLock> lockItems( _mItems );
 
         auto item = _getItem( id );
 
@@ -200,8 +192,7 @@ namespace simq::core::server::q {
     }
 
     void Buffer::free( unsigned int id ) {
-        util::LockAtomic lockAtomicGroup( _countItemsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockItems( _mItems );
+        std::lock_guard<util::RWLock> lockItems( _mItems );
 
         auto item = _getItem( id );
         
@@ -225,26 +216,45 @@ namespace simq::core::server::q {
     }
 
     unsigned int Buffer::_recv( char *data, unsigned int recvLength, unsigned int fd ) {
-        auto length = ::recv( fd, data, recvLength, MSG_NOSIGNAL );
+        auto length = util::IO::recv( fd, data, recvLength );
 
         return _checkRSLength( length );
     }
 
-    unsigned int Buffer::_recvToBuffer( Item *item, unsigned int fd ) {
-        auto recvLength = util::Messages::getResiduePart( item->length, item->recvLength );
-
-        auto offsetPage = _getOffsetPage( item->recvLength );
-        auto offsetInnerPage = _getOffsetInnerPage( item->recvLength, offsetPage );
+    // a page is taken when the first byte of it is received
+    void Buffer::_reservePage( Item *item, unsigned int offsetPage ) {
+        if( item->recvLength % MESSAGE_PACKET_SIZE != 0 ) {
+            return;
+        }
 
-        if( item->recvLength % MESSAGE_PACKET_SIZE == 0 ) {
+        if( item->buffer.get() ) {
             auto residue = util::Messages::getResiduePart( item->length, item->recvLength );
             if( residue > MESSAGE_PACKET_SIZE ) {
                 item->buffer[offsetPage] = std::make_unique<char[]>( MESSAGE_PACKET_SIZE );
             } else {
                 item->buffer[offsetPage] = std::make_unique<char[]>( residue );
             }
+            return;
+        }
+
+        std::lock_guard<std::mutex> lockFile( _mFile );
+
+        if( _freeFileOffsets.empty() ) {
+            _expandFile();
         }
 
+        item->fileOffsets[offsetPage] = _freeFileOffsets.front();
+        _freeFileOffsets.pop_front();
+    }
+
+    unsigned int Buffer::_recvToBuffer( Item *item, unsigned int fd ) {
+        auto recvLength = util::Messages::getResiduePart( item->length, item->recvLength );
+
+        auto offsetPage = _getOffsetPage( item->recvLength );
+        auto offsetInnerPage = _getOffsetInnerPage( item->recvLength, offsetPage );
+
+        _reservePage( item, offsetPage );
+
         auto data = &item->buffer[offsetPage][offsetInnerPage];
 
         auto length = _recv( data, recvLength, fd );
@@ -259,16 +269,7 @@ namespace simq::core::server::q {
         auto offsetPage = _getOffsetPage( item->recvLength );
         auto offsetInnerPage = _getOffsetInnerPage( item->recvLength, offsetPage );
 
-        if( item->recvLength % MESSAGE_PACKET_SIZE == 0 ) {
-            std::lock_guard<std::mutex> lockFile( _mFile );
-
-            if( _freeFileOffsets.empty() ) {
-                _expandFile();
-            }
-
-            item->fileOffsets[offsetPage] = _freeFileOffsets.front();
-            _freeFileOffsets.pop_front();
-        }
+        _reservePage( item, offsetPage );
 
         char data[MESSAGE_PACKET_SIZE];
 
@@ -298,7 +299,7 @@ namespace simq::core::server::q {
         auto offsetInnerPage = _getOffsetInnerPage( offset, offsetPage );
 
         auto data = &item->buffer[offsetPage][offsetInnerPage];
-        auto length = ::send( fd, data, sendLength, MSG_NOSIGNAL );
+        auto length = util::IO::send( fd, data, sendLength );
 
         return _checkRSLength( length );
     }
@@ -310,15 +311,112 @@ namespace simq::core::server::q {
         auto offsetInnerPage = _getOffsetInnerPage( offset, offsetPage );
         auto fileOffset = _getOffsetFile( item, offsetPage, offsetInnerPage );
 
-        auto length = ::sendfile( fd, _fileFD, (long *)&fileOffset, sendLength );
+        auto length = util::IO::sendFile( fd, _fileFD, fileOffset, sendLength );
 
         return _checkRSLength( length );
     }
 
+    unsigned int Buffer::_writeToBuffer( Item *item, const char *data, unsigned int length ) {
+        auto offsetPage = _getOffsetPage( item->recvLength );
+        auto offsetInnerPage = _getOffsetInnerPage( item->recvLength, offsetPage );
+        auto writeLength = std::min( length, util::Messages::getResiduePart( item->length, item->recvLength ) );
+
+        _reservePage( item, offsetPage );
+
+        memcpy( &item->buffer[offsetPage][offsetInnerPage], data, writeLength );
+        item->recvLength += writeLength;
+
+        return writeLength;
+    }
+
+    unsigned int Buffer::_writeToFile( Item *item, const char *data, unsigned int length ) {
+        auto offsetPage = _getOffsetPage( item->recvLength );
+        auto offsetInnerPage = _getOffsetInnerPage( item->recvLength, offsetPage );
+        auto writeLength = std::min( length, util::Messages::getResiduePart( item->length, item->recvLength ) );
+
+        _reservePage( item, offsetPage );
+
+        _file->write(
+            ( void * )data,
+            writeLength,
+            _getOffsetFile( item, offsetPage, offsetInnerPage )
+        );
+        item->recvLength += writeLength;
+
+        return writeLength;
+    }
+
+    // copies a body that is already in memory, page by page as recv does
+    unsigned int Buffer::write( unsigned int id, const char *data, unsigned int length ) {
+        std::shared_lock<util::RWLock> lockItems( _mItems );
+
+        auto item = _getItem( id );
+
+        if( item == nullptr ) {
+            return 0;
+        }
+
+        unsigned int written = 0;
+
+        while( written < length && item->recvLength < item->length ) {
+            if( item->buffer.get() ) {
+                written += _writeToBuffer( item, &data[written], length - written );
+            } else {
+                written += _writeToFile( item, &data[written], length - written );
+            }
+        }
+
+        return written;
+    }
+
+    unsigned int Buffer::_readFromBuffer( Item *item, char *data, unsigned int length, unsigned int offset ) {
+        auto offsetPage = _getOffsetPage( offset );
+        auto offsetInnerPage = _getOffsetInnerPage( offset, offsetPage );
+        auto readLength = std::min( length, util::Messages::getResiduePart( item->length, offset ) );
+
+        memcpy( data, &item->buffer[offsetPage][offsetInnerPage], readLength );
+
+        return readLength;
+    }
+
+    unsigned int Buffer::_readFromFile( Item *item, char *data, unsigned int length, unsigned int offset ) {
+        auto offsetPage = _getOffsetPage( offset );
+        auto offsetInnerPage = _getOffsetInnerPage( offset, offsetPage );
+        auto readLength = std::min( length, util::Messages::getResiduePart( item->length, offset ) );
+
+        auto l = ::pread( _fileFD, data, readLength, _getOffsetFile( item, offsetPage, offsetInnerPage ) );
+        if( l != ( ssize_t )readLength ) {
+            throw util::Error::FS_ERROR;
+        }
+
+        return readLength;
+    }
+
+    // copies a received body out, page by page as send does
+    unsigned int Buffer::read( unsigned int id, char *data, unsigned int length, unsigned int offset ) {
+        std::shared_lock<util::RWLock> lockItems( _mItems );
+
+        auto item = _getItem( id );
+
+        if( item == nullptr ) {
+            return 0;
+        }
+
+        unsigned int done = 0;
+
+        while( done < length && offset + done < item->recvLength ) {
+            if( item->buffer.get() ) {
+                done += _readFromBuffer( item, &data[done], length - done, offset + done );
+            } else {
+                done += _readFromFile( item, &data[done], length - done, offset + done );
+            }
+        }
+
+        return done;
+    }
 
     unsigned int Buffer::recv( unsigned int id, unsigned int fd ) {
-        _wait( _countItemsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockItems( _mItems );
+        std::shared_lock<util::RWLock> lockItems( _mItems );
 
         auto item = _getItem( id );
 
@@ -334,8 +432,7 @@ namespace simq::core::server::q {
     }
 
     unsigned int Buffer::send( unsigned int id, unsigned int fd, unsigned int offset ) {
-        _wait( _countItemsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockItems( _mItems );
+        std::shared_lock<util::RWLock> lockItems( _mItems );
 
         auto item = _getItem( id );
 
@@ -425,8 +522,7 @@ namespace simq::core::server::q {
     }
 
     void Buffer::clear() {
-        util::LockAtomic lockAtomicGroup( _countItemsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockItems( _mItems );
+        std::lock_guard<util::RWLock> lockItems( _mItems );
 
         std::lock_guard<std::mutex> lockFile( _mFile );
 
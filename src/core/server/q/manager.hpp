@@ -6,62 +6,156 @@
 #include <map>
 #include <string>
 #include <string.h>
+#include <deque>
 #include <list>
+#include <vector>
+#include <unordered_map>
 #include <atomic>
 #include <iterator>
 #include <algorithm>
 #include <memory>
-#include "../../../util/lock_atomic.hpp"
+#include <sys/eventfd.h>
+#include "../../../util/rw_lock.hpp"
 #include "../../../util/error.h"
 #include "../../../util/types.h"
 #include "../../../util/uuid.hpp"
+#include "../../../util/snapshot.hpp"
+#include "../../../util/segmented_queue.hpp"
 #include "messages.hpp"
 
 namespace simq::core::server::q {
     class Manager {
         private:
+            struct Consumer {
+                // signal messages waiting for this consumer, a list
+                // since an empty deque already holds a block
+                std::list<unsigned int> signals;
+                std::atomic_uint countSignals{0};
+
+                // shard to start the next pop from
+                unsigned int nextShard = 0;
+
+                // eventfd of the worker serving a subscribed consumer, -1 if it polls
+                std::atomic_int notifyFD{-1};
+                std::atomic_bool isNotified{false};
+            };
+
+            // At most one message of a key is in flight, the others wait
+            // here in push order until the holder is acked or removed
+            struct OrderingKey {
+                unsigned long holder = 0;
+                std::deque<unsigned long> waiting;
+            };
+
+            // Part of a channel with its own messages, data file and queue.
+            // Message ids are localID * countShards + index of the shard
+            struct Shard {
+                std::unique_ptr<Messages> messages;
+
+                // tokens of queued messages, see Messages::enqueue
+                util::SegmentedQueue QList;
+
+                // reverted messages are delivered before QList
+                std::mutex mRedelivery;
+                std::atomic_uint countRedelivery{0};
+                std::deque<unsigned long> redelivery;
+
+                // ordering keys with a message in flight, see _holdKey
+                std::mutex mKeys;
+                std::unordered_map<unsigned long, OrderingKey> keys;
+
+                Shard( util::Epoch &epoch ) : QList{epoch} {};
+            };
+
             struct Channel {
-                std::shared_timed_mutex mConsumers;
-                std::shared_timed_mutex mProducers;
-                std::atomic_uint countConsumersWrited;
-                std::atomic_uint countProducersWrited;
-                // public messages
-                std::map<unsigned int, std::list<unsigned int>> consumers;
+                // 0 after the channel was removed
+                std::atomic_uint epoch;
+
+                util::RWLock mConsumers;
+                util::RWLock mProducers;
+                std::unordered_map<unsigned int, std::unique_ptr<Consumer>> consumers;
                 std::map<unsigned int, bool> producers;
 
-                std::unique_ptr<Messages> messages;
+                std::vector<std::unique_ptr<Shard>> shards;
+                std::atomic_uint nextProducerShard{0};
+
+                std::atomic_uint countSubscribers{0};
 
-                std::shared_timed_mutex mQList;
-                std::atomic_uint countQListWrited;
-                std::list<unsigned int> QList;
+                util::RWLock mSignals;
                 std::map<unsigned int, unsigned int> signals;
             };
 
+        public:
+            // Resolved once when a consumer or producer joins a channel,
+            // so the data plane doesn't look the group and channel up by name
+            class ChannelHandle {
+                friend Manager;
+
+                private:
+                    std::shared_ptr<Channel> _channel;
+                    Consumer *_consumer = nullptr;
+                    bool _isProducer = false;
+                    unsigned int _shard = 0;
+                    unsigned int _epoch = 0;
+
+                public:
+                    bool isEmpty() const;
+                    unsigned int getChannelID() const;
+            };
+
+        private:
             struct Group {
-                std::shared_timed_mutex mChannels;
-                std::atomic_uint countChannelsWrited;
-                std::map<std::string, std::unique_ptr<Channel>> channels;
+                std::map<std::string, std::shared_ptr<Channel>> channels;
             };
 
-            std::shared_timed_mutex _mGroups;
-            std::atomic_uint _countGroupsWrited{0};
+            // replaced as a whole on admin changes, read without locks
+            struct Directory {
+                std::map<std::string, std::shared_ptr<const Group>> groups;
+            };
+
+            // reclaims the segments of every QList, declared before the channels
+            // so it outlives them
+            util::Epoch _queuesEpoch;
+
+            util::Snapshot<Directory> _directory;
 
-            std::map<std::string, std::unique_ptr<Group>> _groups;
+            std::atomic_uint _epoch{0};
 
-            void _wait( std::atomic_uint &atom );
 
-            bool _isConsumer( std::map<unsigned int, std::list<unsigned int>> &map, unsigned int fd );
-            bool _isProducer( std::map<unsigned int, bool> &map, unsigned int fd );
+            std::shared_ptr<Channel> _findChannel( const char *groupName, const char *channelName );
+            Channel *_getChannel( ChannelHandle &handle );
+            Channel *_getChannelOrThrow( ChannelHandle &handle );
+            void _expireChannel( Channel *channel );
+
+            static void _getShardLimits(
+                util::types::ChannelLimitMessages &limitMessages,
+                unsigned int countShards,
+                util::types::ChannelLimitMessages &shardLimitMessages
+            );
+            Shard *_getShard( Channel *channel, unsigned int id );
+            unsigned int _toLocalID( Channel *channel, unsigned int id );
+            unsigned int _toID( Channel *channel, unsigned int shard, unsigned int localID );
+            bool _popToken( Shard *shard, unsigned long &token );
 
-            void _checkConsumer( std::map<unsigned int, std::list<unsigned int>> &map, unsigned int fd );
-            void _checkProducer( std::map<unsigned int, bool> &map, unsigned int fd );
+            static unsigned long _hashKey( const char *key );
+            bool _holdKey( Shard *shard, unsigned long token, unsigned int localID );
+            bool _releaseKey( Shard *shard, unsigned long key, unsigned long token );
+
+            template<typename F>
+            unsigned int _addToShard( Channel *channel, ChannelHandle &handle, F add );
+
+            void _notifySubscribers( Channel *channel );
+
+            void _checkConsumer( ChannelHandle &handle );
+            void _checkProducer( ChannelHandle &handle );
         public:
             void addGroup( const char *groupName );
             void addChannel(
                 const char *groupName,
                 const char *channelName,
                 const char *path,
-                util::types::ChannelLimitMessages &limitMessages
+                util::types::ChannelLimitMessages &limitMessages,
+                unsigned int countShards = 1
             );
             void updateChannelLimitMessages(
                 const char *groupName,
@@ -71,78 +165,79 @@ namespace simq::core::server::q {
             void removeGroup( const char *groupName );
             void removeChannel( const char *groupName, const char *channelName );
 
-            void joinConsumer( const char *groupName, const char *channelName, unsigned int fd );
-            void leaveConsumer( const char *groupName, const char *channelName, unsigned int fd );
-            void joinProducer( const char *groupName, const char *channelName, unsigned int fd );
-            void leaveProducer( const char *groupName, const char *channelName, unsigned int fd );
+            ChannelHandle joinConsumer( const char *groupName, const char *channelName, unsigned int fd );
+            void leaveConsumer( ChannelHandle &handle, unsigned int fd );
+            void subscribeConsumer( ChannelHandle &handle, int notifyFD );
+            ChannelHandle joinProducer( const char *groupName, const char *channelName, unsigned int fd );
+            void leaveProducer( ChannelHandle &handle, unsigned int fd );
 
             unsigned int createMessageForQ(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int length,
-                char *uuid
+                char *uuid,
+                const char *key = nullptr
             );
 
             unsigned int createMessageForBroadcast(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int length
             );
 
             unsigned int createMessageForReplication(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int length,
                 const char *uuid
             );
 
             void removeMessage(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int id
             );
             void removeMessage(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 const char *uuid
             );
+            void removeMessages(
+                ChannelHandle &handle,
+                std::vector<const char *> &uuids
+            );
 
             unsigned int recv(
-                const char *groupName,
-                const char *channelName,
+                ChannelHandle &handle,
                 unsigned int fd,
                 unsigned int id
             );
             unsigned int send(
-                const char *groupName,
-                const char *channelName,
+                ChannelHandle &handle,
                 unsigned int fd,
                 unsigned int id,
                 unsigned int offset
             );
+            unsigned int write(
+                ChannelHandle &handle,
+                unsigned int id,
+                const char *data,
+                unsigned int length
+            );
+            unsigned int read(
+                ChannelHandle &handle,
+                unsigned int id,
+                char *data,
+                unsigned int length,
+                unsigned int offset
+            );
 
             void pushMessage(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int id
             );
             unsigned int popMessage(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int &length,
                 char *uuid
             );
             void revertMessage(
-                const char *groupName,
-                const char *channelName,
-                unsigned int fd,
+                ChannelHandle &handle,
                 unsigned int id
             );
 
@@ -152,53 +247,80 @@ namespace simq::core::server::q {
             );
     };
 
-    void Manager::_wait( std::atomic_uint &atom ) {
-        while( atom );
+    bool Manager::ChannelHandle::isEmpty() const {
+        return _channel == nullptr;
     }
 
-    void Manager::addGroup( const char *groupName ) {
-        util::LockAtomic lockAtomic( _countGroupsWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _mGroups );
+    unsigned int Manager::ChannelHandle::getChannelID() const {
+        return _epoch;
+    }
 
-        auto it = _groups.find( groupName );
-        if( it != _groups.end() ) {
-            throw util::Error::DUPLICATE_GROUP;
-        }
 
-        _groups[groupName] = std::make_unique<Group>();
+    void Manager::addGroup( const char *groupName ) {
+        _directory.update( [&]( Directory &directory ) {
+            if( directory.groups.find( groupName ) != directory.groups.end() ) {
+                throw util::Error::DUPLICATE_GROUP;
+            }
+
+            directory.groups[groupName] = std::make_shared<const Group>();
+        } );
     }
 
     void Manager::removeGroup( const char *groupName ) {
-        util::LockAtomic lockAtomic( _countGroupsWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _mGroups );
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                return;
+            }
 
-        _groups.erase( groupName );
+            auto &channels = it->second->channels;
+            for( auto itChannel = channels.begin(); itChannel != channels.end(); itChannel++ ) {
+                _expireChannel( itChannel->second.get() );
+            }
+
+            directory.groups.erase( it );
+        } );
     }
 
     void Manager::addChannel(
         const char *groupName,
         const char *channelName,
         const char *path,
-        util::types::ChannelLimitMessages &limitMessages
+        util::types::ChannelLimitMessages &limitMessages,
+        unsigned int countShards
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                throw util::Error::NOT_FOUND_GROUP;
+            }
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
+            if( it->second->channels.find( channelName ) != it->second->channels.end() ) {
+                throw util::Error::DUPLICATE_CHANNEL;
+            }
 
-        auto group = _groups[groupName].get();
+            util::types::ChannelLimitMessages shardLimitMessages;
+            _getShardLimits( limitMessages, countShards, shardLimitMessages );
 
-        util::LockAtomic lockAtomicChannels( group->countChannelsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockChannels( group->mChannels );
+            auto channel = std::make_shared<Channel>();
+            channel->epoch = ++_epoch;
 
-        if( group->channels.find( channelName ) != group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
-        }
+            for( unsigned int i = 0; i < countShards; i++ ) {
+                std::string pathShard = path;
+                if( i != 0 ) {
+                    pathShard += ".";
+                    pathShard += std::to_string( i );
+                }
 
-        group->channels[channelName] = std::make_unique<Channel>();
-        group->channels[channelName]->messages = std::make_unique<Messages>( path, limitMessages );
+                auto shard = std::make_unique<Shard>( _queuesEpoch );
+                shard->messages = std::make_unique<Messages>( pathShard.c_str(), shardLimitMessages );
+                channel->shards.push_back( std::move( shard ) );
+            }
+
+            auto group = std::make_shared<Group>( *it->second );
+            group->channels[channelName] = std::move( channel );
+            it->second = std::move( group );
+        } );
     }
 
     void Manager::updateChannelLimitMessages(
@@ -206,336 +328,440 @@ namespace simq::core::server::q {
         const char *channelName,
         util::types::ChannelLimitMessages &limitMessages
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _findChannel( groupName, channelName );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
+        util::types::ChannelLimitMessages shardLimitMessages;
+        _getShardLimits( limitMessages, channel->shards.size(), shardLimitMessages );
+
+        for( auto it = channel->shards.begin(); it != channel->shards.end(); it++ ) {
+            (*it)->messages->updateLimits( shardLimitMessages );
         }
+    }
 
-        auto group = _groups[groupName].get();
+    void Manager::_getShardLimits(
+        util::types::ChannelLimitMessages &limitMessages,
+        unsigned int countShards,
+        util::types::ChannelLimitMessages &shardLimitMessages
+    ) {
+        shardLimitMessages = limitMessages;
+        shardLimitMessages.maxMessagesInMemory = ( limitMessages.maxMessagesInMemory + countShards - 1 ) / countShards;
+        shardLimitMessages.maxMessagesOnDisk = ( limitMessages.maxMessagesOnDisk + countShards - 1 ) / countShards;
+    }
 
-        util::LockAtomic lockAtomicChannels( group->countChannelsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockChannels( group->mChannels );
+    Manager::Shard *Manager::_getShard( Channel *channel, unsigned int id ) {
+        return channel->shards[id % channel->shards.size()].get();
+    }
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
-        }
+    unsigned int Manager::_toLocalID( Channel *channel, unsigned int id ) {
+        return id / channel->shards.size();
+    }
 
-        group->channels[channelName]->messages->updateLimits( limitMessages );
+    unsigned int Manager::_toID( Channel *channel, unsigned int shard, unsigned int localID ) {
+        return localID * channel->shards.size() + shard;
     }
 
     void Manager::removeChannel(
         const char *groupName,
         const char *channelName
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        _directory.update( [&]( Directory &directory ) {
+            auto it = directory.groups.find( groupName );
+            if( it == directory.groups.end() ) {
+                return;
+            }
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            return;
-        }
+            auto itChannel = it->second->channels.find( channelName );
+            if( itChannel == it->second->channels.end() ) {
+                return;
+            }
 
-        auto group = _groups[groupName].get();
+            _expireChannel( itChannel->second.get() );
 
-        util::LockAtomic lockAtomicChannels( group->countChannelsWrited );
-        std::lock_guard<std::shared_timed_mutex> lockChannels( group->mChannels );
+            auto group = std::make_shared<Group>( *it->second );
+            group->channels.erase( channelName );
+            it->second = std::move( group );
+        } );
+    }
 
-        group->channels.erase( channelName );
+    void Manager::_expireChannel( Channel *channel ) {
+        channel->epoch = 0;
     }
 
-    void Manager::joinConsumer( const char *groupName, const char *channelName, unsigned int fd ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+    std::shared_ptr<Manager::Channel> Manager::_findChannel(
+        const char *groupName,
+        const char *channelName
+    ) {
+        util::Snapshot<Directory>::Reader directory( _directory );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        auto itGroup = directory->groups.find( groupName );
+        if( itGroup == directory->groups.end() ) {
             throw util::Error::NOT_FOUND_GROUP;
         }
 
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        auto &channels = itGroup->second->channels;
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
+        auto itChannel = channels.find( channelName );
+        if( itChannel == channels.end() ) {
             throw util::Error::NOT_FOUND_CHANNEL;
         }
 
-        auto channel = group->channels[channelName].get();
+        return itChannel->second;
+    }
 
-        util::LockAtomic lockAtomicChannels( channel->countConsumersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumer( channel->mConsumers );
+    Manager::Channel *Manager::_getChannel( ChannelHandle &handle ) {
+        auto channel = handle._channel.get();
 
-        auto itConsumer = channel->consumers.find( fd );
-        if( itConsumer != channel->consumers.end() ) {
-            throw util::Error::DUPLICATE_CONSUMER;
+        if( channel == nullptr || channel->epoch != handle._epoch ) {
+            return nullptr;
         }
 
-        channel->consumers[fd] = std::list<unsigned int>();
+        return channel;
     }
 
-    void Manager::leaveConsumer( const char *groupName, const char *channelName, unsigned int fd ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+    Manager::Channel *Manager::_getChannelOrThrow( ChannelHandle &handle ) {
+        auto channel = _getChannel( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            return;
+        if( channel == nullptr ) {
+            throw util::Error::NOT_FOUND_CHANNEL;
         }
 
-        auto group = _groups[groupName].get();
+        return channel;
+    }
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+    void Manager::_checkConsumer( ChannelHandle &handle ) {
+        if( handle._consumer == nullptr ) {
+            throw util::Error::NOT_FOUND_CONSUMER;
+        }
+    }
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            return;
+    void Manager::_checkProducer( ChannelHandle &handle ) {
+        if( !handle._isProducer ) {
+            throw util::Error::NOT_FOUND_PRODUCER;
         }
+    }
 
-        auto channel = group->channels[channelName].get();
+    // Each producer walks the shards round-robin from its own offset and
+    // skips shards that are full
+    template<typename F>
+    unsigned int Manager::_addToShard( Channel *channel, ChannelHandle &handle, F add ) {
+        auto countShards = channel->shards.size();
+
+        for( unsigned int i = 0; ; i++ ) {
+            auto index = handle._shard;
+            handle._shard = ( index + 1 ) % countShards;
+
+            try {
+                auto localID = add( channel->shards[index]->messages.get() );
+                return _toID( channel, index, localID );
+            } catch( util::Error::Err err ) {
+                if( err != util::Error::EXCEED_LIMIT || i + 1 >= countShards ) {
+                    throw;
+                }
+            }
+        }
+    }
 
-        util::LockAtomic lockAtomicChannels( channel->countConsumersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockConsumer( channel->mConsumers );
+    bool Manager::_popToken( Shard *shard, unsigned long &token ) {
+        if( shard->countRedelivery != 0 ) {
+            std::lock_guard<std::mutex> lockRedelivery( shard->mRedelivery );
 
-        auto itConsumer = channel->consumers.find( fd );
-        if( itConsumer == channel->consumers.end() ) {
-            return;
+            if( !shard->redelivery.empty() ) {
+                token = shard->redelivery.front();
+                shard->redelivery.pop_front();
+                shard->countRedelivery--;
+                return true;
+            }
         }
 
-        for( auto itMsg = channel->consumers[fd].begin(); itMsg != channel->consumers[fd].end(); itMsg++ ) {
-            auto idMsg = *itMsg;
-            if( channel->signals.find( idMsg ) == channel->signals.end() ) {
-                continue;
-            }
+        return shard->QList.pop( token );
+    }
 
-            channel->signals[idMsg]--;
-            if( channel->signals[idMsg] == 0 ) {
-                channel->messages->free( idMsg );
-                channel->signals.erase( idMsg );
-            }
+    unsigned long Manager::_hashKey( const char *key ) {
+        auto hash = std::hash<std::string>{}( key );
+
+        return hash == 0 ? 1 : hash;
+    }
+
+    // Called with a claimed message. A message whose key is held by another
+    // one goes back to QUEUED and is parked behind that key
+    bool Manager::_holdKey( Shard *shard, unsigned long token, unsigned int localID ) {
+        auto key = shard->messages->getKey( localID );
+
+        if( key == 0 ) {
+            return true;
         }
 
-        channel->consumers.erase( itConsumer );
+        std::lock_guard<std::mutex> lockKeys( shard->mKeys );
+
+        auto it = shard->keys.find( key );
+
+        if( it == shard->keys.end() ) {
+            shard->keys[key].holder = token;
+            return true;
+        }
+
+        // reverted or handed over by _releaseKey
+        if( it->second.holder == token ) {
+            return true;
+        }
+
+        shard->messages->unclaim( localID );
+        it->second.waiting.push_back( token );
+
+        return false;
     }
 
-    void Manager::joinProducer( const char *groupName, const char *channelName, unsigned int fd ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+    bool Manager::_releaseKey( Shard *shard, unsigned long key, unsigned long token ) {
+        if( key == 0 ) {
+            return false;
+        }
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
+        std::lock_guard<std::mutex> lockKeys( shard->mKeys );
+
+        auto it = shard->keys.find( key );
+
+        if( it == shard->keys.end() || it->second.holder != token ) {
+            return false;
         }
 
-        auto group = _groups[groupName].get();
+        auto &waiting = it->second.waiting;
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        // the next message of the key is delivered before anything new,
+        // removed ones left stale tokens behind
+        while( !waiting.empty() ) {
+            auto next = waiting.front();
+            waiting.pop_front();
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
+            if( !shard->messages->isQueued( next ) ) {
+                continue;
+            }
+
+            it->second.holder = next;
+
+            std::lock_guard<std::mutex> lockRedelivery( shard->mRedelivery );
+
+            shard->redelivery.push_back( next );
+            shard->countRedelivery++;
+
+            return true;
         }
 
-        auto channel = group->channels[channelName].get();
+        shard->keys.erase( it );
 
-        util::LockAtomic lockAtomicChannels( channel->countProducersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducer( channel->mProducers );
+        return false;
+    }
 
-        if( channel->producers.find( fd ) != channel->producers.end() ) {
-            throw util::Error::DUPLICATE_PRODUCER;
+    Manager::ChannelHandle Manager::joinConsumer(
+        const char *groupName,
+        const char *channelName,
+        unsigned int fd
+    ) {
+        ChannelHandle handle;
+        handle._channel = _findChannel( groupName, channelName );
+        handle._epoch = handle._channel->epoch;
+
+        auto channel = handle._channel.get();
+
+        std::lock_guard<util::RWLock> lockConsumer( channel->mConsumers );
+
+        auto itConsumer = channel->consumers.find( fd );
+        if( itConsumer != channel->consumers.end() ) {
+            throw util::Error::DUPLICATE_CONSUMER;
         }
 
-        channel->producers[fd] = true;
+        auto consumer = std::make_unique<Consumer>();
+        handle._consumer = consumer.get();
+        channel->consumers[fd] = std::move( consumer );
+
+        return handle;
     }
 
-    void Manager::leaveProducer( const char *groupName, const char *channelName, unsigned int fd ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+    void Manager::leaveConsumer( ChannelHandle &handle, unsigned int fd ) {
+        auto channel = handle._channel.get();
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        if( channel == nullptr || handle._consumer == nullptr ) {
             return;
         }
 
-        auto group = _groups[groupName].get();
+        std::lock_guard<util::RWLock> lockSignals( channel->mSignals );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        std::lock_guard<util::RWLock> lockConsumer( channel->mConsumers );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
+        auto itConsumer = channel->consumers.find( fd );
+        if( itConsumer == channel->consumers.end() ) {
             return;
         }
 
-        auto channel = group->channels[channelName].get();
+        auto &signals = itConsumer->second->signals;
 
-        util::LockAtomic lockAtomicChannels( channel->countProducersWrited );
-        std::lock_guard<std::shared_timed_mutex> lockProducer( channel->mProducers );
+        for( auto itMsg = signals.begin(); itMsg != signals.end(); itMsg++ ) {
+            auto idMsg = *itMsg;
+            if( channel->signals.find( idMsg ) == channel->signals.end() ) {
+                continue;
+            }
 
-        channel->producers.erase( fd );
-    }
+            channel->signals[idMsg]--;
+            if( channel->signals[idMsg] == 0 ) {
+                _getShard( channel, idMsg )->messages->free( _toLocalID( channel, idMsg ) );
+                channel->signals.erase( idMsg );
+            }
+        }
 
-    bool Manager::_isConsumer( std::map<unsigned int, std::list<unsigned int>> &map, unsigned int fd ) {
-        auto it = map.find( fd );
+        if( itConsumer->second->notifyFD != -1 ) {
+            channel->countSubscribers--;
+        }
 
-        return it != map.end();
+        channel->consumers.erase( itConsumer );
+        handle._consumer = nullptr;
     }
 
-    void Manager::_checkConsumer( std::map<unsigned int, std::list<unsigned int>> &map, unsigned int fd ) {
-        if( !_isConsumer( map, fd ) ) {
-            throw util::Error::NOT_FOUND_CONSUMER;
+    // From now on every push to the channel writes notifyFD once,
+    // until the consumer pops again
+    void Manager::subscribeConsumer( ChannelHandle &handle, int notifyFD ) {
+        auto channel = _getChannelOrThrow( handle );
+
+        _checkConsumer( handle );
+
+        std::shared_lock<util::RWLock> lockConsumer( channel->mConsumers );
+
+        if( handle._consumer->notifyFD.exchange( notifyFD ) == -1 ) {
+            channel->countSubscribers++;
         }
     }
 
-    bool Manager::_isProducer( std::map<unsigned int, bool> &map, unsigned int fd ) {
-        auto it = map.find( fd );
+    void Manager::_notifySubscribers( Channel *channel ) {
+        if( channel->countSubscribers == 0 ) {
+            return;
+        }
 
-        return it != map.end();
-    }
+        std::shared_lock<util::RWLock> lockConsumer( channel->mConsumers );
 
-    void Manager::_checkProducer( std::map<unsigned int, bool> &map, unsigned int fd ) {
-        if( !_isProducer( map, fd ) ) {
-            throw util::Error::NOT_FOUND_PRODUCER;
+        for( auto it = channel->consumers.begin(); it != channel->consumers.end(); it++ ) {
+            auto consumer = it->second.get();
+            auto fd = consumer->notifyFD.load();
+
+            if( fd != -1 && !consumer->isNotified.exchange( true ) ) {
+                eventfd_write( fd, 1 );
+            }
         }
     }
 
-    unsigned int Manager::createMessageForQ(
+    Manager::ChannelHandle Manager::joinProducer(
         const char *groupName,
         const char *channelName,
-        unsigned int fd,
-        unsigned int length,
-        char *uuid
+        unsigned int fd
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        ChannelHandle handle;
+        handle._channel = _findChannel( groupName, channelName );
+        handle._epoch = handle._channel->epoch;
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
-
-        auto group = _groups[groupName].get();
+        auto channel = handle._channel.get();
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        std::lock_guard<util::RWLock> lockProducer( channel->mProducers );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
+        if( channel->producers.find( fd ) != channel->producers.end() ) {
+            throw util::Error::DUPLICATE_PRODUCER;
         }
 
-        auto channel = group->channels[channelName].get();
+        channel->producers[fd] = true;
+        handle._isProducer = true;
+        handle._shard = channel->nextProducerShard++ % channel->shards.size();
+
+        return handle;
+    }
 
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducer( channel->mProducers );
+    void Manager::leaveProducer( ChannelHandle &handle, unsigned int fd ) {
+        auto channel = handle._channel.get();
 
-        _checkProducer( channel->producers, fd );
+        if( channel == nullptr || !handle._isProducer ) {
+            return;
+        }
 
-        auto id = channel->messages->addForQ( length, uuid );
+        std::lock_guard<util::RWLock> lockProducer( channel->mProducers );
 
-        return id;
+        channel->producers.erase( fd );
+        handle._isProducer = false;
     }
 
-    unsigned int Manager::createMessageForBroadcast(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
-        unsigned int length
+    unsigned int Manager::createMessageForQ(
+        ChannelHandle &handle,
+        unsigned int length,
+        char *uuid,
+        const char *key
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _getChannelOrThrow( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
+        _checkProducer( handle );
 
-        auto group = _groups[groupName].get();
+        // all messages of a key live in one shard to keep their order
+        if( key != nullptr ) {
+            auto hash = _hashKey( key );
+            auto index = hash % channel->shards.size();
+            auto messages = channel->shards[index]->messages.get();
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+            auto localID = messages->addForQ( length, uuid );
+            messages->setKey( localID, hash );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
+            return _toID( channel, index, localID );
         }
 
-        auto channel = group->channels[channelName].get();
+        return _addToShard( channel, handle, [&]( Messages *messages ) {
+            return messages->addForQ( length, uuid );
+        } );
+    }
 
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducer( channel->mProducers );
+    unsigned int Manager::createMessageForBroadcast(
+        ChannelHandle &handle,
+        unsigned int length
+    ) {
+        auto channel = _getChannelOrThrow( handle );
 
-        _checkProducer( channel->producers, fd );
+        _checkProducer( handle );
 
-        return channel->messages->addForBroadcast( length );
+        return _addToShard( channel, handle, [&]( Messages *messages ) {
+            return messages->addForBroadcast( length );
+        } );
     }
 
     unsigned int Manager::createMessageForReplication(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
+        ChannelHandle &handle,
         unsigned int length,
         const char *uuid
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
-
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
-
-        auto group = _groups[groupName].get();
+        auto channel = _getChannelOrThrow( handle );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        _checkProducer( handle );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
+        if( channel->shards.size() > 1 ) {
+            for( auto it = channel->shards.begin(); it != channel->shards.end(); it++ ) {
+                if( (*it)->messages->hasUUID( uuid ) ) {
+                    throw util::Error::DUPLICATE_UUID;
+                }
+            }
         }
 
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducer( channel->mProducers );
-
-        _checkProducer( channel->producers, fd );
-
-        auto id = channel->messages->addForReplication( length, uuid );
-
-        return id;
+        return _addToShard( channel, handle, [&]( Messages *messages ) {
+            return messages->addForReplication( length, uuid );
+        } );
     }
 
     void Manager::removeMessage(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
+        ChannelHandle &handle,
         unsigned int id
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _getChannel( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        if( channel == nullptr ) {
             return;
         }
 
-        auto group = _groups[groupName].get();
+        auto isConsumer = handle._consumer != nullptr;
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        if( group->channels.find( channelName ) == group->channels.end() ) {
+        if( !isConsumer && !handle._isProducer ) {
             return;
         }
 
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicQ( channel->countQListWrited );
-        std::lock_guard<std::shared_timed_mutex> lockQ( channel->mQList );
-
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducer( channel->mProducers );
-
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumer( channel->mConsumers );
-
-        auto isConsumer = _isConsumer( channel->consumers, fd );
-        auto isProducer = _isProducer( channel->producers, fd );
-
-        if( !isConsumer && !isProducer ) {
-            return;
-        }
+        std::lock_guard<util::RWLock> lockSignals( channel->mSignals );
 
         if( isConsumer && channel->signals.find( id ) != channel->signals.end() ) {
             channel->signals[id]--;
@@ -543,307 +769,306 @@ namespace simq::core::server::q {
             if( channel->signals[id] != 0 ) {
                 return;
             }
+
+            channel->signals.erase( id );
         }
 
+        auto shard = _getShard( channel, id );
+        auto localID = _toLocalID( channel, id );
+
+        auto key = shard->messages->getKey( localID );
+        auto token = shard->messages->getToken( localID );
+
+        shard->messages->free( localID );
 
-        channel->messages->free( id );
+        if( isConsumer && _releaseKey( shard, key, token ) ) {
+            _notifySubscribers( channel );
+        }
     }
 
     void Manager::removeMessage(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
+        ChannelHandle &handle,
         const char *uuid
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _getChannel( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        if( channel == nullptr || handle._consumer == nullptr ) {
             return;
         }
 
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        // its token stays in QList and is skipped as stale by popMessage
+        for( auto it = channel->shards.begin(); it != channel->shards.end(); it++ ) {
+            unsigned long key = 0;
+            unsigned long token = 0;
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            return;
+            if( (*it)->messages->removeQueued( uuid, key, token ) ) {
+                if( _releaseKey( it->get(), key, token ) ) {
+                    _notifySubscribers( channel );
+                }
+                return;
+            }
         }
 
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicQ( channel->countQListWrited );
-        std::lock_guard<std::shared_timed_mutex> lockQ( channel->mQList );
+        throw util::Error::NOT_FOUND_UUID;
+    }
 
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumer( channel->mProducers );
+    // Every shard is locked once for the whole batch, uuids that were
+    // not found are left in the list
+    void Manager::removeMessages(
+        ChannelHandle &handle,
+        std::vector<const char *> &uuids
+    ) {
+        auto channel = _getChannel( handle );
 
-        if( !_isConsumer( channel->consumers, fd ) ) {
+        if( channel == nullptr || handle._consumer == nullptr ) {
             return;
         }
 
-        auto id = channel->messages->getID( uuid );
+        std::vector<std::pair<unsigned long, unsigned long>> keys;
+        bool isReleased = false;
+
+        for( auto it = channel->shards.begin(); it != channel->shards.end() && !uuids.empty(); it++ ) {
+            keys.clear();
+            (*it)->messages->removeQueued( uuids, keys );
+
+            for( auto itKey = keys.begin(); itKey != keys.end(); itKey++ ) {
+                if( _releaseKey( it->get(), itKey->first, itKey->second ) ) {
+                    isReleased = true;
+                }
+            }
+        }
 
-        auto itMsg = std::find( channel->QList.begin(), channel->QList.end(), id );
-        if( itMsg != channel->QList.end() ) {
-            channel->QList.erase( itMsg );
-            channel->messages->free( uuid );
+        if( isReleased ) {
+            _notifySubscribers( channel );
         }
     }
 
     unsigned int Manager::recv(
-        const char *groupName,
-        const char *channelName,
+        ChannelHandle &handle,
         unsigned int fd,
         unsigned int id
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
-
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
-
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
-        }
-
-        auto channel = group->channels[channelName].get();
-
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducer( channel->mProducers );
+        auto channel = _getChannelOrThrow( handle );
 
-        _checkProducer( channel->producers, fd );
+        _checkProducer( handle );
 
-        return channel->messages->recv( id, fd );
+        return _getShard( channel, id )->messages->recv( _toLocalID( channel, id ), fd );
     }
 
     unsigned int Manager::send(
-        const char *groupName,
-        const char *channelName,
+        ChannelHandle &handle,
         unsigned int fd,
         unsigned int id,
         unsigned int offset
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _getChannelOrThrow( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
+        _checkConsumer( handle );
 
-        auto group = _groups[groupName].get();
+        return _getShard( channel, id )->messages->send( _toLocalID( channel, id ), fd, offset );
+    }
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+    unsigned int Manager::write(
+        ChannelHandle &handle,
+        unsigned int id,
+        const char *data,
+        unsigned int length
+    ) {
+        auto channel = _getChannelOrThrow( handle );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
-        }
+        _checkProducer( handle );
 
-        auto channel = group->channels[channelName].get();
+        return _getShard( channel, id )->messages->write( _toLocalID( channel, id ), data, length );
+    }
 
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumer( channel->mConsumers );
+    unsigned int Manager::read(
+        ChannelHandle &handle,
+        unsigned int id,
+        char *data,
+        unsigned int length,
+        unsigned int offset
+    ) {
+        auto channel = _getChannelOrThrow( handle );
 
-        _checkConsumer( channel->consumers, fd );
+        _checkConsumer( handle );
 
-        return channel->messages->send( id, fd, offset );
+        return _getShard( channel, id )->messages->read( _toLocalID( channel, id ), data, length, offset );
     }
 
     void Manager::pushMessage(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
+        ChannelHandle &handle,
         unsigned int id
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
-
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
-        }
-
-        auto group = _groups[groupName].get();
+        auto channel = _getChannelOrThrow( handle );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        _checkProducer( handle );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
-        }
+        auto shard = _getShard( channel, id );
+        auto localID = _toLocalID( channel, id );
 
-        auto channel = group->channels[channelName].get();
+        char uuid[util::UUID::LENGTH+1]{};
 
-        util::LockAtomic lockAtomicQ( channel->countQListWrited );
-        std::lock_guard<std::shared_timed_mutex> lockQ( channel->mQList );
+        shard->messages->getUUID( localID, uuid );
 
-        _wait( channel->countProducersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockProducer( channel->mProducers );
+        if( uuid[0] != 0 ) {
+            shard->QList.push( shard->messages->enqueue( localID ) );
+            _notifySubscribers( channel );
+            return;
+        }
 
-        _checkProducer( channel->producers, fd );
+        {
+            std::lock_guard<util::RWLock> lockSignals( channel->mSignals );
 
-        char uuid[util::UUID::LENGTH+1]{};
+            std::shared_lock<util::RWLock> lockConsumer( channel->mConsumers );
 
-        channel->messages->getUUID( id, uuid );
+            if( channel->consumers.empty() ) {
+                shard->messages->free( localID );
+                return;
+            }
 
-        if( uuid[0] != 0 ) {
-            channel->QList.push_back( id );
-        } else {
-            bool isAdd = false;
             for( auto itConsumer = channel->consumers.begin(); itConsumer != channel->consumers.end(); itConsumer++ ) {
-                channel->consumers[itConsumer->first].push_back( id );
-                isAdd = true;
+                itConsumer->second->signals.push_back( id );
+                itConsumer->second->countSignals++;
             }
 
-            if( !isAdd ) {
-                channel->messages->free( id );
-            } else {
-                channel->signals[id] = channel->consumers.size();
-            }
+            channel->signals[id] = channel->consumers.size();
         }
+
+        _notifySubscribers( channel );
     }
 
     unsigned int Manager::popMessage(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
+        ChannelHandle &handle,
         unsigned int &length,
         char *uuid
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _getChannelOrThrow( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
-            throw util::Error::NOT_FOUND_GROUP;
+        _checkConsumer( handle );
+
+        auto consumer = handle._consumer;
+
+        if( consumer->isNotified ) {
+            consumer->isNotified = false;
         }
 
-        auto group = _groups[groupName].get();
+        unsigned int id = 0;
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        if( consumer->countSignals != 0 ) {
+            std::lock_guard<util::RWLock> lockSignals( channel->mSignals );
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            throw util::Error::NOT_FOUND_CHANNEL;
+            if( !consumer->signals.empty() ) {
+                id = consumer->signals.front();
+                consumer->signals.pop_front();
+                consumer->countSignals--;
+                length = _getShard( channel, id )->messages->getLength( _toLocalID( channel, id ) );
+                return id;
+            }
         }
 
-        auto channel = group->channels[channelName].get();
+        unsigned long token = 0;
+        auto countShards = channel->shards.size();
 
-        util::LockAtomic lockAtomicQ( channel->countQListWrited );
-        std::lock_guard<std::shared_timed_mutex> lockQ( channel->mQList );
+        for( unsigned int i = 0; i < countShards; i++ ) {
+            auto index = ( consumer->nextShard + i ) % countShards;
+            auto shard = channel->shards[index].get();
+            unsigned int localID = 0;
 
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumer( channel->mConsumers );
+            while( localID == 0 && _popToken( shard, token ) ) {
+                localID = shard->messages->claim( token );
 
-        _checkConsumer( channel->consumers, fd );
+                if( localID != 0 && !_holdKey( shard, token, localID ) ) {
+                    localID = 0;
+                }
+            }
 
-        auto consumers = channel->consumers;
+            if( localID == 0 ) {
+                continue;
+            }
 
-        unsigned int id = 0;
+            consumer->nextShard = ( index + 1 ) % countShards;
 
-        if( !consumers[fd].empty() ) {
-            id = consumers[fd].front();
-            channel->consumers[fd].pop_front();
-            length = channel->messages->getLength( id );
-            return id;
-        }
+            shard->messages->getUUID( localID, uuid );
+            length = shard->messages->getLength( localID );
 
-        if( !channel->QList.empty() ) {
-            id = channel->QList.front();
-            channel->messages->getUUID( id, uuid );
-            channel->QList.pop_front();
-            length = channel->messages->getLength( id );
+            return _toID( channel, index, localID );
         }
 
-
-        return id;
+        return 0;
     }
 
     void Manager::revertMessage(
-        const char *groupName,
-        const char *channelName,
-        unsigned int fd,
+        ChannelHandle &handle,
         unsigned int id
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        auto channel = _getChannel( handle );
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        if( channel == nullptr || handle._consumer == nullptr ) {
             return;
         }
 
-        auto group = _groups[groupName].get();
+        auto shard = _getShard( channel, id );
+        auto token = shard->messages->unclaim( _toLocalID( channel, id ) );
 
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
-
-        if( group->channels.find( channelName ) == group->channels.end() ) {
+        if( token == 0 ) {
             return;
         }
 
-        auto channel = group->channels[channelName].get();
-
-        util::LockAtomic lockAtomicQ( channel->countQListWrited );
-        std::lock_guard<std::shared_timed_mutex> lockQ( channel->mQList );
-
-        _wait( channel->countConsumersWrited );
-        std::shared_lock<std::shared_timed_mutex> lockConsumer( channel->mConsumers );
+        {
+            std::lock_guard<std::mutex> lockRedelivery( shard->mRedelivery );
 
-        if( !_isConsumer( channel->consumers, fd ) ) {
-            return;
+            shard->redelivery.push_front( token );
+            shard->countRedelivery++;
         }
 
-        char uuid[util::UUID::LENGTH+1]{};
-
-        channel->messages->getUUID( id, uuid );
-
-        if( uuid[0] == 0 ) {
-            return;
-        }
-
-        channel->QList.push_front( id );
+        _notifySubscribers( channel );
     }
 
     void Manager::clearQ(
         const char *groupName,
         const char *channelName
     ) {
-        _wait( _countGroupsWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mGroups );
+        std::shared_ptr<Channel> channelPtr;
 
-        if( _groups.find( groupName ) == _groups.end() ) {
+        try {
+            channelPtr = _findChannel( groupName, channelName );
+        } catch( ... ) {
             return;
         }
 
-        auto group = _groups[groupName].get();
-
-        _wait( group->countChannelsWrited );
-        std::shared_lock<std::shared_timed_mutex> lockChannels( group->mChannels );
+        auto channel = channelPtr.get();
 
-        if( group->channels.find( channelName ) == group->channels.end() ) {
-            return;
-        }
-
-        auto channel = group->channels[channelName].get();
+        std::lock_guard<util::RWLock> lockSignals( channel->mSignals );
 
-        util::LockAtomic lockAtomicQ( channel->countQListWrited );
-        std::lock_guard<std::shared_timed_mutex> lockQ( channel->mQList );
+        std::shared_lock<util::RWLock> lockConsumer( channel->mConsumers );
 
         for( auto it = channel->consumers.begin(); it != channel->consumers.end(); it++ ) {
-            channel->consumers[it->first].clear();
+            it->second->signals.clear();
+            it->second->countSignals = 0;
         }
 
-        channel->messages->clearQ();
-        channel->QList.clear();
         channel->signals.clear();
+
+        for( auto it = channel->shards.begin(); it != channel->shards.end(); it++ ) {
+            auto shard = it->get();
+
+            shard->messages->clearQ();
+
+            {
+                std::lock_guard<std::mutex> lockRedelivery( shard->mRedelivery );
+                shard->redelivery.clear();
+                shard->countRedelivery = 0;
+            }
+
+            {
+                std::lock_guard<std::mutex> lockKeys( shard->mKeys );
+                shard->keys.clear();
+            }
+
+            unsigned long token;
+            while( shard->QList.pop( token ) );
+        }
     }
 }
 
 #endif
- 
@@ -10,7 +10,7 @@
 #include <string.h>
 #include <vector>
 #include "../../../util/uuid.hpp"
-#include "../../../util/lock_atomic.hpp"
+#include "../../../util/rw_lock.hpp"
 #include "buffer.hpp"
 #include "../../../util/types.h"
 #include "../../../util/error.h"
@@ -23,30 +23,41 @@ namespace simq::core::server::q {
             const unsigned int MESSAGE_PACKET_SIZE = util::constants::MESSAGE_PACKET_SIZE;
             std::unique_ptr<Buffer> _buffer;
 
+            static const unsigned int STATE_NEW = 0;
+            static const unsigned int STATE_QUEUED = 1;
+            static const unsigned int STATE_CLAIMED = 2;
+
             struct Message {
                 char uuid[util::UUID::LENGTH+1];
                 bool isMemory;
+
+                // distinguishes reuses of the same id in queue tokens
+                unsigned int seq;
+                std::atomic_uint state{STATE_NEW};
+
+                // hash of the ordering key, 0 if the message has none
+                unsigned long key = 0;
             };
 
-            std::shared_timed_mutex _mUUID;
-            std::atomic_uint _countUUIDWrited{0};
+            util::RWLock _mUUID;
 
             std::unordered_map<std::string, unsigned int> _uuid;
 
 
-            std::shared_timed_mutex _m;
-            std::atomic_uint _countWrited{0};
+            util::RWLock _m;
 
             unsigned int _totalInMemory = 0;
             unsigned int _totalOnDisk = 0;
             util::types::ChannelLimitMessages _limits;
 
             std::vector<std::unique_ptr<Message>> _messages;
+            unsigned int _seq = 0;
 
-            void _wait( std::atomic_uint &atom );
             unsigned int _allocateMessage( unsigned int length, bool &isMemory );
             void _expandMessages();
+            void _createMessage( unsigned int id, bool isMemory );
             void _validateAdd( unsigned int length );
+            bool _removeQueued( const char *uuid, unsigned long &key, unsigned long &token );
         public:
             Messages( const char *path, util::types::ChannelLimitMessages &limits );
 
@@ -60,7 +71,24 @@ namespace simq::core::server::q {
             void getUUID( unsigned int id, char *uuid );
             unsigned int getID( const char *uuid );
 
+            unsigned long enqueue( unsigned int id );
+            unsigned int claim( unsigned long token );
+            unsigned long unclaim( unsigned int id );
+            unsigned long getToken( unsigned int id );
+            bool isQueued( unsigned long token );
+            bool removeQueued( const char *uuid, unsigned long &key, unsigned long &token );
+            void removeQueued(
+                std::vector<const char *> &uuids,
+                std::vector<std::pair<unsigned long, unsigned long>> &keys
+            );
+            bool hasUUID( const char *uuid );
+
+            void setKey( unsigned int id, unsigned long key );
+            unsigned long getKey( unsigned int id );
+
             unsigned int recv( unsigned int id, unsigned int fd );
+            unsigned int write( unsigned int id, const char *data, unsigned int length );
+            unsigned int read( unsigned int id, char *data, unsigned int length, unsigned int offset );
             unsigned int send( unsigned int id, unsigned int fd, unsigned int offset );
             unsigned int getLength( unsigned int id );
             void clearQ();
@@ -72,9 +100,6 @@ namespace simq::core::server::q {
         _limits = limits;
     }
 
-    void Messages::_wait( std::atomic_uint &atom ) {
-        while( atom );
-    }
 
     void Messages::updateLimits( util::types::ChannelLimitMessages &limits ) {
         _limits = limits;
@@ -103,8 +128,7 @@ namespace simq::core::server::q {
     }
 
     unsigned int Messages::getID( const char *uuid ) {
-        _wait( _countUUIDWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _mUUID );
+        std::shared_lock<util::RWLock> lock( _mUUID );
 
         auto it = _uuid.find( uuid );
 
@@ -116,8 +140,7 @@ namespace simq::core::server::q {
     }
 
     void Messages::getUUID( unsigned int id, char *uuid ) {
-        _wait( _countWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _m );
+        std::shared_lock<util::RWLock> lock( _m );
 
         if( id >= _messages.size() ) {
             throw util::Error::UNKNOWN;
@@ -130,6 +153,188 @@ namespace simq::core::server::q {
         _messages.resize( _messages.size() + MESSAGES_IN_PACKET );
     }
 
+    void Messages::_createMessage( unsigned int id, bool isMemory ) {
+        if( id >= _messages.size() ) {
+            _expandMessages();
+        }
+
+        _messages[id] = std::make_unique<Message>();
+        _messages[id]->isMemory = isMemory;
+        _messages[id]->seq = ++_seq;
+    }
+
+    unsigned long Messages::enqueue( unsigned int id ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        auto msg = _messages[id].get();
+        msg->state = STATE_QUEUED;
+
+        return ( ( unsigned long )msg->seq << 32 ) | id;
+    }
+
+    unsigned int Messages::claim( unsigned long token ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        unsigned int id = token & 0xFFFFFFFF;
+        unsigned int seq = token >> 32;
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            return 0;
+        }
+
+        auto msg = _messages[id].get();
+        auto state = STATE_QUEUED;
+
+        if( msg->seq != seq || !msg->state.compare_exchange_strong( state, STATE_CLAIMED ) ) {
+            return 0;
+        }
+
+        return id;
+    }
+
+    unsigned long Messages::unclaim( unsigned int id ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            return 0;
+        }
+
+        auto msg = _messages[id].get();
+        auto state = STATE_CLAIMED;
+
+        if( !msg->state.compare_exchange_strong( state, STATE_QUEUED ) ) {
+            return 0;
+        }
+
+        return ( ( unsigned long )msg->seq << 32 ) | id;
+    }
+
+    unsigned long Messages::getToken( unsigned int id ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            return 0;
+        }
+
+        return ( ( unsigned long )_messages[id]->seq << 32 ) | id;
+    }
+
+    bool Messages::isQueued( unsigned long token ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        unsigned int id = token & 0xFFFFFFFF;
+        unsigned int seq = token >> 32;
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            return false;
+        }
+
+        auto msg = _messages[id].get();
+
+        return msg->seq == seq && msg->state == STATE_QUEUED;
+    }
+
+    void Messages::setKey( unsigned int id, unsigned long key ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        _messages[id]->key = key;
+    }
+
+    unsigned long Messages::getKey( unsigned int id ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            return 0;
+        }
+
+        return _messages[id]->key;
+    }
+
+    bool Messages::hasUUID( const char *uuid ) {
+        std::shared_lock<util::RWLock> lock( _mUUID );
+
+        return _uuid.find( uuid ) != _uuid.end();
+    }
+
+    bool Messages::removeQueued( const char *uuid, unsigned long &key, unsigned long &token ) {
+        std::lock_guard<util::RWLock> lock( _m );
+
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
+
+        return _removeQueued( uuid, key, token );
+    }
+
+    // Found uuids are taken out of the list, the key and token of every freed
+    // keyed message are added to keys
+    void Messages::removeQueued(
+        std::vector<const char *> &uuids,
+        std::vector<std::pair<unsigned long, unsigned long>> &keys
+    ) {
+        std::lock_guard<util::RWLock> lock( _m );
+
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
+
+        for( unsigned int i = 0; i < uuids.size(); ) {
+            unsigned long key = 0;
+            unsigned long token = 0;
+
+            if( !_removeQueued( uuids[i], key, token ) ) {
+                i++;
+                continue;
+            }
+
+            if( key != 0 ) {
+                keys.push_back( { key, token } );
+            }
+
+            uuids[i] = uuids.back();
+            uuids.pop_back();
+        }
+    }
+
+    bool Messages::_removeQueued( const char *uuid, unsigned long &key, unsigned long &token ) {
+        auto it = _uuid.find( uuid );
+        if( it == _uuid.end() ) {
+            return false;
+        }
+
+        auto id = it->second;
+        auto msg = _messages[id].get();
+
+        key = 0;
+        token = 0;
+
+        // popped messages belong to their consumer until acked or reverted
+        if( msg->state != STATE_QUEUED ) {
+            return true;
+        }
+
+        key = msg->key;
+        token = ( ( unsigned long )msg->seq << 32 ) | id;
+
+        _uuid.erase( it );
+
+        _buffer->free( id );
+
+        if( msg->isMemory ) {
+            _totalInMemory--;
+        } else {
+            _totalOnDisk--;
+        }
+
+        _messages[id].reset();
+
+        return true;
+    }
+
     void Messages::_validateAdd( unsigned int length ) {
         if( length < _limits.minMessageSize || length > _limits.maxMessageSize ) {
             throw util::Error::WRONG_MESSAGE_SIZE;
@@ -139,27 +344,20 @@ namespace simq::core::server::q {
     unsigned int Messages::addForQ( unsigned int length, char *uuid ) {
         _validateAdd( length );
 
-        util::LockAtomic lockAtomic( _countWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _m );
+        std::lock_guard<util::RWLock> lock( _m );
 
-        util::LockAtomic lockAtomicUUID( _countUUIDWrited );
-        std::lock_guard<std::shared_timed_mutex> lockUUID( _mUUID );
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
 
         bool isMemory = false;
         auto id = _allocateMessage( length, isMemory );
 
-        if( id >= _messages.size() ) {
-            _expandMessages();
-        }
-
-        _messages[id] = std::make_unique<Message>();
-        _messages[id]->isMemory = isMemory;
+        _createMessage( id, isMemory );
 
         while( true ) {
             util::UUID::generate( uuid );
             auto it = _uuid.find( uuid );
             if( it == _uuid.end() ) {
-                _uuid[uuid] = true;
+                _uuid[uuid] = id;
                 break;
             }
         }
@@ -172,11 +370,9 @@ namespace simq::core::server::q {
     unsigned int Messages::addForReplication( unsigned int length, const char *uuid ) {
         _validateAdd( length );
 
-        util::LockAtomic lockAtomic( _countWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _m );
+        std::lock_guard<util::RWLock> lock( _m );
 
-        _wait( _countUUIDWrited );
-        std::shared_lock<std::shared_timed_mutex> lockUUID( _mUUID );
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
 
         bool isMemory = false;
 
@@ -187,14 +383,9 @@ namespace simq::core::server::q {
 
         auto id = _allocateMessage( length, isMemory );
 
-        _uuid[uuid] = true;
+        _uuid[uuid] = id;
 
-        if( id >= _messages.size() ) {
-            _expandMessages();
-        }
-
-        _messages[id] = std::make_unique<Message>();
-        _messages[id]->isMemory = isMemory;
+        _createMessage( id, isMemory );
 
         memcpy( _messages[id]->uuid, uuid, util::UUID::LENGTH );
 
@@ -204,25 +395,20 @@ namespace simq::core::server::q {
     unsigned int Messages::addForBroadcast( unsigned int length ) {
         _validateAdd( length );
 
-        util::LockAtomic lockAtomic( _countWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _m );
+        std::lock_guard<util::RWLock> lock( _m );
 
         bool isMemory = false;
         auto id = _allocateMessage( length, isMemory );
 
-        if( id >= _messages.size() ) {
-            _expandMessages();
-        }
-
-        _messages[id] = std::make_unique<Message>();
-        _messages[id]->isMemory = isMemory;
+        _createMessage( id, isMemory );
 
         return id;
     }
 
     void Messages::free( unsigned int id ) {
-        util::LockAtomic lockAtomic( _countWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _m );
+        std::lock_guard<util::RWLock> lock( _m );
+
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
 
         if( id >= _messages.size() || _messages[id] == nullptr ) {
             return;
@@ -249,11 +435,9 @@ namespace simq::core::server::q {
     }
 
     void Messages::free( const char *uuid ) {
-        util::LockAtomic lockAtomic( _countWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _m );
+        std::lock_guard<util::RWLock> lock( _m );
 
-        util::LockAtomic lockAtomicUUID( _countUUIDWrited );
-        std::lock_guard<std::shared_timed_mutex> lockUUID( _mUUID );
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
 
         auto it = _uuid.find( uuid );
         if( it == _uuid.end() ) {
@@ -275,8 +459,7 @@ namespace simq::core::server::q {
     }
 
     unsigned int Messages::recv( unsigned int id, unsigned int fd ) {
-        _wait( _countWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _m );
+        std::shared_lock<util::RWLock> lock( _m );
 
         if( id >= _messages.size() || _messages[id] == nullptr ) {
             throw util::Error::UNKNOWN;
@@ -285,9 +468,28 @@ namespace simq::core::server::q {
         return _buffer->recv( id, fd );
     }
 
+    unsigned int Messages::write( unsigned int id, const char *data, unsigned int length ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        return _buffer->write( id, data, length );
+    }
+
+    unsigned int Messages::read( unsigned int id, char *data, unsigned int length, unsigned int offset ) {
+        std::shared_lock<util::RWLock> lock( _m );
+
+        if( id >= _messages.size() || _messages[id] == nullptr ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        return _buffer->read( id, data, length, offset );
+    }
+
     unsigned int Messages::send( unsigned int id, unsigned int fd, unsigned int offset ) {
-        _wait( _countWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _m );
+        std::shared_lock<util::RWLock> lock( _m );
 
         if( id >= _messages.size() || _messages[id] == nullptr ) {
             throw util::Error::UNKNOWN;
@@ -297,18 +499,15 @@ namespace simq::core::server::q {
     }
 
     unsigned int Messages::getLength( unsigned int id ) {
-        _wait( _countWrited );
-        std::shared_lock<std::shared_timed_mutex> lock( _m );
+        std::shared_lock<util::RWLock> lock( _m );
 
         return _buffer->getLength( id );
     }
 
     void Messages::clearQ() {
-        util::LockAtomic lockAtomic( _countWrited );
-        std::lock_guard<std::shared_timed_mutex> lock( _m );
+        std::lock_guard<util::RWLock> lock( _m );
 
-        util::LockAtomic lockAtomicUUID( _countUUIDWrited );
-        std::lock_guard<std::shared_timed_mutex> lockUUID( _mUUID );
+        std::lock_guard<util::RWLock> lockUUID( _mUUID );
 
         _messages.clear();
         _uuid.clear();
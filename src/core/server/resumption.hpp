@@ -0,0 +1,138 @@
+#ifndef SIMQ_CORE_SERVER_RESUMPTION
+#define SIMQ_CORE_SERVER_RESUMPTION
+
+#include <sys/random.h>
+#include <mutex>
+#include <deque>
+#include <string>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include "protocol.hpp"
+#include "access.hpp"
+#include "../../util/timer.hpp"
+#include "../../util/error.h"
+
+namespace simq::core::server {
+    // Tokens that let a consumer or a producer come back in one round trip
+    // after a lost connection. A token is only handed to the client while its
+    // session is alive, the ticket is stored when the session closes and kept
+    // for TTL_SECONDS, so a token can not open a second copy of a live session.
+    // Every token is used once
+    class Resumption {
+        public:
+            static const unsigned int TTL_SECONDS = 30;
+
+            // a channel a consumer attached after the one it logged in to
+            struct Channel {
+                std::string channel;
+                std::string login;
+                Access::Capability capability;
+            };
+
+            struct Ticket {
+                bool isConsumer;
+                // group, channel and login, each ends with \0
+                std::string authData;
+                unsigned short int offsetChannel;
+                unsigned short int offsetLogin;
+                Access::Capability capability;
+                std::vector<Channel> attached;
+                // the session was in the secure mode
+                bool isSecure;
+                unsigned long int expires;
+            };
+
+        private:
+            static const unsigned int COUNT_SHARDS = 16;
+
+            struct Shard {
+                std::mutex m;
+                std::unordered_map<std::string, Ticket> tickets;
+                // tokens of closed sessions in the order they expire
+                std::deque<std::pair<unsigned long int, std::string>> released;
+            };
+
+            std::unique_ptr<Shard[]> _shards;
+
+            Shard *_getShard( const unsigned char *token );
+            void _purge( Shard *shard, unsigned long int now );
+            static unsigned long int _now();
+
+        public:
+            Resumption();
+
+            void issue( unsigned char *token );
+            void release( const unsigned char *token, Ticket &&ticket );
+            bool take( const unsigned char *token, bool isSecure, Ticket &ticket );
+    };
+
+    Resumption::Resumption() {
+        _shards = std::make_unique<Shard[]>( COUNT_SHARDS );
+    }
+
+    Resumption::Shard *Resumption::_getShard( const unsigned char *token ) {
+        return &_shards[token[0] % COUNT_SHARDS];
+    }
+
+    unsigned long int Resumption::_now() {
+        return util::Timer::tickMicro() / 1'000'000;
+    }
+
+    void Resumption::_purge( Shard *shard, unsigned long int now ) {
+        while( !shard->released.empty() && shard->released.front().first <= now ) {
+            auto it = shard->tickets.find( shard->released.front().second );
+
+            if( it != shard->tickets.end() && it->second.expires == shard->released.front().first ) {
+                shard->tickets.erase( it );
+            }
+
+            shard->released.pop_front();
+        }
+    }
+
+    void Resumption::issue( unsigned char *token ) {
+        if( getrandom( token, Protocol::TOKEN_LENGTH, 0 ) != Protocol::TOKEN_LENGTH ) {
+            throw util::Error::UNKNOWN;
+        }
+    }
+
+    // the session of the token is closed, from now on the token resumes it
+    void Resumption::release( const unsigned char *token, Ticket &&ticket ) {
+        auto shard = _getShard( token );
+        std::string key( ( const char * )token, Protocol::TOKEN_LENGTH );
+        auto now = _now();
+
+        ticket.expires = now + TTL_SECONDS;
+
+        std::lock_guard<std::mutex> lock( shard->m );
+
+        _purge( shard, now );
+
+        shard->released.emplace_back( ticket.expires, key );
+        shard->tickets[std::move( key )] = std::move( ticket );
+    }
+
+    // a ticket of the secure mode is not taken, and not spent, by an open connection
+    bool Resumption::take( const unsigned char *token, bool isSecure, Ticket &ticket ) {
+        auto shard = _getShard( token );
+        auto now = _now();
+
+        std::lock_guard<std::mutex> lock( shard->m );
+
+        _purge( shard, now );
+
+        auto it = shard->tickets.find( std::string( ( const char * )token, Protocol::TOKEN_LENGTH ) );
+        if( it == shard->tickets.end() || ( it->second.isSecure && !isSecure ) ) {
+            return false;
+        }
+
+        ticket = std::move( it->second );
+        shard->tickets.erase( it );
+
+        return true;
+    }
+}
+
+#endif
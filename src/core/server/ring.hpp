@@ -0,0 +1,301 @@
+#ifndef SIMQ_CORE_SERVER_RING
+#define SIMQ_CORE_SERVER_RING
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <atomic>
+#include "protocol.hpp"
+#include "../../util/uuid.hpp"
+#include "../../util/error.h"
+
+namespace simq::core::server {
+    // Shared memory transport of a producer on the same host. The memfd holds
+    // a byte ring of messages written by the client and a ring of completions
+    // written by the server. Each side writes to its eventfd only when the ring
+    // it fills goes from empty to non-empty, the eventfds are non-blocking
+    class Ring {
+        public:
+            static const unsigned int SIZE_DATA = 1 << 20;
+            static const unsigned int COUNT_COMPLETIONS = 1'024;
+            static const unsigned int ALIGN = 8;
+            // fills the end of the data ring, the next record starts at 0
+            static const unsigned int PADDING = 0xFF'FF'FF'FF;
+            static const unsigned int MAX_MESSAGE_SIZE = SIZE_DATA / 2 - sizeof( unsigned int );
+
+            struct Completion {
+                // Protocol::CMD_OK or Protocol::CMD_ERROR
+                unsigned int status;
+                // util::Error::Err of a failed message
+                unsigned int error;
+                char uuid[util::UUID::LENGTH+1];
+            };
+
+            // a record in data is [length][body] aligned to ALIGN,
+            // positions are byte counters that wrap around 2^32
+            struct Layout {
+                alignas( 64 ) std::atomic_uint head;
+                alignas( 64 ) std::atomic_uint tail;
+                alignas( 64 ) std::atomic_uint completionsHead;
+                alignas( 64 ) std::atomic_uint completionsTail;
+                alignas( 64 ) Completion completions[COUNT_COMPLETIONS];
+                alignas( 64 ) char data[SIZE_DATA];
+            };
+
+        private:
+            int _memFD = -1;
+            int _submitFD = -1;
+            int _completeFD = -1;
+            Layout *_layout = nullptr;
+
+            // messages of the client without a completion yet
+            unsigned int _inFlight = 0;
+
+            void _map();
+            void _free();
+            void _complete( unsigned int status, unsigned int error, const char *uuid );
+            static unsigned int _getSizeRecord( unsigned int length );
+
+        public:
+            Ring();
+            Ring( int memFD, int submitFD, int completeFD );
+            ~Ring();
+
+            int getMemFD();
+            int getSubmitFD();
+            int getCompleteFD();
+
+            bool push( const char *data, unsigned int length );
+            bool pop( Completion &completion );
+
+            template<typename F>
+            bool drain( F push, unsigned int maxRecords, unsigned int maxBytes );
+    };
+
+    Ring::Ring() {
+        _memFD = memfd_create( "simq-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING );
+        _submitFD = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+        _completeFD = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+
+        if( _memFD == -1 || _submitFD == -1 || _completeFD == -1 ) {
+            _free();
+            throw util::Error::UNKNOWN;
+        }
+
+        // the client can not truncate the file under the mapping of the server
+        if(
+            ftruncate( _memFD, sizeof( Layout ) ) == -1 ||
+            fcntl( _memFD, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL ) == -1
+        ) {
+            _free();
+            throw util::Error::UNKNOWN;
+        }
+
+        _map();
+    }
+
+    Ring::Ring( int memFD, int submitFD, int completeFD ) {
+        _memFD = memFD;
+        _submitFD = submitFD;
+        _completeFD = completeFD;
+
+        _map();
+    }
+
+    Ring::~Ring() {
+        _free();
+    }
+
+    void Ring::_free() {
+        if( _layout != nullptr ) {
+            munmap( _layout, sizeof( Layout ) );
+            _layout = nullptr;
+        }
+
+        for( auto fd : { &_memFD, &_submitFD, &_completeFD } ) {
+            if( *fd != -1 ) {
+                ::close( *fd );
+                *fd = -1;
+            }
+        }
+    }
+
+    void Ring::_map() {
+        auto ptr = mmap( nullptr, sizeof( Layout ), PROT_READ | PROT_WRITE, MAP_SHARED, _memFD, 0 );
+
+        if( ptr == MAP_FAILED ) {
+            _free();
+            throw util::Error::UNKNOWN;
+        }
+
+        _layout = ( Layout * )ptr;
+    }
+
+    int Ring::getMemFD() {
+        return _memFD;
+    }
+
+    int Ring::getSubmitFD() {
+        return _submitFD;
+    }
+
+    int Ring::getCompleteFD() {
+        return _completeFD;
+    }
+
+    unsigned int Ring::_getSizeRecord( unsigned int length ) {
+        return ( sizeof( unsigned int ) + length + ALIGN - 1 ) & ~( ALIGN - 1 );
+    }
+
+    // client side, false while the ring or the completions are full
+    bool Ring::push( const char *data, unsigned int length ) {
+        if( length > MAX_MESSAGE_SIZE ) {
+            throw util::Error::WRONG_MESSAGE_SIZE;
+        }
+
+        if( _inFlight == COUNT_COMPLETIONS ) {
+            return false;
+        }
+
+        auto tail = _layout->tail.load( std::memory_order_relaxed );
+        auto head = _layout->head.load( std::memory_order_acquire );
+        auto size = _getSizeRecord( length );
+        auto offset = tail & ( SIZE_DATA - 1 );
+        auto padding = SIZE_DATA - offset < size ? SIZE_DATA - offset : 0;
+
+        if( tail + padding + size - head > SIZE_DATA ) {
+            return false;
+        }
+
+        if( padding ) {
+            unsigned int marker = PADDING;
+            memcpy( &_layout->data[offset], &marker, sizeof( unsigned int ) );
+            offset = 0;
+        }
+
+        memcpy( &_layout->data[offset], &length, sizeof( unsigned int ) );
+        memcpy( &_layout->data[offset + sizeof( unsigned int )], data, length );
+
+        _layout->tail.store( tail + padding + size );
+        _inFlight++;
+
+        // the server has drained everything before this record and may sleep
+        if( _layout->head.load() == tail ) {
+            eventfd_write( _submitFD, 1 );
+        }
+
+        return true;
+    }
+
+    // client side, completions come in the order of the pushed messages
+    bool Ring::pop( Completion &completion ) {
+        auto head = _layout->completionsHead.load( std::memory_order_relaxed );
+
+        if( head == _layout->completionsTail.load() ) {
+            return false;
+        }
+
+        completion = _layout->completions[head % COUNT_COMPLETIONS];
+        _layout->completionsHead.store( head + 1 );
+        _inFlight--;
+
+        return true;
+    }
+
+    void Ring::_complete( unsigned int status, unsigned int error, const char *uuid ) {
+        auto tail = _layout->completionsTail.load( std::memory_order_relaxed );
+        auto completion = &_layout->completions[tail % COUNT_COMPLETIONS];
+        completion->status = status;
+        completion->error = error;
+        memcpy( completion->uuid, uuid, util::UUID::LENGTH + 1 );
+
+        _layout->completionsTail.store( tail + 1 );
+
+        if( _layout->completionsHead.load() == tail ) {
+            eventfd_write( _completeFD, 1 );
+        }
+    }
+
+    // Server side. Calls push( data, length, uuid ) for every record until the
+    // ring is empty, util::Error::Err thrown by it fails only that message.
+    // Stops after maxRecords records or maxBytes bytes of bodies and returns
+    // false, the client does not signal a ring that is not drained, so the
+    // caller has to come back on its own.
+    // The memory is written by the client, so every position is checked and
+    // a broken ring throws WRONG_PARAM
+    template<typename F>
+    bool Ring::drain( F push, unsigned int maxRecords, unsigned int maxBytes ) {
+        eventfd_t value;
+        eventfd_read( _submitFD, &value );
+
+        auto head = _layout->head.load( std::memory_order_relaxed );
+        unsigned int tail;
+        unsigned int countRecords = 0;
+        unsigned int bytes = 0;
+
+        do {
+            tail = _layout->tail.load( std::memory_order_acquire );
+
+            if( tail - head > SIZE_DATA || tail % ALIGN != 0 ) {
+                throw util::Error::WRONG_PARAM;
+            }
+
+            while( head != tail ) {
+                if( countRecords >= maxRecords || bytes >= maxBytes ) {
+                    _layout->head.store( head );
+                    return false;
+                }
+
+                auto offset = head & ( SIZE_DATA - 1 );
+                unsigned int length;
+                memcpy( &length, &_layout->data[offset], sizeof( unsigned int ) );
+
+                if( length == PADDING ) {
+                    if( SIZE_DATA - offset > tail - head ) {
+                        throw util::Error::WRONG_PARAM;
+                    }
+                    head += SIZE_DATA - offset;
+                    continue;
+                }
+
+                if( length > MAX_MESSAGE_SIZE || offset + _getSizeRecord( length ) > SIZE_DATA ) {
+                    throw util::Error::WRONG_PARAM;
+                }
+
+                auto size = _getSizeRecord( length );
+                if( size > tail - head ) {
+                    throw util::Error::WRONG_PARAM;
+                }
+
+                // the client pushed more messages than it has room for completions
+                auto completionsTail = _layout->completionsTail.load( std::memory_order_relaxed );
+                if( completionsTail - _layout->completionsHead.load( std::memory_order_acquire ) >= COUNT_COMPLETIONS ) {
+                    throw util::Error::WRONG_PARAM;
+                }
+
+                char uuid[util::UUID::LENGTH+1]{};
+
+                try {
+                    push( &_layout->data[offset + sizeof( unsigned int )], length, uuid );
+                    _complete( Protocol::CMD_OK, 0, uuid );
+                } catch( util::Error::Err err ) {
+                    _complete( Protocol::CMD_ERROR, err, uuid );
+                }
+
+                head += size;
+                countRecords++;
+                bytes += length;
+            }
+
+            _layout->head.store( head );
+        // a record pushed after the last look at the tail sees the old head and
+        // does not wake the server up
+        } while( _layout->tail.load() != tail );
+
+        return true;
+    }
+}
+
+#endif
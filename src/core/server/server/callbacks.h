@@ -9,6 +9,7 @@ namespace simq::core::server::server {
             virtual void send( unsigned int fd ) = 0;
             virtual void disconnect( unsigned int fd ) = 0;
             virtual void polling( unsigned int delay ) = 0;
+            virtual void wakeup() = 0;
     };
 }
 
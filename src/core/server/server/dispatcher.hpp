@@ -0,0 +1,109 @@
+#ifndef SIMQ_CORE_SERVER_SERVER_DISPATCHER
+#define SIMQ_CORE_SERVER_SERVER_DISPATCHER
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+#include "../../../util/spsc_queue.hpp"
+#include "../../../util/error.h"
+
+namespace simq::core::server::server {
+    // Passes items between worker threads: one SPSC mailbox for every
+    // (sender, receiver) pair and an eventfd per receiver to wake its epoll
+    template<typename T>
+    class Dispatcher {
+        private:
+            static const unsigned int MAILBOX_SIZE = 1024;
+
+            using Mailbox = util::SPSCQueue<T, MAILBOX_SIZE>;
+
+            unsigned int _countWorkers;
+            std::vector<int> _wakeFDs;
+            std::unique_ptr<std::unique_ptr<Mailbox>[]> _mailboxes;
+
+            Mailbox *_getMailbox( unsigned int from, unsigned int to );
+
+        public:
+            Dispatcher( unsigned int countWorkers );
+            ~Dispatcher();
+
+            unsigned int getCountWorkers();
+            int getWakeFD( unsigned int worker );
+
+            bool post( unsigned int from, unsigned int to, const T &item );
+
+            template<typename F>
+            void receive( unsigned int worker, F f );
+    };
+
+    template<typename T>
+    Dispatcher<T>::Dispatcher( unsigned int countWorkers ) {
+        _countWorkers = countWorkers;
+        _mailboxes = std::make_unique<std::unique_ptr<Mailbox>[]>( countWorkers * countWorkers );
+
+        for( unsigned int i = 0; i < countWorkers * countWorkers; i++ ) {
+            _mailboxes[i] = std::make_unique<Mailbox>();
+        }
+
+        for( unsigned int i = 0; i < countWorkers; i++ ) {
+            auto fd = eventfd( 0, EFD_NONBLOCK );
+            if( fd == -1 ) {
+                throw util::Error::SOCKET;
+            }
+            _wakeFDs.push_back( fd );
+        }
+    }
+
+    template<typename T>
+    Dispatcher<T>::~Dispatcher() {
+        for( auto it = _wakeFDs.begin(); it != _wakeFDs.end(); it++ ) {
+            ::close( *it );
+        }
+    }
+
+    template<typename T>
+    typename Dispatcher<T>::Mailbox *Dispatcher<T>::_getMailbox( unsigned int from, unsigned int to ) {
+        return _mailboxes[from * _countWorkers + to].get();
+    }
+
+    template<typename T>
+    unsigned int Dispatcher<T>::getCountWorkers() {
+        return _countWorkers;
+    }
+
+    template<typename T>
+    int Dispatcher<T>::getWakeFD( unsigned int worker ) {
+        return _wakeFDs[worker];
+    }
+
+    template<typename T>
+    bool Dispatcher<T>::post( unsigned int from, unsigned int to, const T &item ) {
+        if( !_getMailbox( from, to )->push( item ) ) {
+            return false;
+        }
+
+        eventfd_write( _wakeFDs[to], 1 );
+
+        return true;
+    }
+
+    template<typename T>
+    template<typename F>
+    void Dispatcher<T>::receive( unsigned int worker, F f ) {
+        eventfd_t value;
+        eventfd_read( _wakeFDs[worker], &value );
+
+        T item;
+
+        for( unsigned int from = 0; from < _countWorkers; from++ ) {
+            auto mailbox = _getMailbox( from, worker );
+
+            while( mailbox->pop( item ) ) {
+                f( item );
+            }
+        }
+    }
+}
+
+#endif
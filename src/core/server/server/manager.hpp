@@ -3,46 +3,105 @@
 
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <time.h>
 #include <random>
+#include <deque>
+#include <unordered_set>
+#include <string.h>
 #include "callbacks.h"
 #include "../../../util/error.h"
 #include "../../../util/timer.hpp"
 
 namespace simq::core::server::server {
     class Manager {
+        public:
+            // Counters since the last takeAcceptStats. The latency is the time
+            // in microseconds from the epoll_wait that reported the listener
+            // until a connection is registered, so it includes the events served
+            // before the listener and the iterations of a capped drain; the wait
+            // in the kernel backlog before the edge is not seen
+            struct AcceptStats {
+                unsigned long accepted = 0;
+                unsigned long failed = 0;
+                // drains stopped by MAX_ACCEPTS_PER_EVENT
+                unsigned long capped = 0;
+                unsigned long totalLatency = 0;
+                unsigned long maxLatency = 0;
+            };
+
         private:
+            struct Listener {
+                int fd = -1;
+                // the listener is edge triggered, connections left in the backlog
+                // are accepted on the next iteration without waiting for an edge
+                bool isCapped = false;
+                // accept failed for lack of resources, retried on the next polling
+                bool isPending = false;
+                // when the worker saw the connections in the backlog, see AcceptStats
+                unsigned long since = 0;
+            };
+
             Callbacks *_callbacks = nullptr;
 
             unsigned short int _port;
             unsigned int _ep;
-            unsigned int _sfd;
+            Listener _tcp;
+            // shared by all workers, see createUnixSocket
+            Listener _unix;
+            int _wakeFD = -1;
 
             const unsigned int USER_EVENTS = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET | EPOLLERR;
             const unsigned int SERVER_EVENTS = EPOLLIN | EPOLLET;
+            // one worker is woken up for a connection on the shared unix listener
+            const unsigned int SHARED_SERVER_EVENTS = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
             const unsigned int COUNT_EVENTS = 100;
-            const unsigned int COUNT_LISTEN = 500;
+            static const unsigned int COUNT_LISTEN = 4096;
             const unsigned int TIMEOUT = 30;
+            const unsigned int MAX_ACCEPTS_PER_EVENT = 256;
+
+            AcceptStats _acceptStats;
+
+            // connections that used up their budget with work left, served
+            // in turn after the events of every iteration, see schedule
+            std::deque<unsigned int> _ready;
+            std::unordered_set<unsigned int> _scheduled;
 
             unsigned int _createSocket();
             void _bindSocket();
-            bool _accept( int &cfd, unsigned int &ip );
+            void _listen( Listener &listener, unsigned int events );
+            void _serveReady();
+            void _acceptAll( Listener &listener, unsigned long ts );
+            bool _accept( int sfd, int &cfd, unsigned int &ip );
 
         public:
             Manager( unsigned short int port );
             void bindController( Callbacks *callbacks );
+            void bindWakeup( int fd );
+            void bindUnixSocket( int fd );
+            void watch( unsigned int fd );
+            void unwatch( unsigned int fd );
+            void watchEvent( int fd );
+            void schedule( unsigned int fd );
+            void unschedule( unsigned int fd );
             void run();
+
+            AcceptStats takeAcceptStats();
+
+            static int createUnixSocket( const char *path );
     };
 
     Manager::Manager( unsigned short int port ) {
         _port = port;
         _ep = epoll_create1( 0 );
-        _sfd = _createSocket();
+        _tcp.fd = _createSocket();
         _bindSocket();
     }
 
@@ -50,22 +109,89 @@ namespace simq::core::server::server {
         _callbacks = callbacks;
     }
 
+    void Manager::bindWakeup( int fd ) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+
+        if( epoll_ctl( _ep, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+            throw util::Error::SOCKET;
+        }
+
+        _wakeFD = fd;
+    }
+
+    void Manager::bindUnixSocket( int fd ) {
+        _unix.fd = fd;
+    }
+
+    // hands a connection accepted by another worker over to this epoll,
+    // readiness that is already pending is reported right away
+    void Manager::watch( unsigned int fd ) {
+        struct epoll_event ev;
+        ev.events = USER_EVENTS;
+        ev.data.fd = fd;
+
+        if( epoll_ctl( _ep, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+            throw util::Error::SOCKET;
+        }
+    }
+
+    void Manager::unwatch( unsigned int fd ) {
+        unschedule( fd );
+        epoll_ctl( _ep, EPOLL_CTL_DEL, fd, nullptr );
+    }
+
+    // an eventfd of a connection, its readiness is reported by recv
+    void Manager::watchEvent( int fd ) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = fd;
+
+        if( epoll_ctl( _ep, EPOLL_CTL_ADD, fd, &ev ) == -1 ) {
+            throw util::Error::SOCKET;
+        }
+    }
+
+    // The connection is edge triggered and was left with data in its buffer,
+    // it gets the recv callback again on the next iteration behind the others
+    void Manager::schedule( unsigned int fd ) {
+        if( _scheduled.insert( fd ).second ) {
+            _ready.push_back( fd );
+        }
+    }
+
+    // the fd stays in _ready until its turn and is skipped there
+    void Manager::unschedule( unsigned int fd ) {
+        _scheduled.erase( fd );
+    }
+
+    // every connection gets one turn, one scheduled again waits for the next iteration
+    void Manager::_serveReady() {
+        for( auto count = _ready.size(); count > 0; count-- ) {
+            auto fd = _ready.front();
+            _ready.pop_front();
+
+            if( _scheduled.erase( fd ) != 0 ) {
+                _callbacks->recv( fd );
+            }
+        }
+    }
+
     void Manager::run() {
         if( _callbacks == nullptr ) {
             return;
         }
 
-        if( listen( _sfd, COUNT_LISTEN ) == -1 ) {
+        if( listen( _tcp.fd, COUNT_LISTEN ) == -1 ) {
             throw util::Error::SOCKET;
         }
 
-        struct epoll_event server_event;
         struct epoll_event events[COUNT_EVENTS];
-        server_event.events = SERVER_EVENTS;
-        server_event.data.fd = _sfd;
 
-        if( epoll_ctl( _ep, EPOLL_CTL_ADD, _sfd, &server_event ) == -1 ) {
-            throw util::Error::SOCKET;
+        _listen( _tcp, SERVER_EVENTS );
+        if( _unix.fd != -1 ) {
+            _listen( _unix, SHARED_SERVER_EVENTS );
         }
 
         auto lastTS = util::Timer::tick();
@@ -77,12 +203,15 @@ namespace simq::core::server::server {
         auto randTimeout = buildRand( randomRange );
 
         while( true ) {
-            int count_events = epoll_wait( _ep, events, COUNT_EVENTS, TIMEOUT );
+            auto isBusy = _tcp.isCapped || _unix.isCapped || !_scheduled.empty();
+            int count_events = epoll_wait( _ep, events, COUNT_EVENTS, isBusy ? 0 : TIMEOUT );
 
             if( count_events == -1 ) {
                 continue;
             }
 
+            auto ts = util::Timer::tickMicro();
+
             for( unsigned int i = 0; i < count_events; i++ ) {
                 auto fd = events[i].data.fd;
 
@@ -90,17 +219,22 @@ namespace simq::core::server::server {
                     continue;
                 }
 
+                if( fd == _wakeFD ) {
+                    _callbacks->wakeup();
+                    continue;
+                }
+
+                // the event gives the connection its turn
+                unschedule( fd );
+
                 if( events[i].events & ( EPOLLRDHUP ) || events[i].events & ( EPOLLERR ) ) {
                     _callbacks->disconnect( fd );
                     close( fd );
                 } else if( events[i].events & EPOLLIN ) {
-                    if( fd == _sfd ) {
-                        int cfd;
-                        unsigned int ip;
-                        if( !_accept( cfd, ip ) ) {
-                            break;
-                        }
-                        _callbacks->connect( cfd, ip );
+                    if( fd == _tcp.fd ) {
+                        _acceptAll( _tcp, ts );
+                    } else if( fd == _unix.fd ) {
+                        _acceptAll( _unix, ts );
                     } else {
                         _callbacks->recv( fd );
                     }
@@ -109,10 +243,26 @@ namespace simq::core::server::server {
                 }
             }
 
+            _serveReady();
+
+            if( _tcp.isCapped ) {
+                _acceptAll( _tcp, ts );
+            }
+            if( _unix.isCapped ) {
+                _acceptAll( _unix, ts );
+            }
+
             auto localLastTS = util::Timer::tick();
             auto delay = localLastTS - lastTS;
 
             if( delay > randTimeout ) {
+                if( _tcp.isPending ) {
+                    _acceptAll( _tcp, ts );
+                }
+                if( _unix.isPending ) {
+                    _acceptAll( _unix, ts );
+                }
+
                 _callbacks->polling( delay );
                 randTimeout = buildRand( randomRange );
                 lastTS += delay;
@@ -120,25 +270,84 @@ namespace simq::core::server::server {
         }
     }
 
-    bool Manager::_accept( int &cfd, unsigned int &ip ) {
-        struct sockaddr_in addr_client;
+    Manager::AcceptStats Manager::takeAcceptStats() {
+        auto stats = _acceptStats;
+        _acceptStats = AcceptStats();
+
+        return stats;
+    }
+
+    // Accepts until the backlog is empty, at most MAX_ACCEPTS_PER_EVENT
+    // connections at a time so the connected clients are served in between.
+    // ts is the end of the last epoll_wait, a capped or pending drain keeps
+    // the time of the one that started it
+    void Manager::_acceptAll( Listener &listener, unsigned long ts ) {
+        if( !listener.isCapped && !listener.isPending ) {
+            listener.since = ts;
+        }
+
+        listener.isCapped = false;
+        listener.isPending = false;
+
+        for( unsigned int i = 0; i < MAX_ACCEPTS_PER_EVENT; i++ ) {
+            int cfd;
+            unsigned int ip;
+
+            if( !_accept( listener.fd, cfd, ip ) ) {
+                if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                    return;
+                }
+
+                _acceptStats.failed++;
+
+                if( errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM ) {
+                    listener.isPending = true;
+                    return;
+                }
+
+                continue;
+            }
+
+            _callbacks->connect( cfd, ip );
+
+            auto latency = util::Timer::tickMicro() - listener.since;
+            _acceptStats.accepted++;
+            _acceptStats.totalLatency += latency;
+            if( latency > _acceptStats.maxLatency ) {
+                _acceptStats.maxLatency = latency;
+            }
+        }
+
+        _acceptStats.capped++;
+        listener.isCapped = true;
+    }
+
+    void Manager::_listen( Listener &listener, unsigned int events ) {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.fd = listener.fd;
+
+        if( epoll_ctl( _ep, EPOLL_CTL_ADD, listener.fd, &ev ) == -1 ) {
+            throw util::Error::SOCKET;
+        }
+    }
+
+    bool Manager::_accept( int sfd, int &cfd, unsigned int &ip ) {
+        struct sockaddr_storage addr_client;
         socklen_t size = sizeof( addr_client );
-        cfd = ::accept(
-            _sfd,
+        cfd = ::accept4(
+            sfd,
             ( struct sockaddr * )&addr_client,
-            &size
+            &size,
+            SOCK_NONBLOCK | SOCK_CLOEXEC
         );
 
         if( cfd == -1 ) {
             return false;
         }
 
-        if( fcntl( cfd, F_SETFL, O_NONBLOCK ) == -1 ) {
-            close( cfd );
-            return false;
-        }
-
-        ip = addr_client.sin_addr.s_addr;
+        // clients of the unix listener have no address
+        ip = addr_client.ss_family == AF_INET ? ( ( struct sockaddr_in * )&addr_client )->sin_addr.s_addr : 0;
 
         struct epoll_event ev;
         ev.events = USER_EVENTS;
@@ -151,14 +360,10 @@ namespace simq::core::server::server {
             cfd,
             &ev
         ) == -1 ) {
+            close( cfd );
             return false;
         }
 
-        auto optval = 1;
-        setsockopt( cfd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof( optval ) );
-        optval = 0;
-        setsockopt( cfd, IPPROTO_TCP, TCP_CORK, &optval, sizeof( optval ) );
-
         return true;
     }
 
@@ -172,6 +377,8 @@ namespace simq::core::server::server {
         auto optval = 1;
         setsockopt( sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof( optval ) );
         setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof( optval ) );
+        // inherited by accepted connections
+        setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof( optval ) );
 
         auto res = fcntl( sock, F_SETFL, O_NONBLOCK );
         if( res == -1 ) {
@@ -187,9 +394,44 @@ namespace simq::core::server::server {
         addr.sin_port = htons( _port );
         addr.sin_addr.s_addr = htonl( INADDR_ANY );
 
-        if( bind( _sfd, ( struct sockaddr * )&addr, sizeof( addr ) ) == -1 ) {
+        if( bind( _tcp.fd, ( struct sockaddr * )&addr, sizeof( addr ) ) == -1 ) {
+            throw util::Error::SOCKET;
+        }
+    }
+
+    // A path can be bound only once, so the unix listener is created before
+    // the workers start and every one of them watches the same socket
+    int Manager::createUnixSocket( const char *path ) {
+        struct sockaddr_un addr;
+        memset( &addr, 0, sizeof( addr ) );
+        addr.sun_family = AF_UNIX;
+
+        if( strlen( path ) >= sizeof( addr.sun_path ) ) {
+            throw util::Error::WRONG_PARAM;
+        }
+        strcpy( addr.sun_path, path );
+
+        // the socket is left behind by the previous run
+        struct stat st;
+        if( lstat( path, &st ) == 0 && S_ISSOCK( st.st_mode ) ) {
+            unlink( path );
+        }
+
+        auto sock = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+        if( sock == -1 ) {
+            throw util::Error::SOCKET;
+        }
+
+        if(
+            bind( sock, ( struct sockaddr * )&addr, sizeof( addr ) ) == -1 ||
+            listen( sock, COUNT_LISTEN ) == -1
+        ) {
+            close( sock );
             throw util::Error::SOCKET;
         }
+
+        return sock;
     }
 }
 
@@ -4,13 +4,20 @@
 #include <unordered_map>
 #include <memory>
 #include <list>
+#include <set>
+#include <algorithm>
 #include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <string.h>
 #include "server/callbacks.h"
+#include "server/manager.hpp"
+#include "server/dispatcher.hpp"
 #include "../../util/error.h"
 #include "../../util/types.h"
 #include "../../util/uuid.hpp"
 #include "../../util/messages.hpp"
+#include "../../util/io.hpp"
 #include "access.hpp"
 #include "store.hpp"
 #include "changes.hpp"
@@ -18,11 +25,23 @@
 #include "protocol.hpp"
 #include "fsm.hpp"
 #include "sessions.hpp"
+#include "logger.hpp"
 
 // NO SAFE THREAD!!!
 
 namespace simq::core::server {
     class ServerController: public server::Callbacks {
+        public:
+            // a consumer or producer connection handed to the worker owning its
+            // channel in the experimental owner mode, see simq-server.cpp
+            struct Migration {
+                unsigned int fd;
+                unsigned int counter;
+                Sessions::Session *sess;
+            };
+
+            using Dispatcher = server::Dispatcher<Migration>;
+
         private:
             enum Type {
                 TYPE_COMMON,
@@ -32,32 +51,70 @@ namespace simq::core::server {
             };
             
             const unsigned int MAX_DELAY_SECONDS = 120;
+            const unsigned int MAX_PREFETCH = 256;
+            const unsigned int MAX_CREDITS = 65'536;
+            const unsigned int MAX_CMDS_PER_EVENT = 16;
+            // bytes of message bodies a connection moves in one turn
+            const unsigned int MAX_BYTES_PER_EVENT = 64 * 1'024;
+            const unsigned int MAX_ATTACHED_CHANNELS = 32;
+            const unsigned int ACCEPT_STATS_INTERVAL = 60'000;
             std::map<unsigned int, bool> _waitConsumers;
+            std::set<unsigned int> _subscribers;
+            std::vector<const char *> _uuids;
+
+            // the eventfd of a shared memory ring to the fd of its producer
+            std::unordered_map<unsigned int, unsigned int> _rings;
+
+            // the virtual fd of a stream to the fd of its multiplexed connection
+            std::unordered_map<unsigned int, unsigned int> _streams;
 
             struct WrapperSession {
-                Sessions::Session *sess;
-                unsigned int counter;
+                Sessions::Session *sess = nullptr;
+                unsigned int counter = 0;
             };
 
-            std::map<unsigned int, std::unique_ptr<WrapperSession>> _sessions;
+            // indexed by fd, sess is nullptr for fds this worker does not serve
+            std::vector<WrapperSession> _sessions;
+            // the sessions of the streams by their virtual fds
+            std::unordered_map<unsigned int, WrapperSession> _streamSessions;
             Access *_access = nullptr;
             q::Manager *_q = nullptr;
             Changes *_changes = nullptr;
             Store *_store = nullptr;
             Sessions *_sess = nullptr;
+            server::Manager *_server = nullptr;
+            Dispatcher *_dispatcher = nullptr;
+            unsigned int _worker = 0;
+            Tls *_tls = nullptr;
+            int _wakeFD = -1;
+            // milliseconds since the accept statistics were logged
+            unsigned int _acceptStatsDelay = 0;
 
             FSM::Code _getFSMByError( Sessions::Session *sess, util::Error::Err err );
 
+            WrapperSession *_getWrapper( unsigned int fd );
+            Sessions::Session *_getSession( unsigned int fd );
+            void _setSession( unsigned int fd, Sessions::Session *sess, unsigned int counter );
+
             void _close( unsigned int fd );
+            bool _migrate( unsigned int fd, Sessions::Session *sess );
+            void _receiveMigrations();
 
             bool _recvToPacket( unsigned int fd, Protocol::Packet *packet );
+            void _recvCmd( unsigned int fd, Sessions::Session *sess );
+            void _recvPipelined( unsigned int fd );
+            void _resume( unsigned int fd );
 
             void _recvSecure( unsigned int fd, Sessions::Session *sess );
+            void _checkSecureCmd( unsigned int fd, Sessions::Session *sess );
+            void _handshake( unsigned int fd, Sessions::Session *sess );
             void _recvVersion( unsigned int fd, Sessions::Session *sess );
             void _recvAuth( unsigned int fd, Sessions::Session *sess );
             void _authGroupCmd( unsigned int fd, Sessions::Session *sess );
             void _authConsumerCmd( unsigned int fd, Sessions::Session *sess );
             void _authProducerCmd( unsigned int fd, Sessions::Session *sess );
+            void _resumeCmd( unsigned int fd, Sessions::Session *sess );
+            void _getTokenCmd( unsigned int fd, Sessions::Session *sess );
             void _updateMyGroupPasswordCmd( unsigned int fd, Sessions::Session *sess );
             void _updateMyConsumerPasswordCmd( unsigned int fd, Sessions::Session *sess );
             void _updateConsumerPasswordCmd( unsigned int fd, Sessions::Session *sess );
@@ -87,14 +144,41 @@ namespace simq::core::server {
             void _removeProducerCmd( unsigned int fd, Sessions::Session *sess );
             void _clearQCmd( unsigned int fd, Sessions::Session *sess );
 
+            void _checkPopMessage( unsigned int fd, Sessions::Session *sess, unsigned int index );
+            unsigned int _popFromChannels( unsigned int fd, Sessions::Session *sess, unsigned int &length, char *uuid );
+            const char *_getTagChannel( Sessions::Session *sess );
             unsigned int _popMessage( unsigned int fd, Sessions::Session *sess );
             void _popMessageCmd( unsigned int fd, Sessions::Session *sess );
             void _removeMessageByUUIDCmd( unsigned int fd, Sessions::Session *sess );
+            void _removeMessagesCmd( unsigned int fd, Sessions::Session *sess );
+            void _setPrefetchCmd( unsigned int fd, Sessions::Session *sess );
+            void _ackMessage( unsigned int fd, Sessions::Session *sess, bool isCumulative );
+            void _ackMessageCmd( unsigned int fd, Sessions::Session *sess, bool isCumulative );
+            unsigned int _nextTag( Sessions::Session *sess );
+            void _attachChannelCmd( unsigned int fd, Sessions::Session *sess );
+
+            void _subscribeCmd( unsigned int fd, Sessions::Session *sess );
+            bool _recvSubscribedCmd( unsigned int fd, Sessions::Session *sess );
+            bool _pushToSubscriber( unsigned int fd, Sessions::Session *sess );
+            void _serveSubscriber( unsigned int fd, Sessions::Session *sess );
 
             void _pushMessageCmd( unsigned int fd, Sessions::Session *sess );
             void _pushSignalMessageCmd( unsigned int fd, Sessions::Session *sess );
             void _pushReplicaMessageCmd( unsigned int fd, Sessions::Session *sess );
 
+            void _openRingCmd( unsigned int fd, Sessions::Session *sess );
+            void _recvRing( unsigned int eventFD );
+            void _closeRing( Sessions::Session *sess );
+
+            void _openMuxCmd( unsigned int fd, Sessions::Session *sess );
+            void _recvMux( unsigned int fd, Sessions::Session *sess );
+            void _sendMux( unsigned int fd, Sessions::Session *sess );
+            void _closeMux( unsigned int fd, Sessions::Session *sess );
+            unsigned int _openStream( unsigned int fd, Sessions::Session *sess );
+            bool _isClosedStream( unsigned int streamFD );
+
+
+            void _logAcceptStats( unsigned int delay );
 
             void _copyAuthData(
                 Sessions::Session *sess,
@@ -109,15 +193,57 @@ namespace simq::core::server {
                 simq::core::server::Access *access,
                 simq::core::server::Changes *changes,
                 simq::core::server::q::Manager *q,
-                simq::core::server::Sessions *sess
-            ) : _store{store}, _access{access}, _changes{changes}, _q{q}, _sess{sess} {};
+                simq::core::server::Sessions *sess,
+                simq::core::server::server::Manager *server = nullptr,
+                Dispatcher *dispatcher = nullptr,
+                unsigned int worker = 0,
+                Tls *tls = nullptr
+            );
+            ~ServerController();
+
+            int getWakeFD();
+
             void connect( unsigned int fd, unsigned int ip );
             void recv( unsigned int fd );
             void send( unsigned int fd );
             void disconnect( unsigned int fd );
             void polling( unsigned int delay );
+            void wakeup();
     };
 
+    ServerController::ServerController(
+        simq::core::server::Store *store,
+        simq::core::server::Access *access,
+        simq::core::server::Changes *changes,
+        simq::core::server::q::Manager *q,
+        simq::core::server::Sessions *sess,
+        simq::core::server::server::Manager *server,
+        Dispatcher *dispatcher,
+        unsigned int worker,
+        Tls *tls
+    ) : _store{store}, _access{access}, _changes{changes}, _q{q}, _sess{sess},
+        _server{server}, _dispatcher{dispatcher}, _worker{worker}, _tls{tls} {
+        if( _dispatcher != nullptr ) {
+            _wakeFD = _dispatcher->getWakeFD( _worker );
+            return;
+        }
+
+        _wakeFD = eventfd( 0, EFD_NONBLOCK );
+        if( _wakeFD == -1 ) {
+            throw util::Error::SOCKET;
+        }
+    }
+
+    ServerController::~ServerController() {
+        if( _dispatcher == nullptr && _wakeFD != -1 ) {
+            ::close( _wakeFD );
+        }
+    }
+
+    int ServerController::getWakeFD() {
+        return _wakeFD;
+    }
+
     FSM::Code ServerController::_getFSMByError( Sessions::Session *sess, util::Error::Err err ) {
         switch( sess->type ) {
             case TYPE_GROUP:
@@ -143,6 +269,11 @@ namespace simq::core::server {
                     case util::Error::SOCKET:
                         return FSM::Code::CONSUMER_CLOSE;
                     case util::Error::WRONG_PASSWORD:
+                    case util::Error::WRONG_PARAM:
+                    case util::Error::EXCEED_LIMIT:
+                    case util::Error::NOT_FOUND:
+                    case util::Error::DUPLICATE_SESSION:
+                    case util::Error::DUPLICATE_CONSUMER:
                         return FSM::Code::CONSUMER_SEND_ERROR;
                     default:
                         return FSM::Code::CONSUMER_SEND_ERROR_WITH_CLOSE;
@@ -167,11 +298,78 @@ namespace simq::core::server {
         }
     }
 
+    // the fds of the kernel index the vector, virtual fds start far above them
+    ServerController::WrapperSession *ServerController::_getWrapper( unsigned int fd ) {
+        if( util::IO::isVirtual( fd ) ) {
+            auto it = _streamSessions.find( fd );
+            return it == _streamSessions.end() ? nullptr : &it->second;
+        }
+
+        return fd < _sessions.size() ? &_sessions[fd] : nullptr;
+    }
+
+    Sessions::Session *ServerController::_getSession( unsigned int fd ) {
+        auto wrapper = _getWrapper( fd );
+
+        return wrapper == nullptr ? nullptr : wrapper->sess;
+    }
+
+    void ServerController::_setSession( unsigned int fd, Sessions::Session *sess, unsigned int counter ) {
+        if( util::IO::isVirtual( fd ) ) {
+            if( sess == nullptr ) {
+                _streamSessions.erase( fd );
+            } else {
+                _streamSessions[fd] = { sess, counter };
+            }
+            return;
+        }
+
+        if( fd >= _sessions.size() ) {
+            _sessions.resize( fd + 1 );
+        }
+
+        _sessions[fd].sess = sess;
+        _sessions[fd].counter = counter;
+    }
+
     void ServerController::_close( unsigned int fd ) {
-        auto wrapper = _sessions[fd].get();
+        auto wrapper = _getWrapper( fd );
 
+        wrapper->sess->fsm = FSM::Code::COMMON_CLOSE;
+        _subscribers.erase( fd );
+        _server->unschedule( fd );
+        _closeRing( wrapper->sess );
+        _closeMux( fd, wrapper->sess );
         _sess->disconnect( fd, wrapper->counter );
-        ::close( fd );
+        _setSession( fd, nullptr, 0 );
+        _streams.erase( fd );
+        util::IO::close( fd );
+    }
+
+    bool ServerController::_migrate( unsigned int fd, Sessions::Session *sess ) {
+        // a stream stays with the worker of its connection
+        if( _dispatcher == nullptr || sess->isMuxed ) {
+            return false;
+        }
+
+        auto owner = sess->channel.getChannelID() % _dispatcher->getCountWorkers();
+        if( owner == _worker ) {
+            return false;
+        }
+
+        Migration migration{ fd, _getWrapper( fd )->counter, sess };
+
+        _server->unwatch( fd );
+
+        if( !_dispatcher->post( _worker, owner, migration ) ) {
+            // the owner's mailbox is full, keep serving the connection here
+            _server->watch( fd );
+            return false;
+        }
+
+        _setSession( fd, nullptr, 0 );
+
+        return true;
     }
 
     bool ServerController::_recvToPacket( unsigned int fd, Protocol::Packet *packet ) {
@@ -181,12 +379,42 @@ namespace simq::core::server {
     }
 
     void ServerController::_send( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !Protocol::send( fd, packet ) ) return;
 
+        auto sent = sess->fsm;
         sess->fsm = FSM::getNextCodeAfterSend( sess->fsm );
 
+        if( sent == FSM::Code::COMMON_SEND_CONFIRM_AUTH_CONSUMER
+            || sent == FSM::Code::COMMON_SEND_CONFIRM_AUTH_PRODUCER ) {
+            _migrate( fd, sess );
+            return;
+        }
+
+        if( sent == FSM::Code::CONSUMER_SEND_CONFIRM_SUBSCRIBE ) {
+            _serveSubscriber( fd, sess );
+            return;
+        }
+
+        if( sent == FSM::Code::COMMON_SEND_CONFIRM_TLS ) {
+            try {
+                sess->tls = _tls->accept( fd );
+            } catch( ... ) {
+                _close( fd );
+                return;
+            }
+
+            _handshake( fd, sess );
+            return;
+        }
+
+        if( sent == FSM::Code::COMMON_SEND_CONFIRM_MUX ) {
+            sess->mux = std::make_unique<Mux>( fd, _server );
+            _recvMux( fd, sess );
+            return;
+        }
+
         if( !FSM::isClose( sess->fsm ) ) {
             return;
         }
@@ -199,11 +427,26 @@ namespace simq::core::server {
     }
 
     void ServerController::_recvSecure( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
-        if( !Protocol::isCheckNoSecure( sess->packet.get() ) ) {
+        if( Protocol::isResume( packet ) ) {
+            _resumeCmd( fd, sess );
+            return;
+        }
+
+        if( Protocol::isOpenMux( packet ) ) {
+            _openMuxCmd( fd, sess );
+            return;
+        }
+
+        if( Protocol::isCheckSecure( packet ) ) {
+            _checkSecureCmd( fd, sess );
+            return;
+        }
+
+        if( !Protocol::isCheckNoSecure( &sess->packet ) ) {
             throw util::Error::WRONG_CMD;
         }
 
@@ -213,12 +456,64 @@ namespace simq::core::server {
         _send( fd, sess );
     }
 
+    // kernel TLS is only on TCP, the reply is the last open packet
+    // and the client starts the handshake after it
+    void ServerController::_checkSecureCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        int domain = 0;
+        socklen_t size = sizeof( domain );
+
+        if(
+            _tls == nullptr ||
+            sess->isMuxed ||
+            getsockopt( fd, SOL_SOCKET, SO_DOMAIN, &domain, &size ) == -1 ||
+            ( domain != AF_INET && domain != AF_INET6 )
+        ) {
+            throw util::Error::WRONG_CMD;
+        }
+
+        Protocol::prepareOk( packet );
+        sess->fsm = FSM::Code::COMMON_SEND_CONFIRM_TLS;
+
+        _send( fd, sess );
+    }
+
+    void ServerController::_handshake( unsigned int fd, Sessions::Session *sess ) {
+        try {
+            if( !Tls::handshake( sess->tls.get() ) ) {
+                return;
+            }
+        } catch( ... ) {
+            _close( fd );
+            return;
+        }
+
+        sess->tls.reset();
+        sess->isSecure = true;
+        sess->fsm = FSM::Code::COMMON_RECV_CMD_GET_VERSION;
+
+        // the client may have sent its first command with the end of the handshake
+        _recvPipelined( fd );
+    }
+
     void ServerController::_recvVersion( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
-        if( !Protocol::isGetVersion( sess->packet.get() ) ) {
+        // after the handshake of the secure mode
+        if( Protocol::isResume( packet ) ) {
+            _resumeCmd( fd, sess );
+            return;
+        }
+
+        if( Protocol::isOpenMux( packet ) && sess->isSecure ) {
+            _openMuxCmd( fd, sess );
+            return;
+        }
+
+        if( !Protocol::isGetVersion( &sess->packet ) ) {
             throw util::Error::WRONG_CMD;
         }
 
@@ -256,7 +551,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_authGroupCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = Protocol::getGroup( packet );
         auto password = Protocol::getPassword( packet );
@@ -272,15 +567,15 @@ namespace simq::core::server {
     }
 
     void ServerController::_authConsumerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = Protocol::getGroup( packet );
         auto channel = Protocol::getChannel( packet );
         auto login = Protocol::getConsumer( packet );
         auto password = Protocol::getPassword( packet );
 
-        _access->authConsumer( group, channel, login, password, fd );
-        _q->joinConsumer( group, channel, fd );
+        _access->authConsumer( group, channel, login, password, fd, sess->capability );
+        sess->channel = _q->joinConsumer( group, channel, fd );
         _copyAuthData( sess, group, channel, login );
 
         Protocol::prepareOk( packet );
@@ -291,15 +586,15 @@ namespace simq::core::server {
     }
 
     void ServerController::_authProducerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = Protocol::getGroup( packet );
         auto channel = Protocol::getChannel( packet );
         auto login = Protocol::getProducer( packet );
         auto password = Protocol::getPassword( packet );
 
-        _access->authProducer( group, channel, login, password, fd );
-        _q->joinProducer( group, channel, fd );
+        _access->authProducer( group, channel, login, password, fd, sess->capability );
+        sess->channel = _q->joinProducer( group, channel, fd );
         _copyAuthData( sess, group, channel, login );
 
         Protocol::prepareOk( packet );
@@ -309,8 +604,50 @@ namespace simq::core::server {
         _send( fd, sess );
     }
 
+    // A reconnect skips the authorization with a token, an open one skips the
+    // handshake too. The reply carries the token for the next reconnect
+    void ServerController::_resumeCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        _sess->resume( fd, sess, Protocol::getToken( packet ) );
+
+        auto group = sess->authData.get();
+        auto channel = &sess->authData.get()[sess->offsetChannel];
+
+        if( sess->type == Sessions::TYPE_CONSUMER ) {
+            sess->channel = _q->joinConsumer( group, channel, fd );
+            for( auto &attached : sess->attached ) {
+                attached.handle = _q->joinConsumer( group, attached.channel.c_str(), fd );
+            }
+            sess->fsm = FSM::Code::COMMON_SEND_CONFIRM_AUTH_CONSUMER;
+        } else {
+            sess->channel = _q->joinProducer( group, channel, fd );
+            sess->fsm = FSM::Code::COMMON_SEND_CONFIRM_AUTH_PRODUCER;
+        }
+
+        _sess->issueToken( sess );
+
+        Protocol::prepareToken( packet, sess->token );
+        _send( fd, sess );
+    }
+
+    // a client that can resume asks for a token after the authorization,
+    // the same token is returned until it is used
+    void ServerController::_getTokenCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        if( !sess->isToken ) {
+            _sess->issueToken( sess );
+        }
+
+        Protocol::prepareToken( packet, sess->token );
+        sess->fsm = sess->type == Sessions::TYPE_CONSUMER ? FSM::Code::CONSUMER_SEND : FSM::Code::PRODUCER_SEND;
+
+        _send( fd, sess );
+    }
+
     void ServerController::_recvAuth( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
@@ -320,13 +657,15 @@ namespace simq::core::server {
             _authConsumerCmd( fd, sess );
         } else if( Protocol::isAuthProducer( packet ) ) {
             _authProducerCmd( fd, sess );
+        } else if( Protocol::isResume( packet ) ) {
+            _resumeCmd( fd, sess );
         } else {
             throw util::Error::WRONG_CMD;
         }
     }
 
     void ServerController::_updateMyGroupPasswordCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto curPassword = Protocol::getPassword( packet );
         auto newPassword = Protocol::getNewPassword( packet );
@@ -350,7 +689,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_updateMyConsumerPasswordCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto curPassword = Protocol::getPassword( packet );
         auto newPassword = Protocol::getNewPassword( packet );
@@ -381,7 +720,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_updateConsumerPasswordCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto newPassword = Protocol::getPassword( packet );
 
@@ -411,7 +750,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_updateMyProducerPasswordCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto curPassword = Protocol::getPassword( packet );
         auto newPassword = Protocol::getNewPassword( packet );
@@ -442,7 +781,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_updateProducerPasswordCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto newPassword = Protocol::getPassword( packet );
 
@@ -472,7 +811,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_recvGroupCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
@@ -512,7 +851,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_recvConsumerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
@@ -522,13 +861,27 @@ namespace simq::core::server {
             _popMessageCmd( fd, sess );
         } else if( Protocol::isRemoveMessageByUUID( packet ) ) {
             _removeMessageByUUIDCmd( fd, sess );
+        } else if( Protocol::isRemoveMessages( packet ) ) {
+            _removeMessagesCmd( fd, sess );
+        } else if( Protocol::isSetPrefetch( packet ) ) {
+            _setPrefetchCmd( fd, sess );
+        } else if( Protocol::isAckMessage( packet ) ) {
+            _ackMessageCmd( fd, sess, false );
+        } else if( Protocol::isAckMessages( packet ) ) {
+            _ackMessageCmd( fd, sess, true );
+        } else if( Protocol::isSubscribe( packet ) ) {
+            _subscribeCmd( fd, sess );
+        } else if( Protocol::isAttachChannel( packet ) ) {
+            _attachChannelCmd( fd, sess );
+        } else if( Protocol::isGetToken( packet ) ) {
+            _getTokenCmd( fd, sess );
         } else {
             throw util::Error::WRONG_CMD;
         }
     }
 
     void ServerController::_recvConsumerCmdPartMessage( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
@@ -541,30 +894,25 @@ namespace simq::core::server {
     }
 
     void ServerController::_recvConsumerRemoveMessageCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
-        if( !Protocol::isRemoveMessage( packet ) ) {
-            auto group = sess->authData.get();
-            auto channel = &sess->authData.get()[sess->offsetChannel];
+        auto &channel = Sessions::getChannel( sess, sess->msgChannel );
 
+        if( !Protocol::isRemoveMessage( packet ) ) {
             if( !sess->isSignal ) {
-                _q->revertMessage( group, channel, fd, sess->msgID );
+                _q->revertMessage( channel, sess->msgID );
             } else {
-                _q->removeMessage( group, channel, fd, sess->msgID );
+                _q->removeMessage( channel, sess->msgID );
             }
             sess->msgID = 0;
 
             throw util::Error::WRONG_CMD;
         };
 
-        auto group = sess->authData.get();
-        auto channel = &sess->authData.get()[sess->offsetChannel];
-        auto login = &sess->authData.get()[sess->offsetLogin];
-
-        _access->checkPopMessage( group, channel, login, fd );
-        _q->removeMessage( group, channel, fd, sess->msgID );
+        _checkPopMessage( fd, sess, sess->msgChannel );
+        _q->removeMessage( channel, sess->msgID );
         sess->fsm = FSM::Code::CONSUMER_SEND;
         sess->msgID = 0;
 
@@ -573,39 +921,44 @@ namespace simq::core::server {
     }
 
     void ServerController::_recvProducerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         if( !_recvToPacket( fd, packet ) ) return;
 
         if( Protocol::isUpdatePassword( packet ) ) {
             _updateMyProducerPasswordCmd( fd, sess );
-        } else if( Protocol::isPushMessage( packet ) ) {
+        } else if( Protocol::isPushMessage( packet ) || Protocol::isPushKeyedMessage( packet ) ) {
             _pushMessageCmd( fd, sess );
         } else if( Protocol::isPushSignalMessage( packet ) ) {
             _pushSignalMessageCmd( fd, sess );
         } else if( Protocol::isPushReplicaMessage( packet ) ) {
             _pushReplicaMessageCmd( fd, sess );
+        } else if( Protocol::isOpenRing( packet ) ) {
+            _openRingCmd( fd, sess );
+        } else if( Protocol::isGetToken( packet ) ) {
+            _getTokenCmd( fd, sess );
         } else {
             throw util::Error::WRONG_CMD;
         }
     }
 
     void ServerController::_recvFromProducerPartMessage( unsigned int fd, Sessions::Session *sess ) {
-        auto packetMsg = sess->packetMsg.get();
-        auto packet = sess->packet.get();
+        auto packetMsg = &sess->packetMsg;
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = &sess->authData.get()[sess->offsetChannel];
         auto login = &sess->authData.get()[sess->offsetLogin];
 
         try {
-            _access->checkPushMessage( group, channel, login, fd );
-            auto l = _q->recv( group, channel, fd, sess->msgID );
+            _access->checkPushMessage( group, channel, login, fd, sess->capability );
+            auto l = _q->recv( sess->channel, fd, sess->msgID );
+            if( l == 0 ) return;
             Protocol::addWRLength( packetMsg, l );
 
             bool isSend = false;
             if( Protocol::isFull( packetMsg ) ) {
-                _q->pushMessage( group, channel, fd, sess->msgID );
+                _q->pushMessage( sess->channel, sess->msgID );
                 sess->msgID = 0;
                 sess->fsm = FSM::Code::PRODUCER_SEND_CONFIRM_PART_MESSAGE_END;
                 isSend = true;
@@ -632,15 +985,15 @@ namespace simq::core::server {
     }
 
     void ServerController::_recvFromProducerPartMessageNull( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
         auto residue = util::Messages::getResiduePart( packetMsg->length, packetMsg->wrLength );
         auto data = std::make_unique<char[]>( residue );
-        auto l = ::recv( fd, data.get(), residue, MSG_NOSIGNAL );
+        auto l = util::IO::recv( fd, data.get(), residue );
 
-        if( l == -1 ) {
-            if( errno != EAGAIN ) {
+        if( l <= 0 ) {
+            if( l == -1 && errno != EAGAIN ) {
                 _close( fd );
             }
             return;
@@ -657,19 +1010,24 @@ namespace simq::core::server {
     }
 
     void ServerController::_sendToConsumerPartMessage( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
-
-        auto group = sess->authData.get();
-        auto channel = &sess->authData.get()[sess->offsetChannel];
-        auto login = &sess->authData.get()[sess->offsetLogin];
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
         try {
-            _access->checkPopMessage( group, channel, login, fd );
-            auto l = _q->send( group, channel, fd, sess->msgID, packetMsg->wrLength );
+            _checkPopMessage( fd, sess, sess->msgChannel );
+            auto l = _q->send( Sessions::getChannel( sess, sess->msgChannel ), fd, sess->msgID, packetMsg->wrLength );
             Protocol::addWRLength( packetMsg, l );
 
-            if( Protocol::isFull( packetMsg ) ) {
+            if( Protocol::isFull( packetMsg ) && sess->msgTag != 0 ) {
+                // with a prefetch window the ack may come later, the consumer can pop again
+                sess->inFlight.push_back( { sess->msgTag, sess->msgID, sess->isSignal, sess->msgChannel } );
+                sess->msgID = 0;
+                sess->msgTag = 0;
+
+                Protocol::prepareOk( packet );
+                sess->fsm = FSM::Code::CONSUMER_SEND;
+                _send( fd, sess );
+            } else if( Protocol::isFull( packetMsg ) ) {
                 Protocol::prepareOk( packet );
                 sess->fsm = FSM::Code::CONSUMER_SEND_CONFIRM_PART_MESSAGE_END;
                 _send( fd, sess );
@@ -691,12 +1049,12 @@ namespace simq::core::server {
     }
 
     void ServerController::_sendToConsumerPartMessageNull( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
         auto residue = util::Messages::getResiduePart( packetMsg->length, packetMsg->wrLength );
         auto data = std::make_unique<char[]>( residue );
-        auto l = ::send( fd, data.get(), residue, MSG_NOSIGNAL );
+        auto l = util::IO::send( fd, data.get(), residue );
 
         if( l == -1 ) {
             if( errno != EAGAIN ) {
@@ -716,7 +1074,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_getChannelsCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
 
@@ -731,7 +1089,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_getChannelLimitMessagesCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -747,7 +1105,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_getConsumersCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -763,7 +1121,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_getProducersCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -779,7 +1137,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_addChannelCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -797,7 +1155,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_updateChannelLimitMessagesCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -815,7 +1173,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_removeChannelCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -831,7 +1189,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_addConsumerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -849,7 +1207,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_removeConsumerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -866,7 +1224,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_addProducerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -884,7 +1242,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_removeProducerCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -901,7 +1259,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_clearQCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = Protocol::getChannel( packet );
@@ -914,18 +1272,64 @@ namespace simq::core::server {
         _send( fd, sess );
     }
 
+    void ServerController::_checkPopMessage( unsigned int fd, Sessions::Session *sess, unsigned int index ) {
+        auto group = sess->authData.get();
+
+        if( index == 0 ) {
+            auto channel = &sess->authData.get()[sess->offsetChannel];
+            auto login = &sess->authData.get()[sess->offsetLogin];
+
+            _access->checkPopMessage( group, channel, login, fd, sess->capability );
+        } else {
+            auto attached = &sess->attached[index - 1];
+
+            _access->checkPopMessage( group, attached->channel.c_str(), attached->login.c_str(), fd, attached->capability );
+        }
+    }
+
+    // the channels of a consumer take turns, a pop starts
+    // with the one after the channel of the previous message
+    unsigned int ServerController::_popFromChannels(
+        unsigned int fd,
+        Sessions::Session *sess,
+        unsigned int &length,
+        char *uuid
+    ) {
+        unsigned int count = sess->attached.size() + 1;
+
+        for( unsigned int i = 0; i < count; i++ ) {
+            auto index = ( sess->nextChannel + i ) % count;
+
+            _checkPopMessage( fd, sess, index );
+            auto id = _q->popMessage( Sessions::getChannel( sess, index ), length, uuid );
+
+            if( id != 0 ) {
+                sess->msgChannel = index;
+                sess->nextChannel = ( index + 1 ) % count;
+                return id;
+            }
+        }
+
+        return 0;
+    }
+
+    // replies to a consumer with attached channels name the channel of the message
+    const char *ServerController::_getTagChannel( Sessions::Session *sess ) {
+        if( sess->attached.empty() ) {
+            return nullptr;
+        }
+
+        return Sessions::getChannelName( sess, sess->msgChannel );
+    }
+
     unsigned int ServerController::_popMessage( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
-        auto group = sess->authData.get();
-        auto channel = &sess->authData.get()[sess->offsetChannel];
-        auto login = &sess->authData.get()[sess->offsetLogin];
-        char uuid[util::UUID::LENGTH]{};
+        char uuid[util::UUID::LENGTH+1]{};
         unsigned int length;
 
-        _access->checkPopMessage( group, channel, login, fd );
-        auto id = _q->popMessage( group, channel, fd, length, uuid );
+        auto id = _popFromChannels( fd, sess, length, uuid );
 
         if( id == 0 ) {
             return id;
@@ -934,13 +1338,14 @@ namespace simq::core::server {
         Protocol::setLength( packetMsg, length );
         sess->fsm = FSM::Code::CONSUMER_SEND_MESSAGE_META;
         sess->msgID = id;
+        sess->msgTag = sess->prefetch > 1 ? _nextTag( sess ) : 0;
 
         if( uuid[0] ) {
             sess->isSignal = false;
-            Protocol::prepareMessageMetaPop( packet, length, uuid );
+            Protocol::prepareMessageMetaPop( packet, length, uuid, sess->msgTag, _getTagChannel( sess ) );
         } else {
             sess->isSignal = true;
-            Protocol::prepareSignalMessageMetaPop( packet, length );
+            Protocol::prepareSignalMessageMetaPop( packet, length, sess->msgTag, _getTagChannel( sess ) );
         }
 
         _send( fd, sess );
@@ -948,7 +1353,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_popMessageCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto delay = Protocol::getDelay( packet );
         if( delay > MAX_DELAY_SECONDS ) {
@@ -956,6 +1361,10 @@ namespace simq::core::server {
         }
         sess->delayConsumerWait = delay * 1000;
 
+        if( sess->inFlight.size() >= sess->prefetch ) {
+            throw util::Error::EXCEED_LIMIT;
+        }
+
         auto id = _popMessage( fd, sess );
 
         if( id != 0 ) {
@@ -973,7 +1382,7 @@ namespace simq::core::server {
     }
 
     void ServerController::_removeMessageByUUIDCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
+        auto packet = &sess->packet;
 
         auto group = sess->authData.get();
         auto channel = &sess->authData.get()[sess->offsetChannel];
@@ -981,27 +1390,306 @@ namespace simq::core::server {
 
         auto uuid = Protocol::getUUID( packet );
 
-        _access->checkPopMessage( group, channel, login, fd );
-        _q->removeMessage( group, channel, fd, uuid );
+        _access->checkPopMessage( group, channel, login, fd, sess->capability );
+        _q->removeMessage( sess->channel, uuid );
 
         Protocol::prepareOk( packet );
         sess->fsm = FSM::Code::CONSUMER_SEND;
         _send( fd, sess );
     }
 
+    void ServerController::_removeMessagesCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        auto group = sess->authData.get();
+        auto channel = &sess->authData.get()[sess->offsetChannel];
+        auto login = &sess->authData.get()[sess->offsetLogin];
+
+        _uuids.clear();
+        Protocol::getUUIDs( packet, _uuids );
+
+        _access->checkPopMessage( group, channel, login, fd, sess->capability );
+        _q->removeMessages( sess->channel, _uuids );
+
+        // the rest of the batch is removed, the reply lists the uuids that were not found
+        if( _uuids.empty() ) {
+            Protocol::prepareOk( packet );
+        } else {
+            std::list<std::string> missing( _uuids.begin(), _uuids.end() );
+            Protocol::prepareStringList( packet, missing );
+        }
+
+        sess->fsm = FSM::Code::CONSUMER_SEND;
+        _send( fd, sess );
+    }
+
+    void ServerController::_setPrefetchCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        auto prefetch = Protocol::getPrefetch( packet );
+        if( prefetch == 0 || prefetch > MAX_PREFETCH ) {
+            throw util::Error::WRONG_PARAM;
+        }
+
+        sess->prefetch = prefetch;
+        sess->inFlight.reserve( prefetch );
+
+        Protocol::prepareOk( packet );
+        sess->fsm = FSM::Code::CONSUMER_SEND;
+        _send( fd, sess );
+    }
+
+    unsigned int ServerController::_nextTag( Sessions::Session *sess ) {
+        sess->lastTag++;
+        if( sess->lastTag == 0 ) {
+            sess->lastTag++;
+        }
+
+        return sess->lastTag;
+    }
+
+    void ServerController::_ackMessage( unsigned int fd, Sessions::Session *sess, bool isCumulative ) {
+        auto packet = &sess->packet;
+
+        auto tag = Protocol::getTag( packet );
+        auto &inFlight = sess->inFlight;
+
+        _checkPopMessage( fd, sess, 0 );
+
+        if( isCumulative ) {
+            // tags grow with every pop, so everything up to tag is a prefix.
+            // Every channel is checked before anything is removed
+            auto end = inFlight.begin();
+            for( ; end != inFlight.end() && end->tag <= tag; end++ ) {
+                if( end->channel != 0 ) {
+                    _checkPopMessage( fd, sess, end->channel );
+                }
+            }
+
+            // a removed message must not stay in flight, _disconnect would revert it
+            auto it = inFlight.begin();
+            try {
+                for( ; it != end; it++ ) {
+                    _q->removeMessage( Sessions::getChannel( sess, it->channel ), it->msgID );
+                }
+            } catch( ... ) {
+                inFlight.erase( inFlight.begin(), it );
+                throw;
+            }
+            inFlight.erase( inFlight.begin(), end );
+        } else {
+            auto it = std::find_if( inFlight.begin(), inFlight.end(), [tag]( const Sessions::InFlight &item ) {
+                return item.tag == tag;
+            } );
+
+            if( it == inFlight.end() ) {
+                throw util::Error::NOT_FOUND;
+            }
+
+            if( it->channel != 0 ) {
+                _checkPopMessage( fd, sess, it->channel );
+            }
+            _q->removeMessage( Sessions::getChannel( sess, it->channel ), it->msgID );
+            inFlight.erase( it );
+        }
+    }
+
+    void ServerController::_ackMessageCmd( unsigned int fd, Sessions::Session *sess, bool isCumulative ) {
+        auto packet = &sess->packet;
+
+        _ackMessage( fd, sess, isCumulative );
+
+        Protocol::prepareOk( packet );
+        sess->fsm = FSM::Code::CONSUMER_SEND;
+        _send( fd, sess );
+    }
+
+    // every channel of a group has its own consumers, so a channel is attached
+    // with a login of it; the session stays bound to the channel it logged in to
+    void ServerController::_attachChannelCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        auto group = sess->authData.get();
+        auto channel = Protocol::getChannel( packet );
+        auto login = Protocol::getConsumer( packet );
+        auto password = Protocol::getPassword( packet );
+
+        if( sess->attached.size() >= MAX_ATTACHED_CHANNELS ) {
+            throw util::Error::EXCEED_LIMIT;
+        }
+
+        Sessions::Attached attached{ channel, login, {}, {} };
+
+        _access->authConsumer( group, channel, login, password, fd, attached.capability );
+
+        try {
+            attached.handle = _q->joinConsumer( group, channel, fd );
+            sess->attached.push_back( std::move( attached ) );
+        } catch( ... ) {
+            _q->leaveConsumer( attached.handle, fd );
+            _access->logoutConsumer( group, channel, login, fd );
+            throw;
+        }
+
+        Protocol::prepareOk( packet );
+        sess->fsm = FSM::Code::CONSUMER_SEND;
+        _send( fd, sess );
+    }
+
+    void ServerController::_subscribeCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        auto credits = Protocol::getCredits( packet );
+        if( credits > MAX_CREDITS ) {
+            throw util::Error::WRONG_PARAM;
+        }
+
+        _q->subscribeConsumer( sess->channel, _wakeFD );
+        for( auto &attached : sess->attached ) {
+            _q->subscribeConsumer( attached.handle, _wakeFD );
+        }
+        _waitConsumers.erase( fd );
+        _subscribers.insert( fd );
+
+        sess->credits = credits;
+        sess->packetPush = std::make_unique<Protocol::Packet>();
+
+        Protocol::prepareOk( packet );
+        sess->fsm = FSM::Code::CONSUMER_SEND_CONFIRM_SUBSCRIBE;
+        _send( fd, sess );
+    }
+
+    // credits and acks of a subscribed consumer get no reply,
+    // the stream of messages is the only thing the server writes
+    bool ServerController::_recvSubscribedCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        if( !_recvToPacket( fd, packet ) ) return false;
+
+        if( Protocol::isCredit( packet ) ) {
+            auto credits = sess->credits + Protocol::getCredits( packet );
+            if( credits > MAX_CREDITS || credits < sess->credits ) {
+                throw util::Error::EXCEED_LIMIT;
+            }
+            sess->credits = credits;
+        } else if( Protocol::isAckMessage( packet ) ) {
+            _ackMessage( fd, sess, false );
+        } else if( Protocol::isAckMessages( packet ) ) {
+            _ackMessage( fd, sess, true );
+        } else {
+            throw util::Error::WRONG_CMD;
+        }
+
+        return true;
+    }
+
+    bool ServerController::_pushToSubscriber( unsigned int fd, Sessions::Session *sess ) {
+        if( sess->credits == 0 ) {
+            return false;
+        }
+
+        auto packetPush = sess->packetPush.get();
+        auto packetMsg = &sess->packetMsg;
+
+        char uuid[util::UUID::LENGTH+1]{};
+        unsigned int length;
+
+        auto id = _popFromChannels( fd, sess, length, uuid );
+
+        if( id == 0 ) {
+            return false;
+        }
+
+        Protocol::setLength( packetMsg, length );
+        sess->msgID = id;
+        sess->msgTag = _nextTag( sess );
+        sess->isSignal = uuid[0] == 0;
+        sess->credits--;
+
+        if( !sess->isSignal ) {
+            Protocol::prepareMessageMetaPop( packetPush, length, uuid, sess->msgTag, _getTagChannel( sess ) );
+        } else {
+            Protocol::prepareSignalMessageMetaPop( packetPush, length, sess->msgTag, _getTagChannel( sess ) );
+        }
+
+        sess->fsm = FSM::Code::CONSUMER_SUBSCRIBED_SEND_MESSAGE_META;
+
+        return true;
+    }
+
+    // A message goes out as its meta packet followed by the raw body,
+    // without waiting for the consumer between parts. Received commands and
+    // pushed messages count against MAX_CMDS_PER_EVENT, bodies against
+    // MAX_BYTES_PER_EVENT; a used up budget puts it back on the ready list
+    void ServerController::_serveSubscriber( unsigned int fd, Sessions::Session *sess ) {
+        auto packetMsg = &sess->packetMsg;
+        unsigned int cmds = 0;
+        unsigned int bytes = 0;
+
+        try {
+            while( true ) {
+                if( cmds >= MAX_CMDS_PER_EVENT || bytes >= MAX_BYTES_PER_EVENT ) {
+                    _resume( fd );
+                    return;
+                }
+
+                switch( sess->fsm ) {
+                    case FSM::Code::CONSUMER_SUBSCRIBED_RECV_CMD:
+                        if( _recvSubscribedCmd( fd, sess ) ) {
+                            cmds++;
+                            break;
+                        }
+                        if( !_pushToSubscriber( fd, sess ) ) {
+                            return;
+                        }
+                        cmds++;
+                        break;
+                    case FSM::Code::CONSUMER_SUBSCRIBED_SEND_MESSAGE_META:
+                        if( !Protocol::send( fd, sess->packetPush.get() ) ) {
+                            return;
+                        }
+                        sess->fsm = FSM::getNextCodeAfterSend( sess->fsm );
+                        break;
+                    case FSM::Code::CONSUMER_SUBSCRIBED_SEND_MESSAGE:
+                        if( !Protocol::isFull( packetMsg ) ) {
+                            auto l = _q->send( Sessions::getChannel( sess, sess->msgChannel ), fd, sess->msgID, packetMsg->wrLength );
+                            if( l == 0 ) {
+                                return;
+                            }
+                            Protocol::addWRLength( packetMsg, l );
+                            bytes += l;
+                            break;
+                        }
+
+                        sess->inFlight.push_back( { sess->msgTag, sess->msgID, sess->isSignal, sess->msgChannel } );
+                        sess->msgID = 0;
+                        sess->msgTag = 0;
+                        sess->fsm = FSM::Code::CONSUMER_SUBSCRIBED_RECV_CMD;
+                        break;
+                    default:
+                        return;
+                }
+            }
+        } catch( ... ) {
+            _close( fd );
+        }
+    }
+
     void ServerController::_pushMessageCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
         auto length = Protocol::getLength( packet );
         auto group = sess->authData.get();
         auto channel = &sess->authData.get()[sess->offsetChannel];
         auto login = &sess->authData.get()[sess->offsetLogin];
 
-        _access->checkPushMessage( group, channel, login, fd );
-        char uuid[util::UUID::LENGTH];
+        _access->checkPushMessage( group, channel, login, fd, sess->capability );
+        char uuid[util::UUID::LENGTH+1]{};
 
-        sess->msgID = _q->createMessageForQ( group, channel, fd, length, uuid );
+        auto key = Protocol::isPushKeyedMessage( packet ) ? Protocol::getKey( packet ) : nullptr;
+
+        sess->msgID = _q->createMessageForQ( sess->channel, length, uuid, key );
         Protocol::setLength( packetMsg, length );
 
         Protocol::prepareMessageMetaPush( packet, uuid );
@@ -1011,17 +1699,17 @@ namespace simq::core::server {
     }
 
     void ServerController::_pushSignalMessageCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
         auto length = Protocol::getLength( packet );
         auto group = sess->authData.get();
         auto channel = &sess->authData.get()[sess->offsetChannel];
         auto login = &sess->authData.get()[sess->offsetLogin];
 
-        _access->checkPushMessage( group, channel, login, fd );
+        _access->checkPushMessage( group, channel, login, fd, sess->capability );
 
-        sess->msgID = _q->createMessageForBroadcast( group, channel, fd, length );
+        sess->msgID = _q->createMessageForBroadcast( sess->channel, length );
         Protocol::setLength( packetMsg, length );
 
         Protocol::prepareOk( packet );
@@ -1031,8 +1719,8 @@ namespace simq::core::server {
     }
     
     void ServerController::_pushReplicaMessageCmd( unsigned int fd, Sessions::Session *sess ) {
-        auto packet = sess->packet.get();
-        auto packetMsg = sess->packetMsg.get();
+        auto packet = &sess->packet;
+        auto packetMsg = &sess->packetMsg;
 
         auto length = Protocol::getLength( packet );
         auto uuid = Protocol::getUUID( packet );
@@ -1040,9 +1728,9 @@ namespace simq::core::server {
         auto channel = &sess->authData.get()[sess->offsetChannel];
         auto login = &sess->authData.get()[sess->offsetLogin];
 
-        _access->checkPushMessage( group, channel, login, fd );
+        _access->checkPushMessage( group, channel, login, fd, sess->capability );
 
-        sess->msgID = _q->createMessageForReplication( group, channel, fd, length, uuid );
+        sess->msgID = _q->createMessageForReplication( sess->channel, length, uuid );
         Protocol::setLength( packetMsg, length );
 
         Protocol::prepareOk( packet );
@@ -1051,16 +1739,271 @@ namespace simq::core::server {
         _send( fd, sess );
     }
 
+    // The ring and both eventfds are passed to the client with SCM_RIGHTS,
+    // so a ring is opened only over the unix listener
+    void ServerController::_openRingCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        int domain = 0;
+        socklen_t size = sizeof( domain );
+
+        if( sess->ring || sess->isMuxed || getsockopt( fd, SOL_SOCKET, SO_DOMAIN, &domain, &size ) == -1 || domain != AF_UNIX ) {
+            throw util::Error::WRONG_CMD;
+        }
+
+        auto group = sess->authData.get();
+        auto channel = &sess->authData.get()[sess->offsetChannel];
+        auto login = &sess->authData.get()[sess->offsetLogin];
+
+        _access->checkPushMessage( group, channel, login, fd, sess->capability );
+
+        sess->ring = std::make_unique<Ring>();
+        _server->watchEvent( sess->ring->getSubmitFD() );
+        _rings[sess->ring->getSubmitFD()] = fd;
+
+        int fds[3] = {
+            sess->ring->getMemFD(),
+            sess->ring->getSubmitFD(),
+            sess->ring->getCompleteFD(),
+        };
+
+        Protocol::prepareRing( packet, Ring::SIZE_DATA, Ring::COUNT_COMPLETIONS );
+        sess->fsm = FSM::Code::PRODUCER_SEND;
+
+        Protocol::sendRights( fd, packet, fds, 3 );
+        _send( fd, sess );
+    }
+
+    // every message is copied once, from the ring to the buffer of the queue
+    void ServerController::_recvRing( unsigned int eventFD ) {
+        auto it = _rings.find( eventFD );
+        if( it == _rings.end() ) return;
+
+        auto fd = it->second;
+        auto sess = _getSession( fd );
+        if( sess == nullptr || !sess->ring ) return;
+
+        auto group = sess->authData.get();
+        auto channel = &sess->authData.get()[sess->offsetChannel];
+        auto login = &sess->authData.get()[sess->offsetLogin];
+
+        try {
+            auto isDrained = sess->ring->drain( [&]( const char *data, unsigned int length, char *uuid ) {
+                _access->checkPushMessage( group, channel, login, fd, sess->capability );
+
+                auto id = _q->createMessageForQ( sess->channel, length, uuid );
+
+                try {
+                    _q->write( sess->channel, id, data, length );
+                } catch( ... ) {
+                    _q->removeMessage( sess->channel, id );
+                    throw;
+                }
+
+                _q->pushMessage( sess->channel, id );
+            }, MAX_CMDS_PER_EVENT, MAX_BYTES_PER_EVENT );
+
+            // the other connections go first, the rest of the ring waits on the ready list
+            if( !isDrained ) {
+                _resume( eventFD );
+            }
+        } catch( ... ) {
+            _close( fd );
+        }
+    }
+
+    // the client holds the same eventfd, closing ours does not remove it from epoll
+    void ServerController::_closeRing( Sessions::Session *sess ) {
+        if( !sess->ring ) return;
+
+        _server->unwatch( sess->ring->getSubmitFD() );
+        _rings.erase( sess->ring->getSubmitFD() );
+        sess->ring.reset();
+    }
+
+    void ServerController::_openMuxCmd( unsigned int fd, Sessions::Session *sess ) {
+        auto packet = &sess->packet;
+
+        if( sess->isMuxed ) {
+            throw util::Error::WRONG_CMD;
+        }
+
+        Protocol::prepareOk( packet );
+        sess->fsm = FSM::Code::COMMON_SEND_CONFIRM_MUX;
+
+        _send( fd, sess );
+    }
+
+    void ServerController::_recvMux( unsigned int fd, Sessions::Session *sess ) {
+        try {
+            sess->mux->recv( [this, fd, sess]( unsigned int ) {
+                return _openStream( fd, sess );
+            } );
+            sess->mux->send();
+        } catch( ... ) {
+            _close( fd );
+        }
+    }
+
+    void ServerController::_sendMux( unsigned int fd, Sessions::Session *sess ) {
+        try {
+            sess->mux->send();
+        } catch( ... ) {
+            _close( fd );
+        }
+    }
+
+    // the sessions of the streams are closed with the connection
+    void ServerController::_closeMux( unsigned int fd, Sessions::Session *sess ) {
+        if( !sess->mux ) return;
+
+        std::vector<unsigned int> streamFDs;
+        for( auto &item : _streams ) {
+            if( item.second == fd ) {
+                streamFDs.push_back( item.first );
+            }
+        }
+
+        for( auto streamFD : streamFDs ) {
+            auto streamSess = _getSession( streamFD );
+            if( streamSess == nullptr ) continue;
+
+            if( FSM::isConsumer( streamSess->fsm ) ) {
+                _waitConsumers.erase( streamFD );
+            }
+            _close( streamFD );
+        }
+
+        sess->mux.reset();
+    }
+
+    // a stream is served as a connection of its own on a virtual fd of the mux
+    unsigned int ServerController::_openStream( unsigned int fd, Sessions::Session *sess ) {
+        auto streamFD = util::IO::open( sess->mux.get() );
+
+        connect( streamFD, 0 );
+
+        auto streamSess = _getSession( streamFD );
+        if( streamSess == nullptr ) {
+            throw util::Error::SOCKET;
+        }
+
+        streamSess->isMuxed = true;
+        // streams of a connection in the secure mode are secure too
+        streamSess->isSecure = sess->isSecure;
+
+        _streams[streamFD] = fd;
+
+        return streamFD;
+    }
+
+    // the client closed the stream, what it sent before is dropped like on a socket with EPOLLRDHUP
+    bool ServerController::_isClosedStream( unsigned int streamFD ) {
+        auto it = _streams.find( streamFD );
+        if( it == _streams.end() ) return false;
+
+        auto sess = _getSession( it->second );
+
+        return sess != nullptr && sess->mux && sess->mux->isClosed( streamFD );
+    }
+
     void ServerController::connect( unsigned int fd, unsigned int ip ) {
-        auto wrapper = std::make_unique<WrapperSession>();
+        unsigned int counter;
 
-        wrapper->sess = _sess->connect( fd, wrapper->counter );
-        _sessions[fd] = std::move( wrapper );
+        try {
+            auto sess = _sess->connect( fd, counter );
+            _setSession( fd, sess, counter );
+        } catch( ... ) {
+            util::IO::close( fd );
+        }
+    }
+
+    // Commands are read one frame at a time and every reply is sent before
+    // the next frame, so a pipelining client gets its replies in order.
+    // The loop stops when the socket is drained or a reply has to wait for
+    // EPOLLOUT; with EPOLLET nothing else would wake it for frames that are
+    // already buffered, so a used up budget puts it on the ready list of the
+    // server manager and the other connections go first.
+    void ServerController::_recvPipelined( unsigned int fd ) {
+        unsigned int bytes = 0;
+
+        for( unsigned int i = 0; i < MAX_CMDS_PER_EVENT && bytes < MAX_BYTES_PER_EVENT; i++ ) {
+            auto sess = _getSession( fd );
+            if( sess == nullptr ) return;
+
+            if( !FSM::isRecv( sess->fsm ) || _waitConsumers.find( fd ) != _waitConsumers.end() ) {
+                return;
+            }
+
+            auto packet = &sess->packet;
+            auto packetMsg = &sess->packetMsg;
+            auto isPart = sess->fsm == FSM::Code::PRODUCER_RECV_PART_MESSAGE
+                || sess->fsm == FSM::Code::PRODUCER_RECV_PART_MESSAGE_NULL;
+            auto wrLength = packetMsg->wrLength;
+
+            _recvCmd( fd, sess );
+
+            // closed, or migrated to its owner that may already be receiving into the packet
+            if( _getSession( fd ) != sess ) {
+                return;
+            }
+
+            if( isPart ? packetMsg->wrLength == wrLength : packet->isRecvMeta || packet->isRecvBody ) {
+                return;
+            }
+
+            if( isPart && packetMsg->wrLength > wrLength ) {
+                bytes += packetMsg->wrLength - wrLength;
+            }
+        }
+
+        _resume( fd );
+    }
+
+    void ServerController::_resume( unsigned int fd ) {
+        _server->schedule( fd );
     }
 
     void ServerController::recv( unsigned int fd ) {
-        auto sess = _sessions[fd]->sess;
+        auto sess = _getSession( fd );
+        if( sess == nullptr ) {
+            _recvRing( fd );
+            return;
+        }
+
+        if( sess->isMuxed && _isClosedStream( fd ) ) {
+            if( FSM::isConsumer( sess->fsm ) ) {
+                _waitConsumers.erase( fd );
+            }
+            _close( fd );
+            return;
+        }
 
+        if( sess->fsm == FSM::Code::COMMON_MUX ) {
+            _recvMux( fd, sess );
+            return;
+        }
+
+        if( sess->fsm == FSM::Code::COMMON_TLS_HANDSHAKE ) {
+            _handshake( fd, sess );
+            return;
+        }
+
+        if( FSM::isSubscribed( sess->fsm ) ) {
+            _serveSubscriber( fd, sess );
+            return;
+        }
+
+        // EPOLLIN and EPOLLOUT together are reported here, finish the reply first
+        if( !FSM::isRecv( sess->fsm ) ) {
+            send( fd );
+            return;
+        }
+
+        _recvPipelined( fd );
+    }
+
+    void ServerController::_recvCmd( unsigned int fd, Sessions::Session *sess ) {
         try {
             switch( sess->fsm ) {
                 case FSM::Code::COMMON_RECV_CMD_CHECK_SECURE:
@@ -1107,7 +2050,7 @@ namespace simq::core::server {
                 _close( fd );
             } else {
                 try {
-                    Protocol::prepareError( sess->packet.get(), util::Error::getDescription( err ) );
+                    Protocol::prepareError( &sess->packet, util::Error::getDescription( err ) );
                     _send( fd, sess );
                 } catch( ... ) {
                     if( FSM::isConsumer( sess->fsm ) ) {
@@ -1126,7 +2069,28 @@ namespace simq::core::server {
     }
 
     void ServerController::send( unsigned int fd ) {
-        auto sess = _sessions[fd]->sess;
+        auto sess = _getSession( fd );
+        if( sess == nullptr ) return;
+
+        if( sess->fsm == FSM::Code::COMMON_MUX ) {
+            _sendMux( fd, sess );
+            return;
+        }
+
+        if( sess->fsm == FSM::Code::COMMON_TLS_HANDSHAKE ) {
+            _handshake( fd, sess );
+            return;
+        }
+
+        if( FSM::isSubscribed( sess->fsm ) ) {
+            _serveSubscriber( fd, sess );
+            return;
+        }
+
+        // nothing to send, the packet may hold a half received command
+        if( FSM::isRecv( sess->fsm ) ) {
+            return;
+        }
 
         try {
             switch( sess->fsm ) {
@@ -1145,26 +2109,98 @@ namespace simq::core::server {
                 _waitConsumers.erase( fd );
             }
             _close( fd );
+            return;
         }
+
+        _recvPipelined( fd );
     }
 
     void ServerController::disconnect( unsigned int fd ) {
-        auto wrapper = _sessions[fd].get();
+        if( _getSession( fd ) == nullptr ) return;
+
+        auto wrapper = &_sessions[fd];
 
         if( FSM::isConsumer( wrapper->sess->fsm ) ) {
             _waitConsumers.erase( fd );
         }
 
+        _subscribers.erase( fd );
+        _closeRing( wrapper->sess );
+        _closeMux( fd, wrapper->sess );
         _sess->disconnect( fd, wrapper->counter );
+        wrapper->sess = nullptr;
+    }
+
+    void ServerController::wakeup() {
+        if( _dispatcher == nullptr ) {
+            eventfd_t value;
+            eventfd_read( _wakeFD, &value );
+        } else {
+            _receiveMigrations();
+        }
+
+        for( auto it = _subscribers.begin(); it != _subscribers.end(); ) {
+            auto fd = *it++;
+
+            auto sess = _getSession( fd );
+            if( sess == nullptr ) continue;
+
+            if( sess->fsm == FSM::Code::CONSUMER_SUBSCRIBED_RECV_CMD ) {
+                _serveSubscriber( fd, sess );
+            }
+        }
+    }
+
+    void ServerController::_receiveMigrations() {
+        _dispatcher->receive( _worker, [this]( const Migration &migration ) {
+            _setSession( migration.fd, migration.sess, migration.counter );
+
+            try {
+                _server->watch( migration.fd );
+            } catch( ... ) {
+                _close( migration.fd );
+            }
+        } );
+    }
+
+    // a line per worker every ACCEPT_STATS_INTERVAL, if it accepted anything
+    void ServerController::_logAcceptStats( unsigned int delay ) {
+        _acceptStatsDelay += delay;
+        if( _acceptStatsDelay < ACCEPT_STATS_INTERVAL ) {
+            return;
+        }
+
+        _acceptStatsDelay = 0;
+
+        auto stats = _server->takeAcceptStats();
+        if( stats.accepted == 0 && stats.failed == 0 ) {
+            return;
+        }
+
+        auto average = stats.accepted == 0 ? 0 : stats.totalLatency / stats.accepted;
+
+        std::list<Logger::Detail> details;
+        Logger::addItemToDetails( details, "worker", std::to_string( _worker ).c_str() );
+        Logger::addItemToDetails( details, "accepted", std::to_string( stats.accepted ).c_str() );
+        Logger::addItemToDetails( details, "failed", std::to_string( stats.failed ).c_str() );
+        Logger::addItemToDetails( details, "capped", std::to_string( stats.capped ).c_str() );
+        Logger::addItemToDetails( details, "averageLatencyMicro", std::to_string( average ).c_str() );
+        Logger::addItemToDetails( details, "maxLatencyMicro", std::to_string( stats.maxLatency ).c_str() );
+
+        Logger::success( Logger::OP_ACCEPT_STATS, 0, details );
     }
 
     void ServerController::polling( unsigned int delay ) {
+        _logAcceptStats( delay );
+
         for( auto it = _waitConsumers.begin(); it != _waitConsumers.end(); ) {
             auto fd = it->first;
 
-            auto itSess = _sessions.find( fd );
-            if( itSess == _sessions.end() ) continue;
-            auto sess = itSess->second->sess;
+            auto sess = _getSession( fd );
+            if( sess == nullptr ) {
+                _waitConsumers.erase( it++ );
+                continue;
+            }
 
             sess->delayConsumerWait -= delay;
 
@@ -1172,15 +2208,17 @@ namespace simq::core::server {
                 auto msgId = _popMessage( fd, sess );
                 if( msgId == 0 ) {
                     if( sess->delayConsumerWait <= 0 ) {
-                        Protocol::prepareNoneMessageMetaPop( sess->packet.get() );
+                        Protocol::prepareNoneMessageMetaPop( &sess->packet );
                         sess->fsm = FSM::Code::CONSUMER_SEND;
                         _send( fd, sess );
                         _waitConsumers.erase( it++ );
+                        _resume( fd );
                     } else {
                         ++it;
                     }
                 } else {
                     _waitConsumers.erase( it++ );
+                    _resume( fd );
                 }
             } catch( util::Error::Err err ) {
                 _waitConsumers.erase( it++ );
@@ -1188,7 +2226,7 @@ namespace simq::core::server {
                     _close( fd );
                 } else {
                     sess->fsm = FSM::Code::CONSUMER_SEND_ERROR;
-                    Protocol::prepareError( sess->packet.get(), util::Error::getDescription( err ) );
+                    Protocol::prepareError( &sess->packet, util::Error::getDescription( err ) );
                     _send( fd, sess );
                 }
             } catch ( ... ) {
@@ -2,10 +2,16 @@
 #define SIMQ_CORE_SERVER_SESSIONS
 
 #include <vector>
+#include <string>
 #include <memory>
-#include <mutex>
+#include <atomic>
+#include <string.h>
 #include "protocol.hpp"
 #include "access.hpp"
+#include "resumption.hpp"
+#include "ring.hpp"
+#include "mux.hpp"
+#include "tls.hpp"
 #include "q/manager.hpp"
 #include "fsm.hpp"
 
@@ -19,15 +25,40 @@ namespace simq::core::server {
                 TYPE_PRODUCER,
             };
             
+            // a fully sent message waiting for an ack from a consumer
+            // with a prefetch window
+            struct InFlight {
+                unsigned int tag;
+                unsigned int msgID;
+                bool isSignal;
+                // index of the channel, see getChannel
+                unsigned int channel;
+            };
+
+            // one more channel of the group a consumer pops from,
+            // authorized with its own consumer login
+            struct Attached {
+                std::string channel;
+                std::string login;
+                q::Manager::ChannelHandle handle;
+                Access::Capability capability;
+            };
+
             struct Session {
                 FSM::Code fsm;
                 Type type;
              
                 std::unique_ptr<char[]> authData;
-                std::unique_ptr<Protocol::Packet> packet;
-                std::unique_ptr<Protocol::BasePacket> packetMsg;
+                Protocol::Packet packet;
+                Protocol::BasePacket packetMsg;
                 unsigned short int offsetChannel;
                 unsigned short int offsetLogin;
+                q::Manager::ChannelHandle channel;
+                Access::Capability capability;
+
+                // presented by a reconnect to resume this session
+                unsigned char token[Protocol::TOKEN_LENGTH];
+                bool isToken;
              
                 unsigned int ip;
                 unsigned int lastTS;
@@ -38,81 +69,167 @@ namespace simq::core::server {
                 unsigned int lengthMessage;
                 unsigned int sendLengthMessage;
                 bool isSignal;
+
+                // 1 means the consumer acks every message before the next pop
+                unsigned int prefetch;
+                unsigned int lastTag;
+                unsigned int msgTag;
+                std::vector<InFlight> inFlight;
+
+                // channels of a consumer after the one it logged in to
+                std::vector<Attached> attached;
+                // the channel of msgID and the one the next pop starts from
+                unsigned int msgChannel;
+                unsigned int nextChannel;
+
+                // a subscribed consumer gets messages pushed while it has credits
+                unsigned int credits;
+                std::unique_ptr<Protocol::Packet> packetPush;
+
+                // messages of a producer on the same host come through shared memory
+                std::unique_ptr<Ring> ring;
+
+                // the handshake of the secure mode, freed once the kernel has the keys
+                Tls::Handshake tls;
+                bool isSecure;
+
+                // streams of a multiplexed connection, isMuxed marks the sessions of them
+                std::unique_ptr<Mux> mux;
+                bool isMuxed;
             };
 
-            void _resizeSessions( unsigned int fd );
         private:
+            // a session is only touched by the worker serving its fd,
+            // the atomics order a reuse of the fd by another worker
             struct WrapperSession {
-                unsigned int counter;
-                bool isLive;
-                std::unique_ptr<Session> sess;
+                std::atomic_uint counter{0};
+                std::atomic_bool isLive{false};
+                Session sess;
             };
 
-            const unsigned int STEP_RESIZE_SESSIONS = 1024;
-            std::vector<std::unique_ptr<WrapperSession>> _sessions;
-            std::mutex _mSessions;
+            // Slots are indexed by fd and allocated a chunk at a time on first
+            // use, then reused by every later connection with the same fd
+            static const unsigned int CHUNK_SIZE = 1'024;
+            static const unsigned int MAX_CHUNKS = 16'384;
+
+            std::unique_ptr<std::atomic<WrapperSession *>[]> _chunks;
 
             Access *_access = nullptr;
             q::Manager *_q = nullptr;
+            Resumption _resumption;
 
+            WrapperSession *_getWrapper( unsigned int fd );
+            void _reset( Session *sess );
             void _disconnect( unsigned int fd, WrapperSession *wrapper );
+            Resumption::Ticket _makeTicket( Session *sess );
         public:
             Sessions(
                 simq::core::server::Access *access,
                 simq::core::server::q::Manager *q
-            ) : _access{access}, _q{q} {};
+            );
+            ~Sessions();
             
             Session *connect( unsigned int fd, unsigned int &counter );
             void disconnect( unsigned int fd, unsigned int counter );
-    };
 
-    void Sessions::_resizeSessions( unsigned int fd ) {
-        while( true ) {
-            if( fd < _sessions.size() ) {
-                return;
-            }
-            auto prevSize = _sessions.size();
+            void issueToken( Session *sess );
+            void resume( unsigned int fd, Session *sess, const unsigned char *token );
 
-            _sessions.resize( prevSize + STEP_RESIZE_SESSIONS );
+            // index 0 is the channel of the login, the attached ones follow
+            static q::Manager::ChannelHandle &getChannel( Session *sess, unsigned int index );
+            static const char *getChannelName( Session *sess, unsigned int index );
+    };
 
-            for( auto i = prevSize; i < prevSize + STEP_RESIZE_SESSIONS; i++ ) {
-                _sessions[i] = std::make_unique<WrapperSession>();
-            }
+    Sessions::Sessions(
+        simq::core::server::Access *access,
+        simq::core::server::q::Manager *q
+    ) : _access{access}, _q{q} {
+        _chunks = std::make_unique<std::atomic<WrapperSession *>[]>( MAX_CHUNKS );
+    }
+
+    Sessions::~Sessions() {
+        for( unsigned int i = 0; i < MAX_CHUNKS; i++ ) {
+            delete[] _chunks[i].load();
         }
     }
 
-    Sessions::Session *Sessions::connect( unsigned int fd, unsigned int &counter ) {
-        std::lock_guard<std::mutex> lock( _mSessions );
+    Sessions::WrapperSession *Sessions::_getWrapper( unsigned int fd ) {
+        auto index = fd / CHUNK_SIZE;
 
-        if( fd >= _sessions.size() ) {
-            _resizeSessions( fd );
+        if( index >= MAX_CHUNKS ) {
+            throw util::Error::EXCEED_LIMIT;
         }
 
-        auto wrapper = _sessions[fd].get();
+        auto chunk = _chunks[index].load( std::memory_order_acquire );
 
-        if( wrapper->isLive ) {
-            _disconnect( fd, wrapper );
+        if( chunk == nullptr ) {
+            auto created = new WrapperSession[CHUNK_SIZE];
+
+            if( _chunks[index].compare_exchange_strong( chunk, created, std::memory_order_acq_rel ) ) {
+                chunk = created;
+            } else {
+                delete[] created;
+            }
         }
 
-        auto sess = std::make_unique<Session>();
+        return &chunk[fd % CHUNK_SIZE];
+    }
+
+    void Sessions::_reset( Session *sess ) {
         sess->fsm = FSM::Code::COMMON_RECV_CMD_CHECK_SECURE;
         sess->type = TYPE_COMMON;
-        sess->packet = std::make_unique<Protocol::Packet>();
-        sess->packetMsg = std::make_unique<Protocol::BasePacket>();
+        sess->authData.reset();
+        sess->channel = q::Manager::ChannelHandle();
+        sess->capability = Access::Capability();
+        sess->isToken = false;
+        sess->ip = 0;
+        sess->lastTS = 0;
 
-        wrapper->sess = std::move( sess );
-        wrapper->counter++;
-        wrapper->isLive = true;
-        counter = wrapper->counter;
+        sess->packet.isRecvMeta = false;
+        sess->packet.isRecvBody = false;
+        sess->packet.countValues = 0;
+        sess->packet.length = 0;
+        sess->packet.wrLength = 0;
+        sess->packetMsg.length = 0;
+        sess->packetMsg.wrLength = 0;
 
-        return wrapper->sess.get();
+        sess->delayConsumerWait = 0;
+        sess->msgID = 0;
+        sess->msgTag = 0;
+        sess->lastTag = 0;
+        sess->prefetch = 1;
+        sess->credits = 0;
+        sess->packetPush.reset();
+        sess->ring.reset();
+        sess->tls.reset();
+        sess->isSecure = false;
+        sess->mux.reset();
+        sess->isMuxed = false;
+        sess->msgChannel = 0;
+        sess->nextChannel = 0;
+        std::vector<InFlight>().swap( sess->inFlight );
+        std::vector<Attached>().swap( sess->attached );
+    }
+
+    Sessions::Session *Sessions::connect( unsigned int fd, unsigned int &counter ) {
+        auto wrapper = _getWrapper( fd );
+
+        if( wrapper->isLive.load( std::memory_order_acquire ) ) {
+            _disconnect( fd, wrapper );
+        }
+
+        _reset( &wrapper->sess );
+
+        counter = ++wrapper->counter;
+        wrapper->isLive.store( true, std::memory_order_release );
+
+        return &wrapper->sess;
     }
 
     void Sessions::disconnect( unsigned int fd, unsigned int counter ) {
-        std::lock_guard<std::mutex> lock( _mSessions );
-        auto wrapper = _sessions[fd].get();
+        auto wrapper = _getWrapper( fd );
 
-        if( !wrapper->isLive || wrapper->counter != counter ) {
+        if( !wrapper->isLive.load( std::memory_order_acquire ) || wrapper->counter != counter ) {
             return;
         }
 
@@ -120,7 +237,7 @@ namespace simq::core::server {
     }
 
     void Sessions::_disconnect( unsigned int fd, WrapperSession *wrapper ) {
-        auto sess = wrapper->sess.get();
+        auto sess = &wrapper->sess;
         char *group, *channel, *login;
 
         switch( sess->type ) {
@@ -134,16 +251,32 @@ namespace simq::core::server {
                 login = &sess->authData.get()[sess->offsetLogin];
 
                 _access->logoutConsumer( group, channel, login, fd );
+                for( auto &attached : sess->attached ) {
+                    _access->logoutConsumer( group, attached.channel.c_str(), attached.login.c_str(), fd );
+                }
+
                 try {
                     if( sess->msgID != 0 ) {
                         if( !sess->isSignal ) {
-                            _q->revertMessage( group, channel, fd, sess->msgID );
+                            _q->revertMessage( getChannel( sess, sess->msgChannel ), sess->msgID );
+                        } else {
+                            _q->removeMessage( getChannel( sess, sess->msgChannel ), sess->msgID );
+                        }
+                    }
+
+                    // reverted newest first, so they are redelivered in the order they were popped
+                    for( auto it = sess->inFlight.rbegin(); it != sess->inFlight.rend(); it++ ) {
+                        if( !it->isSignal ) {
+                            _q->revertMessage( getChannel( sess, it->channel ), it->msgID );
                         } else {
-                            _q->removeMessage( group, channel, fd, sess->msgID );
+                            _q->removeMessage( getChannel( sess, it->channel ), it->msgID );
                         }
                     }
                 } catch( ... ) {}
-                _q->leaveConsumer( group, channel, fd );
+                _q->leaveConsumer( sess->channel, fd );
+                for( auto &attached : sess->attached ) {
+                    _q->leaveConsumer( attached.handle, fd );
+                }
                 break;
             case TYPE_PRODUCER:
                 group = sess->authData.get();
@@ -153,17 +286,100 @@ namespace simq::core::server {
                 _access->logoutProducer( group, channel, login, fd );
                 try {
                     if( sess->msgID != 0 ) {
-                        _q->removeMessage( group, channel, fd, sess->msgID );
+                        _q->removeMessage( sess->channel, sess->msgID );
                     }
                 } catch( ... ) {}
-                _q->leaveProducer( group, channel, fd );
+                _q->leaveProducer( sess->channel, fd );
                 break;
         }
 
-        wrapper->isLive = false;
+        if( sess->isToken ) {
+            _resumption.release( sess->token, _makeTicket( sess ) );
+            sess->isToken = false;
+        }
+
+        // drop what an idle slot does not need
+        sess->authData.reset();
+        sess->channel = q::Manager::ChannelHandle();
+        sess->capability = Access::Capability();
+        sess->packet.values.reset();
+        sess->packet.valuesOffsets.reset();
+        sess->packet.capacity = 0;
+        sess->packetPush.reset();
+        sess->ring.reset();
+        sess->tls.reset();
+        sess->mux.reset();
+        std::vector<InFlight>().swap( sess->inFlight );
+        std::vector<Attached>().swap( sess->attached );
+
         wrapper->counter++;
+        wrapper->isLive.store( false, std::memory_order_release );
+    }
+
+    // the ticket is made when the session closes, see Resumption
+    void Sessions::issueToken( Session *sess ) {
+        _resumption.issue( sess->token );
+        sess->isToken = true;
+    }
+
+    Resumption::Ticket Sessions::_makeTicket( Session *sess ) {
+        auto login = &sess->authData[sess->offsetLogin];
+
+        Resumption::Ticket ticket;
+        ticket.isConsumer = sess->type == TYPE_CONSUMER;
+        ticket.authData.assign( sess->authData.get(), sess->offsetLogin + strlen( login ) + 1 );
+        ticket.offsetChannel = sess->offsetChannel;
+        ticket.offsetLogin = sess->offsetLogin;
+        ticket.capability = sess->capability;
+        ticket.isSecure = sess->isSecure;
+
+        for( auto &attached : sess->attached ) {
+            ticket.attached.push_back( { attached.channel, attached.login, attached.capability } );
+        }
+
+        return ticket;
+    }
+
+    // Binds the session to the consumer or the producer of a token, a consumer
+    // gets its attached channels back without their handles. The type is set
+    // once the login is bound, so a failure after it logs the session out on
+    // close; the token is spent either way
+    void Sessions::resume( unsigned int fd, Session *sess, const unsigned char *token ) {
+        Resumption::Ticket ticket;
+
+        if( !_resumption.take( token, sess->isSecure, ticket ) ) {
+            throw util::Error::ACCESS_DENY;
+        }
+
+        _access->resume( ticket.capability, fd );
+
+        sess->authData = std::make_unique<char[]>( ticket.authData.size() );
+        memcpy( sess->authData.get(), ticket.authData.data(), ticket.authData.size() );
+        sess->offsetChannel = ticket.offsetChannel;
+        sess->offsetLogin = ticket.offsetLogin;
+        sess->capability = std::move( ticket.capability );
+        sess->type = ticket.isConsumer ? TYPE_CONSUMER : TYPE_PRODUCER;
+
+        // a channel is kept only once its login is bound, close logs out what is kept
+        for( auto &channel : ticket.attached ) {
+            _access->resume( channel.capability, fd );
+
+            sess->attached.push_back( {
+                std::move( channel.channel ),
+                std::move( channel.login ),
+                {},
+                std::move( channel.capability )
+            } );
+        }
+    }
+
+    q::Manager::ChannelHandle &Sessions::getChannel( Session *sess, unsigned int index ) {
+        return index == 0 ? sess->channel : sess->attached[index - 1].handle;
+    }
+
+    const char *Sessions::getChannelName( Session *sess, unsigned int index ) {
+        return index == 0 ? &sess->authData[sess->offsetChannel] : sess->attached[index - 1].channel.c_str();
     }
 }
 
 #endif
- 
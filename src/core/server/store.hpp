@@ -33,6 +33,7 @@ namespace simq::core::server {
 
             struct Channel {
                 util::types::ChannelLimitMessages limitMessages;
+                unsigned int countShards = 1;
                 std::map<std::string, bool> consumers;
                 std::map<std::string, bool> producers;
             };
@@ -49,6 +50,7 @@ namespace simq::core::server {
             void _initSettings();
             void _initChannels( const char *group );
             void _initChannelLimitMessages( const char *group, const char *channel );
+            void _initChannelShards( const char *group, const char *channel );
             void _initUsers( const char *group, const char *channel, TypeUser type );
             void _initGroups();
             bool _issetCorrectPasswordFile( const char *path );
@@ -63,10 +65,12 @@ namespace simq::core::server {
                 const char *channel,
                 util::types::ChannelLimitMessages &limitMessages
             );
+            unsigned int getDirectChannelShards( const char *group, const char *channel );
             void getDirectConsumers( const char *group, const char *channel, std::vector<std::string> &list );
             void getDirectProducers( const char *group, const char *channel, std::vector<std::string> &list );
             unsigned short int getDirectPort();
             unsigned short int getDirectCountThreads();
+            void getDirectUnixSocket( std::string &socketPath );
             void getDirectMasterPassword(
                 unsigned char *password
             );
@@ -93,6 +97,8 @@ namespace simq::core::server {
                 const char *channel,
                 util::types::ChannelLimitMessages limitMessages
             );
+            unsigned int getChannelShards( const char *group, const char *channel );
+            void updateChannelShards( const char *group, const char *channel, unsigned int count );
             void removeChannel( const char *group, const char *channel );
 
             void getConsumers( const char *group, const char *channel, std::list<std::string> &consumers );
@@ -145,6 +151,10 @@ namespace simq::core::server {
 
             unsigned short int getPort();
             void updatePort( unsigned short int port );
+
+            // an empty path turns the listener off
+            void getUnixSocket( std::string &socketPath );
+            void updateUnixSocket( const char *socketPath );
     };
 
     Store::Store( const char *path ) {
@@ -332,6 +342,10 @@ namespace simq::core::server {
 
     }
 
+    void Store::_initChannelShards( const char *group, const char *channel ) {
+        groups[group][channel].countShards = getDirectChannelShards( group, channel );
+    }
+
     void Store::_initChannels( const char *group ) {
         std::vector<std::string> dirs;
         std::string pathToGroup;
@@ -350,6 +364,7 @@ namespace simq::core::server {
             Channel channel;
             groups[group][_channel] = channel;
             _initChannelLimitMessages( group, (*it).c_str() );
+            _initChannelShards( group, (*it).c_str() );
 
             std::string _pathConsumers;
             util::constants::buildPathToConsumers( _pathConsumers, _path.get(), group, _channel );
@@ -477,6 +492,30 @@ namespace simq::core::server {
         file.atomicWrite( &settings, sizeof( Settings ) );
     }
 
+    void Store::getUnixSocket( std::string &socketPath ) {
+        std::lock_guard<std::mutex> lock( m );
+        getDirectUnixSocket( socketPath );
+    }
+
+    void Store::updateUnixSocket( const char *socketPath ) {
+        std::lock_guard<std::mutex> lock( m );
+
+        std::string path;
+        util::constants::buildPathToUnixSocket( path, _path.get() );
+
+        if( socketPath[0] == 0 ) {
+            util::FS::removeFile( path.c_str() );
+            return;
+        }
+
+        if( !util::Validation::isUnixSocketPath( socketPath ) ) {
+            throw util::Error::WRONG_PARAM;
+        }
+
+        util::File file( path.c_str(), true );
+        file.atomicWrite( ( void * )socketPath, strlen( socketPath ) );
+    }
+
     void Store::getMasterPassword( unsigned char *password ) {
         std::lock_guard<std::mutex> lock( m );
         Settings settings;
@@ -550,6 +589,28 @@ namespace simq::core::server {
         limitMessages.maxMessagesOnDisk = ntohl( limitMessages.maxMessagesOnDisk );
     }
 
+    unsigned int Store::getDirectChannelShards( const char *group, const char *channel ) {
+        std::string path;
+        util::constants::buildPathToChannelShards( path, _path.get(), group, channel );
+
+        if( !util::FS::fileExists( path.c_str() ) ) {
+            return 1;
+        }
+
+        unsigned int count = 0;
+        {
+            util::File file( path.c_str() );
+            if( file.size() < sizeof( count ) ) {
+                return 1;
+            }
+            file.read( &count, sizeof( count ) );
+        }
+
+        count = ntohl( count );
+
+        return util::Validation::isChannelShards( count ) ? count : 1;
+    }
+
     void Store::getDirectConsumers( const char *group, const char *channel, std::vector<std::string> &list ) {
         std::string path;
         util::constants::buildPathToConsumers( path, _path.get(), group, channel );
@@ -591,6 +652,25 @@ namespace simq::core::server {
         return ntohs( settings.port );
     }
 
+    void Store::getDirectUnixSocket( std::string &socketPath ) {
+        std::string path;
+        util::constants::buildPathToUnixSocket( path, _path.get() );
+
+        socketPath.clear();
+
+        if( !util::FS::fileExists( path.c_str() ) ) {
+            return;
+        }
+
+        util::File file( path.c_str() );
+        socketPath.resize( file.size() );
+        file.read( socketPath.data(), socketPath.size() );
+
+        if( !util::Validation::isUnixSocketPath( socketPath.c_str() ) ) {
+            socketPath.clear();
+        }
+    }
+
     unsigned short int Store::getDirectCountThreads() {
         std::string path;
         util::constants::buildPathToSettings( path, _path.get() );
@@ -858,6 +938,39 @@ namespace simq::core::server {
         fileSettings.atomicWrite( &limitMessages, sizeof( util::types::ChannelLimitMessages ) );
     }
 
+    unsigned int Store::getChannelShards( const char *group, const char *channel ) {
+        std::lock_guard<std::mutex> lock( m );
+
+        auto itGroup = groups.find( group );
+
+        if( itGroup == groups.end() ) {
+            throw util::Error::NOT_FOUND_GROUP;
+        }
+
+        auto itChannel = itGroup->second.find( channel );
+        if( itChannel == itGroup->second.end() ) {
+            throw util::Error::NOT_FOUND_CHANNEL;
+        }
+
+        return itChannel->second.countShards;
+    }
+
+    void Store::updateChannelShards( const char *group, const char *channel, unsigned int count ) {
+        std::lock_guard<std::mutex> lock( m );
+
+        if( !util::Validation::isChannelShards( count ) ) {
+            count = 1;
+        }
+
+        std::string path;
+        util::constants::buildPathToChannelShards( path, _path.get(), group, channel );
+
+        util::File file( path.c_str(), true );
+
+        count = htonl( count );
+        file.atomicWrite( &count, sizeof( count ) );
+    }
+
     void Store::getConsumers( const char *group, const char *channel, std::list<std::string> &consumers ) {
         std::lock_guard<std::mutex> lock( m );
 
@@ -0,0 +1,137 @@
+#ifndef SIMQ_CORE_SERVER_TLS
+#define SIMQ_CORE_SERVER_TLS
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <memory>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include "../../util/error.h"
+
+namespace simq::core::server {
+    // The secure mode. OpenSSL runs only the handshake and hands the keys to
+    // the kernel, records are then encrypted by kernel TLS, so the connection
+    // is used by plain recv, send and sendfile like an open one.
+    // OpenSSL 3.0 moves the receive side to the kernel for TLS 1.2 only
+    class Tls {
+        public:
+            struct Free {
+                void operator()( SSL *ssl ) const;
+            };
+
+            using Handshake = std::unique_ptr<SSL, Free>;
+
+        private:
+            SSL_CTX *_ctx = nullptr;
+
+            static bool _isKernelSupported();
+
+        public:
+            Tls( const char *pathCertificate, const char *pathKey );
+            ~Tls();
+
+            Handshake accept( int fd );
+            static bool handshake( SSL *ssl );
+    };
+
+    void Tls::Free::operator()( SSL *ssl ) const {
+        SSL_free( ssl );
+    }
+
+    Tls::Tls( const char *pathCertificate, const char *pathKey ) {
+        if( !_isKernelSupported() ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        _ctx = SSL_CTX_new( TLS_server_method() );
+        if( _ctx == nullptr ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        SSL_CTX_set_min_proto_version( _ctx, TLS1_2_VERSION );
+        SSL_CTX_set_max_proto_version( _ctx, TLS1_2_VERSION );
+        SSL_CTX_set_options( _ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION );
+
+        if(
+            SSL_CTX_set_cipher_list( _ctx, "ECDHE+AESGCM:ECDHE+CHACHA20" ) != 1 ||
+            SSL_CTX_use_certificate_chain_file( _ctx, pathCertificate ) != 1 ||
+            SSL_CTX_use_PrivateKey_file( _ctx, pathKey, SSL_FILETYPE_PEM ) != 1 ||
+            SSL_CTX_check_private_key( _ctx ) != 1
+        ) {
+            SSL_CTX_free( _ctx );
+            throw util::Error::WRONG_SETTINGS;
+        }
+    }
+
+    Tls::~Tls() {
+        SSL_CTX_free( _ctx );
+    }
+
+    // the tls module is loaded on the first use, so it is tried on a connection
+    bool Tls::_isKernelSupported() {
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        socklen_t size = sizeof( addr );
+
+        auto listenFD = socket( AF_INET, SOCK_STREAM, 0 );
+        auto clientFD = socket( AF_INET, SOCK_STREAM, 0 );
+        auto isSupported = false;
+
+        if(
+            listenFD != -1 && clientFD != -1 &&
+            bind( listenFD, ( struct sockaddr * )&addr, size ) == 0 &&
+            listen( listenFD, 1 ) == 0 &&
+            getsockname( listenFD, ( struct sockaddr * )&addr, &size ) == 0 &&
+            ::connect( clientFD, ( struct sockaddr * )&addr, size ) == 0
+        ) {
+            isSupported = setsockopt( clientFD, SOL_TCP, TCP_ULP, "tls", sizeof( "tls" ) ) == 0;
+        }
+
+        if( listenFD != -1 ) ::close( listenFD );
+        if( clientFD != -1 ) ::close( clientFD );
+
+        return isSupported;
+    }
+
+    Tls::Handshake Tls::accept( int fd ) {
+        Handshake ssl( SSL_new( _ctx ) );
+
+        if( !ssl || SSL_set_fd( ssl.get(), fd ) != 1 ) {
+            throw util::Error::UNKNOWN;
+        }
+
+        SSL_set_accept_state( ssl.get() );
+
+        return ssl;
+    }
+
+    // true when the keys are in the kernel, false while the socket is not ready;
+    // the SSL is not needed after it and is freed without a shutdown
+    bool Tls::handshake( SSL *ssl ) {
+        ERR_clear_error();
+
+        auto result = SSL_do_handshake( ssl );
+
+        if( result != 1 ) {
+            auto err = SSL_get_error( ssl, result );
+
+            if( err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE ) {
+                return false;
+            }
+
+            throw util::Error::SOCKET;
+        }
+
+        if( !BIO_get_ktls_send( SSL_get_wbio( ssl ) ) || !BIO_get_ktls_recv( SSL_get_rbio( ssl ) ) ) {
+            throw util::Error::SOCKET;
+        }
+
+        return true;
+    }
+}
+
+#endif
@@ -14,8 +14,12 @@ namespace simq::util::constants {
     inline const char *PATH_FILE_PASSWORD = "password";
     inline const char *PATH_FILE_CHANNEL_LIMIT_MESSAGES = "limit-messages";
     inline const char *PATH_FILE_CHANNEL_DATA = "data";
+    inline const char *PATH_FILE_CHANNEL_SHARDS = "shards";
     inline const char *PATH_DIR_SETTINGS = "settings";
     inline const char *PATH_FILE_SETTINGS = "settings";
+    inline const char *PATH_FILE_UNIX_SOCKET = "unix-socket";
+    inline const char *PATH_FILE_TLS_CERTIFICATE = "tls-certificate.pem";
+    inline const char *PATH_FILE_TLS_KEY = "tls-key.pem";
     inline const char *PATH_DIR_CHANGES = "changes";
 
     inline void buildPathToDirSettings( std::string &str, const char *path ) {
@@ -31,6 +35,27 @@ namespace simq::util::constants {
         str += PATH_FILE_SETTINGS;
     }
 
+    inline void buildPathToUnixSocket( std::string &str, const char *path ) {
+        buildPathToDirSettings( str, path );
+
+        str += "/";
+        str += PATH_FILE_UNIX_SOCKET;
+    }
+
+    inline void buildPathToTLSCertificate( std::string &str, const char *path ) {
+        buildPathToDirSettings( str, path );
+
+        str += "/";
+        str += PATH_FILE_TLS_CERTIFICATE;
+    }
+
+    inline void buildPathToTLSKey( std::string &str, const char *path ) {
+        buildPathToDirSettings( str, path );
+
+        str += "/";
+        str += PATH_FILE_TLS_KEY;
+    }
+
     inline void buildPathToGroups( std::string &str, const char *path ) {
         str = path;
         str += "/";
@@ -72,6 +97,13 @@ namespace simq::util::constants {
         str += PATH_FILE_CHANNEL_DATA;
     }
 
+    inline void buildPathToChannelShards( std::string &str, const char *path, const char *group, const char *channel ) {
+        buildPathToChannel( str, path, group, channel );
+
+        str += "/";
+        str += PATH_FILE_CHANNEL_SHARDS;
+    }
+
     inline void buildPathToProducers( std::string &str, const char *path, const char *group, const char *channel ) {
         buildPathToChannel( str, path, group, channel );
 
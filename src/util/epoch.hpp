@@ -0,0 +1,194 @@
+#ifndef SIMQ_UTIL_EPOCH
+#define SIMQ_UTIL_EPOCH
+
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <deque>
+#include <memory>
+#include <thread>
+#include "error.h"
+
+namespace simq::util {
+    // Epoch based reclamation: readers announce the epoch they entered in
+    // their own cache line, writers bump the global epoch and either wait
+    // until no reader is left in an older one or retire what they unpublished
+    // to be freed later. A slot costs a cache line per thread, so one Epoch
+    // is meant to be shared by many structures
+    class Epoch {
+        public:
+            static const unsigned int MAX_THREADS = 1024;
+
+            class Guard {
+                private:
+                    Epoch *_epoch;
+                public:
+                    Guard( Epoch &epoch );
+                    ~Guard();
+            };
+
+        private:
+            struct alignas( 64 ) Slot {
+                std::atomic_ulong epoch{0};
+                unsigned int nesting = 0;
+            };
+
+            class ThreadIndex {
+                private:
+                    inline static std::mutex _m;
+                    inline static std::list<unsigned int> _freeIndexes;
+
+                public:
+                    inline static std::atomic_uint countIndexes{0};
+                    unsigned int value;
+
+                    ThreadIndex();
+                    ~ThreadIndex();
+            };
+
+            struct Retired {
+                unsigned long epoch;
+                void *ptr;
+                void ( *free )( void *ptr );
+            };
+
+            std::atomic_ulong _global{1};
+            std::unique_ptr<Slot[]> _slots;
+
+            std::mutex _mRetired;
+            std::deque<Retired> _retired;
+
+            static unsigned int _getThreadIndex();
+            unsigned long _getOldestEpoch();
+            void _reclaim();
+
+        public:
+            Epoch();
+            ~Epoch();
+
+            Epoch( const Epoch & ) = delete;
+            Epoch &operator=( const Epoch & ) = delete;
+
+            void enter();
+            void leave();
+            void synchronize();
+
+            // frees ptr once no reader can see it, never waits
+            template<typename T>
+            void retire( T *ptr );
+    };
+
+    Epoch::ThreadIndex::ThreadIndex() {
+        std::lock_guard<std::mutex> lock( _m );
+
+        if( !_freeIndexes.empty() ) {
+            value = _freeIndexes.front();
+            _freeIndexes.pop_front();
+            return;
+        }
+
+        if( countIndexes == MAX_THREADS ) {
+            throw util::Error::EXCEED_LIMIT;
+        }
+
+        value = countIndexes++;
+    }
+
+    Epoch::ThreadIndex::~ThreadIndex() {
+        std::lock_guard<std::mutex> lock( _m );
+        _freeIndexes.push_back( value );
+    }
+
+    unsigned int Epoch::_getThreadIndex() {
+        thread_local ThreadIndex index;
+
+        return index.value;
+    }
+
+    Epoch::Epoch() {
+        _slots = std::make_unique<Slot[]>( MAX_THREADS );
+    }
+
+    Epoch::~Epoch() {
+        for( auto &retired : _retired ) {
+            retired.free( retired.ptr );
+        }
+    }
+
+    void Epoch::enter() {
+        auto &slot = _slots[_getThreadIndex()];
+
+        if( slot.nesting++ == 0 ) {
+            slot.epoch.store( _global.load() );
+        }
+    }
+
+    void Epoch::leave() {
+        auto &slot = _slots[_getThreadIndex()];
+
+        if( --slot.nesting == 0 ) {
+            slot.epoch.store( 0, std::memory_order_release );
+        }
+    }
+
+    void Epoch::synchronize() {
+        auto target = ++_global;
+        auto count = ThreadIndex::countIndexes.load();
+
+        for( unsigned int i = 0; i < count; i++ ) {
+            while( true ) {
+                auto epoch = _slots[i].epoch.load();
+
+                if( epoch == 0 || epoch >= target ) {
+                    break;
+                }
+
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    unsigned long Epoch::_getOldestEpoch() {
+        auto oldest = ~0ul;
+        auto count = ThreadIndex::countIndexes.load();
+
+        for( unsigned int i = 0; i < count; i++ ) {
+            auto epoch = _slots[i].epoch.load();
+
+            if( epoch != 0 && epoch < oldest ) {
+                oldest = epoch;
+            }
+        }
+
+        return oldest;
+    }
+
+    // retired in increasing epochs, so it stops at the first one still visible
+    void Epoch::_reclaim() {
+        auto oldest = _getOldestEpoch();
+
+        while( !_retired.empty() && _retired.front().epoch <= oldest ) {
+            _retired.front().free( _retired.front().ptr );
+            _retired.pop_front();
+        }
+    }
+
+    template<typename T>
+    void Epoch::retire( T *ptr ) {
+        std::lock_guard<std::mutex> lock( _mRetired );
+
+        _retired.push_back( { ++_global, ptr, []( void *ptr ) { delete ( T * )ptr; } } );
+        _reclaim();
+    }
+
+    Epoch::Guard::Guard( Epoch &epoch ) {
+        _epoch = &epoch;
+        _epoch->enter();
+    }
+
+    Epoch::Guard::~Guard() {
+        _epoch->leave();
+    }
+}
+
+#endif
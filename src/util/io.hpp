@@ -0,0 +1,165 @@
+#ifndef SIMQ_UTIL_IO
+#define SIMQ_UTIL_IO
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <errno.h>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include "error.h"
+
+namespace simq::util {
+    // Socket calls of the server. An fd from VIRTUAL_BASE is not a socket but
+    // a stream served in user space by an endpoint, e.g. a stream of a
+    // multiplexed connection; the calls on it look like the ones on a non
+    // blocking socket. Endpoints are per thread, a virtual fd is used only by
+    // the worker that opened it
+    class IO {
+        public:
+            class Endpoint {
+                public:
+                    virtual long read( unsigned int fd, char *data, unsigned int length ) = 0;
+                    virtual long write( unsigned int fd, const char *data, unsigned int length ) = 0;
+                    virtual void close( unsigned int fd ) = 0;
+            };
+
+            // above any fd of the kernel, below the limit of the session slots
+            static const unsigned int VIRTUAL_BASE = 1 << 23;
+            static const unsigned int MAX_VIRTUAL = 1 << 22;
+
+        private:
+            static const unsigned int SIZE_FILE_READ = 64 * 1'024;
+
+            struct Numbers {
+                std::mutex m;
+                unsigned int next = VIRTUAL_BASE;
+                std::vector<unsigned int> free;
+            };
+
+            static Numbers &_getNumbers();
+            static std::unordered_map<unsigned int, Endpoint *> &_getEndpoints();
+            static Endpoint *_getEndpoint( unsigned int fd );
+
+        public:
+            static bool isVirtual( unsigned int fd );
+            static unsigned int open( Endpoint *endpoint );
+
+            static long recv( unsigned int fd, char *data, unsigned int length );
+            static long send( unsigned int fd, const char *data, unsigned int length );
+            static long sendFile( unsigned int fd, int fileFD, off_t offset, unsigned int length );
+            static void close( unsigned int fd );
+    };
+
+    IO::Numbers &IO::_getNumbers() {
+        static Numbers numbers;
+        return numbers;
+    }
+
+    std::unordered_map<unsigned int, IO::Endpoint *> &IO::_getEndpoints() {
+        thread_local std::unordered_map<unsigned int, Endpoint *> endpoints;
+        return endpoints;
+    }
+
+    IO::Endpoint *IO::_getEndpoint( unsigned int fd ) {
+        auto &endpoints = _getEndpoints();
+        auto it = endpoints.find( fd );
+
+        return it == endpoints.end() ? nullptr : it->second;
+    }
+
+    bool IO::isVirtual( unsigned int fd ) {
+        return fd >= VIRTUAL_BASE;
+    }
+
+    unsigned int IO::open( Endpoint *endpoint ) {
+        auto &numbers = _getNumbers();
+        unsigned int fd;
+
+        {
+            std::lock_guard<std::mutex> lock( numbers.m );
+
+            if( !numbers.free.empty() ) {
+                fd = numbers.free.back();
+                numbers.free.pop_back();
+            } else if( numbers.next < VIRTUAL_BASE + MAX_VIRTUAL ) {
+                fd = numbers.next++;
+            } else {
+                throw util::Error::EXCEED_LIMIT;
+            }
+        }
+
+        _getEndpoints()[fd] = endpoint;
+
+        return fd;
+    }
+
+    long IO::recv( unsigned int fd, char *data, unsigned int length ) {
+        if( !isVirtual( fd ) ) {
+            return ::recv( fd, data, length, MSG_NOSIGNAL );
+        }
+
+        auto endpoint = _getEndpoint( fd );
+        if( endpoint == nullptr ) {
+            errno = EBADF;
+            return -1;
+        }
+
+        return endpoint->read( fd, data, length );
+    }
+
+    long IO::send( unsigned int fd, const char *data, unsigned int length ) {
+        if( !isVirtual( fd ) ) {
+            return ::send( fd, data, length, MSG_NOSIGNAL );
+        }
+
+        auto endpoint = _getEndpoint( fd );
+        if( endpoint == nullptr ) {
+            errno = EBADF;
+            return -1;
+        }
+
+        return endpoint->write( fd, data, length );
+    }
+
+    // a virtual fd gets the file through a buffer, there is no page cache to splice from
+    long IO::sendFile( unsigned int fd, int fileFD, off_t offset, unsigned int length ) {
+        if( !isVirtual( fd ) ) {
+            return ::sendfile( fd, fileFD, &offset, length );
+        }
+
+        char data[SIZE_FILE_READ];
+
+        auto l = pread( fileFD, data, length < SIZE_FILE_READ ? length : SIZE_FILE_READ, offset );
+        if( l <= 0 ) {
+            return l;
+        }
+
+        return send( fd, data, l );
+    }
+
+    void IO::close( unsigned int fd ) {
+        if( !isVirtual( fd ) ) {
+            ::close( fd );
+            return;
+        }
+
+        auto &endpoints = _getEndpoints();
+        auto it = endpoints.find( fd );
+        if( it == endpoints.end() ) {
+            return;
+        }
+
+        auto endpoint = it->second;
+        endpoints.erase( it );
+        endpoint->close( fd );
+
+        auto &numbers = _getNumbers();
+        std::lock_guard<std::mutex> lock( numbers.m );
+        numbers.free.push_back( fd );
+    }
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef SIMQ_UTIL_RW_LOCK
+#define SIMQ_UTIL_RW_LOCK
+
+#include <atomic>
+
+namespace simq::util {
+    // Writer-preferring reader/writer lock on a single futex word.
+    // Waiting threads sleep in atomic::wait instead of spinning, new
+    // readers queue up behind a waiting writer. Usable with
+    // std::lock_guard and std::shared_lock
+    class alignas( 64 ) RWLock {
+        private:
+            static const unsigned int WRITER = 1u << 31;
+            static const unsigned int READERS_WAITING = 1u << 30;
+            static const unsigned int WRITER_WAITING = 1u << 16;
+            static const unsigned int WRITERS_WAITING_MASK = 0x3FFF0000;
+            static const unsigned int READERS_MASK = 0x0000FFFF;
+
+            std::atomic_uint _state{0};
+
+        public:
+            RWLock() = default;
+            RWLock( const RWLock & ) = delete;
+            RWLock &operator=( const RWLock & ) = delete;
+
+            void lock();
+            bool try_lock();
+            void unlock();
+
+            void lock_shared();
+            bool try_lock_shared();
+            void unlock_shared();
+    };
+
+    void RWLock::lock() {
+        auto state = _state.fetch_add( WRITER_WAITING, std::memory_order_relaxed ) + WRITER_WAITING;
+
+        while( true ) {
+            if( ( state & ( WRITER | READERS_MASK ) ) == 0 ) {
+                if( _state.compare_exchange_weak(
+                    state,
+                    ( state - WRITER_WAITING ) | WRITER,
+                    std::memory_order_acquire,
+                    std::memory_order_relaxed
+                ) ) {
+                    return;
+                }
+                continue;
+            }
+
+            _state.wait( state, std::memory_order_relaxed );
+            state = _state.load( std::memory_order_relaxed );
+        }
+    }
+
+    bool RWLock::try_lock() {
+        auto state = _state.load( std::memory_order_relaxed );
+
+        if( ( state & ( WRITER | READERS_MASK ) ) != 0 ) {
+            return false;
+        }
+
+        return _state.compare_exchange_strong(
+            state,
+            state | WRITER,
+            std::memory_order_acquire,
+            std::memory_order_relaxed
+        );
+    }
+
+    void RWLock::unlock() {
+        auto state = _state.fetch_and( ~( WRITER | READERS_WAITING ), std::memory_order_release );
+
+        if( state & ( READERS_WAITING | WRITERS_WAITING_MASK ) ) {
+            _state.notify_all();
+        }
+    }
+
+    void RWLock::lock_shared() {
+        auto state = _state.load( std::memory_order_relaxed );
+
+        while( true ) {
+            if( ( state & ( WRITER | WRITERS_WAITING_MASK ) ) == 0 ) {
+                if( _state.compare_exchange_weak(
+                    state,
+                    state + 1,
+                    std::memory_order_acquire,
+                    std::memory_order_relaxed
+                ) ) {
+                    return;
+                }
+                continue;
+            }
+
+            if( ( state & READERS_WAITING ) == 0 && !_state.compare_exchange_weak(
+                state,
+                state | READERS_WAITING,
+                std::memory_order_relaxed
+            ) ) {
+                continue;
+            }
+
+            _state.wait( state | READERS_WAITING, std::memory_order_relaxed );
+            state = _state.load( std::memory_order_relaxed );
+        }
+    }
+
+    bool RWLock::try_lock_shared() {
+        auto state = _state.load( std::memory_order_relaxed );
+
+        if( ( state & ( WRITER | WRITERS_WAITING_MASK ) ) != 0 ) {
+            return false;
+        }
+
+        return _state.compare_exchange_strong(
+            state,
+            state + 1,
+            std::memory_order_acquire,
+            std::memory_order_relaxed
+        );
+    }
+
+    void RWLock::unlock_shared() {
+        auto state = _state.fetch_sub( 1, std::memory_order_release ) - 1;
+
+        if( ( state & READERS_MASK ) == 0 && ( state & WRITERS_WAITING_MASK ) ) {
+            _state.notify_all();
+        }
+    }
+}
+
+#endif
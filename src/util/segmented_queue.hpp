@@ -0,0 +1,142 @@
+#ifndef SIMQ_UTIL_SEGMENTED_QUEUE
+#define SIMQ_UTIL_SEGMENTED_QUEUE
+
+#include <atomic>
+#include "epoch.hpp"
+
+namespace simq::util {
+    // Lock-free MPMC FIFO of non zero 64 bit tokens. Items live in fixed
+    // segments claimed with fetch_add, so producers and consumers only meet
+    // on a slot; drained segments are retired to the epoch of the owner and
+    // freed once no thread can still see them
+    class SegmentedQueue {
+        private:
+            static const unsigned int SEGMENT_SIZE = 1024;
+            static const unsigned long EMPTY = 0;
+            static const unsigned long TAKEN = ~0ul;
+
+            struct Segment {
+                alignas( 64 ) std::atomic_uint popIndex{0};
+                alignas( 64 ) std::atomic_uint pushIndex{0};
+                alignas( 64 ) std::atomic<Segment *> next{nullptr};
+                std::atomic_ulong items[SEGMENT_SIZE];
+
+                Segment();
+            };
+
+            Epoch &_epoch;
+
+            alignas( 64 ) std::atomic<Segment *> _head;
+            alignas( 64 ) std::atomic<Segment *> _tail;
+
+        public:
+            SegmentedQueue( Epoch &epoch );
+            ~SegmentedQueue();
+
+            SegmentedQueue( const SegmentedQueue & ) = delete;
+            SegmentedQueue &operator=( const SegmentedQueue & ) = delete;
+
+            void push( unsigned long token );
+            bool pop( unsigned long &token );
+    };
+
+    SegmentedQueue::Segment::Segment() {
+        for( unsigned int i = 0; i < SEGMENT_SIZE; i++ ) {
+            items[i].store( EMPTY, std::memory_order_relaxed );
+        }
+    }
+
+    SegmentedQueue::SegmentedQueue( Epoch &epoch ) : _epoch{epoch} {
+        auto segment = new Segment();
+        _head = segment;
+        _tail = segment;
+    }
+
+    SegmentedQueue::~SegmentedQueue() {
+        auto segment = _head.load();
+
+        while( segment != nullptr ) {
+            auto next = segment->next.load();
+            delete segment;
+            segment = next;
+        }
+    }
+
+    void SegmentedQueue::push( unsigned long token ) {
+        Epoch::Guard guard( _epoch );
+
+        while( true ) {
+            auto tail = _tail.load();
+            auto index = tail->pushIndex.fetch_add( 1 );
+
+            if( index < SEGMENT_SIZE ) {
+                unsigned long expected = EMPTY;
+                if( tail->items[index].compare_exchange_strong( expected, token ) ) {
+                    return;
+                }
+                continue;
+            }
+
+            if( tail != _tail.load() ) {
+                continue;
+            }
+
+            auto next = tail->next.load();
+            if( next != nullptr ) {
+                _tail.compare_exchange_strong( tail, next );
+                continue;
+            }
+
+            auto segment = new Segment();
+            segment->items[0].store( token, std::memory_order_relaxed );
+            segment->pushIndex.store( 1, std::memory_order_relaxed );
+
+            if( tail->next.compare_exchange_strong( next, segment ) ) {
+                _tail.compare_exchange_strong( tail, segment );
+                return;
+            }
+
+            delete segment;
+        }
+    }
+
+    bool SegmentedQueue::pop( unsigned long &token ) {
+        Epoch::Guard guard( _epoch );
+
+        while( true ) {
+            auto head = _head.load();
+
+            if( head->popIndex.load() >= head->pushIndex.load() && head->next.load() == nullptr ) {
+                return false;
+            }
+
+            auto index = head->popIndex.fetch_add( 1 );
+
+            if( index < SEGMENT_SIZE ) {
+                auto item = head->items[index].exchange( TAKEN );
+                if( item == EMPTY ) {
+                    continue;
+                }
+
+                token = item;
+                return true;
+            }
+
+            auto next = head->next.load();
+            if( next == nullptr ) {
+                return false;
+            }
+
+            // the tail must not be left on a segment that is about to be freed
+            auto tail = head;
+            _tail.compare_exchange_strong( tail, next );
+
+            // the guard of this thread keeps it alive until the pop returns
+            if( _head.compare_exchange_strong( head, next ) ) {
+                _epoch.retire( head );
+            }
+        }
+    }
+}
+
+#endif
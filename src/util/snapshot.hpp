@@ -0,0 +1,58 @@
+#ifndef SIMQ_UTIL_SNAPSHOT
+#define SIMQ_UTIL_SNAPSHOT
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include "epoch.hpp"
+
+namespace simq::util {
+    // Immutable value replaced as a whole: readers take no locks, writers
+    // publish an updated copy and free the previous one once no reader
+    // can still see it
+    template<typename T>
+    class Snapshot {
+        private:
+            Epoch _epoch;
+            std::atomic<T *> _current;
+            std::mutex _mUpdate;
+
+        public:
+            class Reader {
+                private:
+                    Epoch::Guard _guard;
+                    const T *_value;
+                public:
+                    Reader( Snapshot<T> &snapshot ) :
+                        _guard{snapshot._epoch}, _value{snapshot._current.load()} {};
+
+                    const T *operator->() const { return _value; };
+                    const T &operator*() const { return *_value; };
+            };
+
+            Snapshot() : _current{new T()} {};
+            ~Snapshot() { delete _current.load(); };
+
+            Snapshot( const Snapshot & ) = delete;
+            Snapshot &operator=( const Snapshot & ) = delete;
+
+            // f edits a private copy; nothing is published if it throws
+            template<typename F>
+            void update( F f );
+    };
+
+    template<typename T>
+    template<typename F>
+    void Snapshot<T>::update( F f ) {
+        std::lock_guard<std::mutex> lock( _mUpdate );
+
+        auto next = std::make_unique<T>( *_current.load() );
+        f( *next );
+
+        std::unique_ptr<T> prev( _current.exchange( next.release() ) );
+
+        _epoch.synchronize();
+    }
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SIMQ_UTIL_SPSC_QUEUE
+#define SIMQ_UTIL_SPSC_QUEUE
+
+#include <atomic>
+
+namespace simq::util {
+    // Bounded lock-free queue for exactly one producer and one consumer thread
+    template<typename T, unsigned int SIZE>
+    class SPSCQueue {
+        static_assert( ( SIZE & ( SIZE - 1 ) ) == 0, "SIZE must be a power of two" );
+
+        private:
+            alignas( 64 ) std::atomic_uint _head{0};
+            alignas( 64 ) std::atomic_uint _tail{0};
+            alignas( 64 ) T _items[SIZE];
+
+        public:
+            bool push( const T &item );
+            bool pop( T &item );
+    };
+
+    template<typename T, unsigned int SIZE>
+    bool SPSCQueue<T, SIZE>::push( const T &item ) {
+        auto tail = _tail.load( std::memory_order_relaxed );
+
+        if( tail - _head.load( std::memory_order_acquire ) == SIZE ) {
+            return false;
+        }
+
+        _items[tail & ( SIZE - 1 )] = item;
+        _tail.store( tail + 1, std::memory_order_release );
+
+        return true;
+    }
+
+    template<typename T, unsigned int SIZE>
+    bool SPSCQueue<T, SIZE>::pop( T &item ) {
+        auto head = _head.load( std::memory_order_relaxed );
+
+        if( head == _tail.load( std::memory_order_acquire ) ) {
+            return false;
+        }
+
+        item = _items[head & ( SIZE - 1 )];
+        _head.store( head + 1, std::memory_order_release );
+
+        return true;
+    }
+}
+
+#endif
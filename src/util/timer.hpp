@@ -7,6 +7,7 @@ namespace simq::util {
     class Timer {
         public:
         static unsigned long int tick();
+        static unsigned long int tickMicro();
     };
 
     unsigned long int Timer::tick() {
@@ -15,6 +16,14 @@ namespace simq::util {
 
         return std::chrono::duration_cast<std::chrono::milliseconds>(epoch).count();
     }
+
+    // monotonic, for measuring intervals
+    unsigned long int Timer::tickMicro() {
+        auto time = std::chrono::steady_clock::now();
+        auto epoch = time.time_since_epoch();
+
+        return std::chrono::duration_cast<std::chrono::microseconds>(epoch).count();
+    }
 }
 
 #endif
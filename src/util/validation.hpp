@@ -3,6 +3,7 @@
 
 #include "uuid.hpp"
 #include "types.h"
+#include <sys/un.h>
 #include <string.h>
 #include <thread>
 
@@ -18,7 +19,9 @@ namespace simq::util {
             static bool isProducerName( const char *name );
             static bool isUUID( const char *name );
             static bool isPort( unsigned int port );
+            static bool isUnixSocketPath( const char *path );
             static bool isCountThread( unsigned int count );
+            static bool isChannelShards( unsigned int count );
             static bool isUInt( const char *value );
             static bool isChannelLimitMessages( util::types::ChannelLimitMessages &limitMessages );
     };
@@ -146,6 +149,11 @@ namespace simq::util {
         return port > 0 && port <= 0xFF'FF;
     }
 
+    bool Validation::isUnixSocketPath( const char *path ) {
+        auto length = strlen( path );
+        return length > 0 && length < sizeof( sockaddr_un::sun_path );
+    }
+
     bool Validation::isUInt( const char *value ) {
         unsigned long int v = 0;
         bool isStartNull = false;
@@ -186,6 +194,10 @@ namespace simq::util {
         return count <= hc + hc / 2;
     }
 
+    bool Validation::isChannelShards( unsigned int count ) {
+        return count > 0 && count <= 64;
+    }
+
     bool Validation::isChannelLimitMessages( util::types::ChannelLimitMessages &limitMessages ) {
         unsigned long int _size = limitMessages.maxMessagesOnDisk;
         _size += limitMessages.maxMessagesInMemory;
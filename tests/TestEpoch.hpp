@@ -0,0 +1,285 @@
+#ifndef SIMQ_TEST_EPOCH
+#define SIMQ_TEST_EPOCH
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "../src/util/epoch.hpp"
+#include "../src/util/snapshot.hpp"
+#include "../src/util/error.h"
+
+namespace simq::test {
+    class Epoch {
+        private:
+            // counts its own deletes
+            struct Retired {
+                std::atomic_uint *countFreed;
+                ~Retired() { ( *countFreed )++; };
+            };
+
+            void _printPassed();
+            void _printFailed();
+            void _print( bool isPassed );
+
+            void _runRetire();
+            void _runSynchronize();
+            void _runSnapshot();
+        public:
+            void run();
+    };
+
+    void Epoch::_printPassed() {
+        std::cout << "\x1b[32m";
+        std::cout << "passed" << std::endl;
+        std::cout << "\x1b[0m";
+    }
+
+    void Epoch::_printFailed() {
+        std::cout << "\x1b[31m";
+        std::cout << "failed" << std::endl;
+        std::cout << "\x1b[0m";
+    }
+
+    void Epoch::_print( bool isPassed ) {
+        if( isPassed ) {
+            _printPassed();
+        } else {
+            _printFailed();
+        }
+    }
+
+    void Epoch::_runRetire() {
+        try {
+            std::cout << "retire without readers: ";
+
+            std::atomic_uint countFreed{0};
+            util::Epoch epoch;
+            epoch.retire( new Retired{ &countFreed } );
+
+            _print( countFreed == 1 );
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "retire keeps what a reader can see: ";
+
+            std::atomic_uint countFreed{0};
+            util::Epoch epoch;
+            bool isKept;
+
+            {
+                util::Epoch::Guard guard( epoch );
+                epoch.retire( new Retired{ &countFreed } );
+                isKept = countFreed == 0;
+            }
+
+            // the next retire frees the previous one
+            epoch.retire( new Retired{ &countFreed } );
+
+            _print( isKept && countFreed == 2 );
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "retire keeps what a reader of another thread can see: ";
+
+            std::atomic_uint countFreed{0};
+            std::atomic_bool isEntered{false};
+            std::atomic_bool isDone{false};
+            util::Epoch epoch;
+
+            std::thread reader( [&]() {
+                util::Epoch::Guard guard( epoch );
+                isEntered = true;
+
+                while( !isDone ) {
+                    std::this_thread::yield();
+                }
+            } );
+
+            while( !isEntered ) {
+                std::this_thread::yield();
+            }
+
+            epoch.retire( new Retired{ &countFreed } );
+            auto isKept = countFreed == 0;
+
+            isDone = true;
+            reader.join();
+
+            epoch.retire( new Retired{ &countFreed } );
+
+            _print( isKept && countFreed == 2 );
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "retire in a nested guard: ";
+
+            std::atomic_uint countFreed{0};
+            util::Epoch epoch;
+            bool isKept;
+
+            {
+                util::Epoch::Guard guard( epoch );
+                {
+                    util::Epoch::Guard nested( epoch );
+                }
+                epoch.retire( new Retired{ &countFreed } );
+                isKept = countFreed == 0;
+            }
+
+            epoch.retire( new Retired{ &countFreed } );
+
+            _print( isKept && countFreed == 2 );
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "destructor frees retired: ";
+
+            std::atomic_uint countFreed{0};
+            std::atomic_bool isEntered{false};
+            std::atomic_bool isDone{false};
+
+            {
+                util::Epoch epoch;
+
+                std::thread reader( [&]() {
+                    util::Epoch::Guard guard( epoch );
+                    isEntered = true;
+
+                    while( !isDone ) {
+                        std::this_thread::yield();
+                    }
+                } );
+
+                while( !isEntered ) {
+                    std::this_thread::yield();
+                }
+
+                epoch.retire( new Retired{ &countFreed } );
+                isDone = true;
+                reader.join();
+            }
+
+            _print( countFreed == 1 );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void Epoch::_runSynchronize() {
+        try {
+            std::cout << "synchronize without readers: ";
+
+            util::Epoch epoch;
+            epoch.synchronize();
+
+            _printPassed();
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "synchronize waits for a reader: ";
+
+            std::atomic_bool isEntered{false};
+            std::atomic_bool isLeft{false};
+            util::Epoch epoch;
+
+            std::thread reader( [&]() {
+                util::Epoch::Guard guard( epoch );
+                isEntered = true;
+
+                std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+                isLeft = true;
+            } );
+
+            while( !isEntered ) {
+                std::this_thread::yield();
+            }
+
+            epoch.synchronize();
+            auto isWaited = isLeft.load();
+
+            reader.join();
+
+            _print( isWaited );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void Epoch::_runSnapshot() {
+        try {
+            std::cout << "snapshot reader keeps its value during an update: ";
+
+            util::Snapshot<unsigned int> snapshot;
+            std::atomic_bool isEntered{false};
+            std::atomic_bool isUpdated{false};
+            bool isKept;
+
+            std::thread reader( [&]() {
+                util::Snapshot<unsigned int>::Reader value( snapshot );
+                isEntered = true;
+
+                std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+                isKept = *value == 0 && !isUpdated;
+            } );
+
+            while( !isEntered ) {
+                std::this_thread::yield();
+            }
+
+            snapshot.update( []( unsigned int &value ) {
+                value = 1;
+            } );
+            isUpdated = true;
+
+            reader.join();
+
+            util::Snapshot<unsigned int>::Reader value( snapshot );
+
+            _print( isKept && *value == 1 );
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "snapshot update that throws: ";
+
+            util::Snapshot<unsigned int> snapshot;
+
+            try {
+                snapshot.update( []( unsigned int &value ) {
+                    value = 1;
+                    throw util::Error::WRONG_PARAM;
+                } );
+            } catch( util::Error::Err err ) {}
+
+            util::Snapshot<unsigned int>::Reader value( snapshot );
+
+            _print( *value == 0 );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void Epoch::run() {
+        std::cout << "test epoch" << std::endl;
+
+        _runRetire();
+        _runSynchronize();
+        _runSnapshot();
+
+        std::cout << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef SIMQ_TEST_RW_LOCK
+#define SIMQ_TEST_RW_LOCK
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include "../src/util/rw_lock.hpp"
+
+namespace simq::test {
+    class RWLock {
+        private:
+            static const unsigned int COUNT_THREADS = 8;
+            static const unsigned int COUNT_ITERATIONS = 20'000;
+
+            void _printPassed();
+            void _printFailed();
+            void _print( bool isPassed );
+
+            void _runTry();
+            void _runWriterPreferred();
+            void _runStress();
+        public:
+            void run();
+    };
+
+    void RWLock::_printPassed() {
+        std::cout << "\x1b[32m";
+        std::cout << "passed" << std::endl;
+        std::cout << "\x1b[0m";
+    }
+
+    void RWLock::_printFailed() {
+        std::cout << "\x1b[31m";
+        std::cout << "failed" << std::endl;
+        std::cout << "\x1b[0m";
+    }
+
+    void RWLock::_print( bool isPassed ) {
+        if( isPassed ) {
+            _printPassed();
+        } else {
+            _printFailed();
+        }
+    }
+
+    void RWLock::_runTry() {
+        try {
+            std::cout << "try lock shared by many readers: ";
+
+            util::RWLock lock;
+            auto isLocked = lock.try_lock_shared() && lock.try_lock_shared();
+            auto isWriterDenied = !lock.try_lock();
+
+            lock.unlock_shared();
+            lock.unlock_shared();
+
+            _print( isLocked && isWriterDenied && lock.try_lock() );
+            lock.unlock();
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "try lock held by a writer: ";
+
+            util::RWLock lock;
+            lock.lock();
+
+            auto isDenied = !lock.try_lock() && !lock.try_lock_shared();
+
+            lock.unlock();
+
+            _print( isDenied && lock.try_lock_shared() );
+            lock.unlock_shared();
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void RWLock::_runWriterPreferred() {
+        try {
+            std::cout << "new readers wait behind a waiting writer: ";
+
+            util::RWLock lock;
+            std::atomic_bool isWritten{false};
+
+            lock.lock_shared();
+
+            std::thread writer( [&]() {
+                std::lock_guard<util::RWLock> guard( lock );
+                isWritten = true;
+            } );
+
+            // the writer announces itself before it sleeps
+            while( lock.try_lock_shared() ) {
+                lock.unlock_shared();
+                std::this_thread::yield();
+            }
+
+            std::thread reader( [&]() {
+                std::shared_lock<util::RWLock> guard( lock );
+            } );
+
+            std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+            auto isWaiting = !isWritten;
+
+            lock.unlock_shared();
+
+            writer.join();
+            reader.join();
+
+            _print( isWaiting && isWritten );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void RWLock::_runStress() {
+        try {
+            std::cout << "readers and writers under contention: ";
+
+            util::RWLock lock;
+            std::atomic_bool isBroken{false};
+            std::atomic_uint countReaders{0};
+            unsigned int first = 0;
+            unsigned int second = 0;
+
+            std::vector<std::thread> threads;
+
+            for( unsigned int i = 0; i < COUNT_THREADS; i++ ) {
+                threads.emplace_back( [&, i]() {
+                    for( unsigned int j = 0; j < COUNT_ITERATIONS; j++ ) {
+                        if( ( i + j ) % 4 == 0 ) {
+                            std::lock_guard<util::RWLock> guard( lock );
+
+                            if( countReaders != 0 ) {
+                                isBroken = true;
+                            }
+
+                            first++;
+                            second++;
+                        } else {
+                            std::shared_lock<util::RWLock> guard( lock );
+                            countReaders++;
+
+                            if( first != second ) {
+                                isBroken = true;
+                            }
+
+                            countReaders--;
+                        }
+                    }
+                } );
+            }
+
+            for( auto &thread : threads ) {
+                thread.join();
+            }
+
+            _print( !isBroken && first == COUNT_THREADS * COUNT_ITERATIONS / 4 && first == second );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void RWLock::run() {
+        std::cout << "test rw lock" << std::endl;
+
+        _runTry();
+        _runWriterPreferred();
+        _runStress();
+
+        std::cout << std::endl;
+    }
+}
+
+#endif
@@ -0,0 +1,247 @@
+#ifndef SIMQ_TEST_SEGMENTED_QUEUE
+#define SIMQ_TEST_SEGMENTED_QUEUE
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../src/util/segmented_queue.hpp"
+#include "../src/core/server/q/messages.hpp"
+#include "../src/util/types.h"
+#include "../src/util/uuid.hpp"
+
+namespace simq::test {
+    class SegmentedQueue {
+        private:
+            static const unsigned int COUNT_PRODUCERS = 4;
+            static const unsigned int COUNT_CONSUMERS = 4;
+            // several segments per producer
+            static const unsigned int COUNT_ITEMS = 50'000;
+            static const unsigned int COUNT_MESSAGES = 5'000;
+
+            void _printPassed();
+            void _printFailed();
+            void _print( bool isPassed );
+
+            void _runOneThread();
+            void _runManyThreads();
+            void _runTokens();
+        public:
+            void run();
+    };
+
+    void SegmentedQueue::_printPassed() {
+        std::cout << "\x1b[32m";
+        std::cout << "passed" << std::endl;
+        std::cout << "\x1b[0m";
+    }
+
+    void SegmentedQueue::_printFailed() {
+        std::cout << "\x1b[31m";
+        std::cout << "failed" << std::endl;
+        std::cout << "\x1b[0m";
+    }
+
+    void SegmentedQueue::_print( bool isPassed ) {
+        if( isPassed ) {
+            _printPassed();
+        } else {
+            _printFailed();
+        }
+    }
+
+    void SegmentedQueue::_runOneThread() {
+        try {
+            std::cout << "pop from empty: ";
+
+            util::Epoch epoch;
+            util::SegmentedQueue queue( epoch );
+            unsigned long token;
+
+            _print( !queue.pop( token ) );
+        } catch( ... ) {
+            _printFailed();
+        }
+
+        try {
+            std::cout << "fifo across segments: ";
+
+            util::Epoch epoch;
+            util::SegmentedQueue queue( epoch );
+            unsigned long token;
+            bool isOrdered = true;
+
+            for( unsigned long i = 1; i <= 5'000; i++ ) {
+                queue.push( i );
+            }
+
+            for( unsigned long i = 1; i <= 5'000; i++ ) {
+                if( !queue.pop( token ) || token != i ) {
+                    isOrdered = false;
+                }
+            }
+
+            _print( isOrdered && !queue.pop( token ) );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void SegmentedQueue::_runManyThreads() {
+        try {
+            std::cout << "every token popped once by many threads: ";
+
+            util::Epoch epoch;
+            util::SegmentedQueue queue( epoch );
+            auto countPopped = std::make_unique<std::atomic_uint[]>( COUNT_PRODUCERS * COUNT_ITEMS + 1 );
+            std::atomic_uint total{0};
+            std::vector<std::thread> threads;
+
+            for( unsigned int i = 0; i < COUNT_PRODUCERS; i++ ) {
+                threads.emplace_back( [&, i]() {
+                    for( unsigned int j = 1; j <= COUNT_ITEMS; j++ ) {
+                        queue.push( i * COUNT_ITEMS + j );
+                    }
+                } );
+            }
+
+            for( unsigned int i = 0; i < COUNT_CONSUMERS; i++ ) {
+                threads.emplace_back( [&]() {
+                    unsigned long token;
+
+                    while( total < COUNT_PRODUCERS * COUNT_ITEMS ) {
+                        if( queue.pop( token ) ) {
+                            countPopped[token]++;
+                            total++;
+                        }
+                    }
+                } );
+            }
+
+            for( auto &thread : threads ) {
+                thread.join();
+            }
+
+            bool isOnce = true;
+            for( unsigned int i = 1; i <= COUNT_PRODUCERS * COUNT_ITEMS; i++ ) {
+                if( countPopped[i] != 1 ) {
+                    isOnce = false;
+                }
+            }
+
+            unsigned long token;
+            _print( isOnce && !queue.pop( token ) );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    // The way q::Manager uses the queue: a token is claimed before delivery,
+    // an unclaimed message is pushed again, and the token of a freed message
+    // stays in the queue and must not claim the message reusing its id
+    void SegmentedQueue::_runTokens() {
+        try {
+            std::cout << "claim, unclaim and stale tokens: ";
+
+            char path[] = "/tmp/simq-test-queue-XXXXXX";
+            auto fd = mkstemp( path );
+            if( fd == -1 ) {
+                throw util::Error::FS_ERROR;
+            }
+            close( fd );
+
+            util::types::ChannelLimitMessages limits{ 1, 1'024, COUNT_PRODUCERS * COUNT_MESSAGES, 0 };
+            auto messages = std::make_unique<core::server::q::Messages>( path, limits );
+
+            util::Epoch epoch;
+            util::SegmentedQueue queue( epoch );
+            std::atomic_uint countAcked{0};
+            std::atomic_bool isBroken{false};
+            std::vector<std::thread> threads;
+
+            for( unsigned int i = 0; i < COUNT_PRODUCERS; i++ ) {
+                threads.emplace_back( [&]() {
+                    char uuid[util::UUID::LENGTH+1]{};
+
+                    for( unsigned int j = 0; j < COUNT_MESSAGES; j++ ) {
+                        auto id = messages->addForQ( 1, uuid );
+                        queue.push( messages->enqueue( id ) );
+                    }
+                } );
+            }
+
+            for( unsigned int i = 0; i < COUNT_CONSUMERS; i++ ) {
+                threads.emplace_back( [&]() {
+                    unsigned long token;
+                    unsigned int countClaimed = 0;
+
+                    while( countAcked < COUNT_PRODUCERS * COUNT_MESSAGES ) {
+                        if( !queue.pop( token ) ) {
+                            continue;
+                        }
+
+                        auto id = messages->claim( token );
+                        if( id == 0 ) {
+                            continue;
+                        }
+
+                        // a claimed message can not be claimed again
+                        if( messages->claim( token ) != 0 ) {
+                            isBroken = true;
+                        }
+
+                        if( ++countClaimed % 3 == 0 ) {
+                            auto unclaimed = messages->unclaim( id );
+                            if( unclaimed != token ) {
+                                isBroken = true;
+                            }
+
+                            queue.push( unclaimed );
+                            continue;
+                        }
+
+                        messages->free( id );
+                        countAcked++;
+
+                        // the id may be reused, the old token must stay stale
+                        queue.push( token );
+                    }
+                } );
+            }
+
+            for( auto &thread : threads ) {
+                thread.join();
+            }
+
+            unsigned long token;
+            while( queue.pop( token ) ) {
+                if( messages->claim( token ) != 0 ) {
+                    isBroken = true;
+                }
+            }
+
+            messages.reset();
+            remove( path );
+
+            _print( !isBroken && countAcked == COUNT_PRODUCERS * COUNT_MESSAGES );
+        } catch( ... ) {
+            _printFailed();
+        }
+    }
+
+    void SegmentedQueue::run() {
+        std::cout << "test segmented queue" << std::endl;
+
+        _runOneThread();
+        _runManyThreads();
+        _runTokens();
+
+        std::cout << std::endl;
+    }
+}
+
+#endif